@@ -0,0 +1,366 @@
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "arena.h"
+#include "bit_slice.h"
+#include "chromosome.h"
+#include "crossovers.h"
+#include "genetic_solver.h"
+#include "initializers.h"
+#include "mutations.h"
+#include "niching.h"
+#include "selections.h"
+#include "thread_pool.h"
+#include "translators.h"
+
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::string;
+
+using namespace GeneticAlgorithms;
+
+/*
+ * Micro-benchmarks of the genetic operators and of full solve() runs.
+ *
+ * Usage:
+ *   benchmark [--min-time seconds] [--output file.json]
+ *             [--compare baseline.json] [--threshold fraction]
+ *
+ * Every result is a metric with a unit: ns/bit, ns/couple,
+ * ns/chromosome (lower is better) or gens/s (higher is better).
+ * Results are printed as JSON, one result per line, and written to
+ * --output when given. With --compare, results are compared to a
+ * baseline written before, and the program exits with status 1 when
+ * any metric is worse than the baseline by more than the threshold
+ * (0.1 by default).
+ */
+
+struct Result {
+  string name;
+  double value;
+  string unit;
+};
+
+static double min_time = 0.2;
+static volatile uint64_t sink = 0u;
+
+static bool higher_is_better(const string &unit) {
+  return unit == "gens/s";
+}
+
+/// Mean seconds per call of f, calling it until min_time is reached
+template<typename F>
+static double time_per_call(F f) {
+  typedef std::chrono::steady_clock clock;
+  f(); // warm up
+  size_t n = 0u;
+  const clock::time_point start = clock::now();
+  double elapsed = 0.0;
+  do {
+    for (size_t i=0; i<16u; ++i) f();
+    n += 16u;
+    elapsed = std::chrono::duration<double>(clock::now() - start).count();
+  } while (elapsed < min_time);
+  return elapsed / n;
+}
+
+struct PopCountRank {
+  float operator()(const Chromosome &x) const {
+    uint64_t r = 0u;
+    for (size_t i=0; i<x.num_blocks(); ++i) r += BitKernels::popcount(x.blocks()[i]);
+    return static_cast<float>(r);
+  }
+};
+
+/// Number of active gens, ranked one by one or a slice at a time
+struct OneMaxRank {
+  float operator()(const Chromosome &x) const {
+    size_t r = 0u;
+    for (size_t i=0; i<x.size(); ++i) r += x[i];
+    return static_cast<float>(r);
+  }
+  template<size_t W>
+  void operator()(const BasicBitSlice<W> &slice, float *ranks) const {
+    BasicSlicedCounter<W> ones;
+    for (size_t j=0; j<slice.numGens(); ++j) ones.add(slice.word(j));
+    ones.counts(ranks, slice.rows());
+  }
+};
+
+static void add(std::vector<Result> &results, const string &name,
+                const double value, const string &unit) {
+  Result r = { name, value, unit };
+  results.push_back(r);
+  cerr << name << ": " << value << " " << unit << endl;
+}
+
+static string name_of(const string &op, const size_t N) {
+  std::ostringstream out;
+  out << op << "/N=" << N;
+  return out.str();
+}
+
+static void bench_operators(std::vector<Result> &results, const size_t N) {
+  Chromosome a(N), b(N), dest(N);
+  RandomInitializer(N, 1u, 0.5f)(a);
+  RandomInitializer(N, 2u, 0.5f)(b);
+  const double bits = double(N);
+  auto per_bit = [&](const string &op, double seconds) {
+    add(results, name_of(op, N), seconds * 1e9 / bits, "ns/bit");
+  };
+
+  for (float p : { 0.5f, 0.1f }) {
+    RandomInitializer init(N, 3u, p);
+    std::ostringstream op;
+    op << "RandomInitializer(p=" << p << ")";
+    per_bit(op.str(), time_per_call([&]{ init(dest); sink += dest.blocks()[0]; }));
+  }
+
+  RandomSplitCrossOver split(N, 4u);
+  per_bit("RandomSplitCrossOver",
+          time_per_call([&]{ split(a, b, dest); sink += dest.blocks()[0]; }));
+  RandomMixCrossOver mix(5u);
+  per_bit("RandomMixCrossOver",
+          time_per_call([&]{ mix(a, b, dest); sink += dest.blocks()[0]; }));
+  TwoPointCrossOver two_point(N, 6u);
+  per_bit("TwoPointCrossOver",
+          time_per_call([&]{ two_point(a, b, dest); sink += dest.blocks()[0]; }));
+  auto on_prob = make_cross_over_on_prob(7u, 0.5f, RandomMixCrossOver(8u));
+  per_bit("CrossOverOnProbWrapper(p=0.5,RandomMix)",
+          time_per_call([&]{ on_prob(a, b, dest); sink += dest.blocks()[0]; }));
+
+  for (float p : { 0.001f, 0.01f, 0.1f, 0.5f }) {
+    RandomMutate mutate(9u, p);
+    std::ostringstream op;
+    op << "RandomMutate(p=" << p << ")";
+    per_bit(op.str(), time_per_call([&]{ mutate(dest, dest); sink += dest.blocks()[0]; }));
+  }
+
+  for (float p : { 0.001f, 0.1f }) {
+    RandomMutate mutate(17u, p);
+    std::ostringstream op;
+    op << "breed_into(RandomMix,RandomMutate(p=" << p << "))";
+    per_bit(op.str(), time_per_call([&]{
+          breed_into(mix, mutate, a, b, dest);
+          sink += dest.blocks()[0];
+        }));
+  }
+
+  // decodes as many 16 bits floats as the chromosome contains
+  per_bit("Decoder(Float16)", time_per_call([&]{
+        Decoder decoder(a);
+        float sum = 0.0f;
+        for (size_t i=0; i+16u<=N; i+=16u) sum += decoder.decodeFloat(16u, -5.0f, 5.0f);
+        sink += static_cast<uint64_t>(sum);
+      }));
+}
+
+template<typename SelectionFunctor>
+static void bench_select(std::vector<Result> &results, const string &op,
+                         const SelectionFunctor &select_func,
+                         const std::vector<float> &ranks, ThreadPool *pool) {
+  const size_t P = ranks.size();
+  const double seconds = time_per_call([&]{
+      sink += select_couples(select_func, ranks, P, pool).back().first;
+    });
+  std::ostringstream name;
+  name << op << "/P=" << P;
+  add(results, name.str(), seconds * 1e9 / P, "ns/couple");
+}
+
+static void bench_selection(std::vector<Result> &results, const size_t P,
+                            ThreadPool &pool) {
+  std::vector<float> ranks(P);
+  CounterRng rng(10u);
+  for (float &r : ranks) r = static_cast<float>(rng() % 1000u);
+  std::ostringstream pool_name;
+  pool_name << "(pool=" << pool.size() << ")";
+  bench_select(results, "RouletteWheelSelection",
+               RouletteWheelSelection<float>(11u), ranks, nullptr);
+  bench_select(results, "AliasRouletteWheelSelection",
+               FloatAliasRouletteWheelSelection(11u), ranks, nullptr);
+  bench_select(results, "AliasRouletteWheelSelection" + pool_name.str(),
+               FloatAliasRouletteWheelSelection(11u), ranks, &pool);
+  bench_select(results, "StochasticUniversalSampling",
+               FloatStochasticUniversalSampling(11u), ranks, nullptr);
+  bench_select(results, "StochasticUniversalSampling" + pool_name.str(),
+               FloatStochasticUniversalSampling(11u), ranks, &pool);
+  bench_select(results, "TournamentSelection",
+               TournamentSelection(11u), ranks, nullptr);
+  bench_select(results, "TournamentSelection" + pool_name.str(),
+               TournamentSelection(11u), ranks, &pool);
+}
+
+static void bench_rank(std::vector<Result> &results, const size_t N) {
+  const size_t P = 1024u;
+  ChromosomeArena<Chromosome> arena;
+  RandomInitializer init(N, 16u, 0.5f);
+  for (size_t i=0; i<P; ++i) init(arena.emplace(N));
+  const GeneMatrix genes = { arena.data(), arena.stride(), P, N };
+  std::vector<float> ranks(P);
+  const OneMaxRank scalar = OneMaxRank();
+  const SlicedRank<OneMaxRank> sliced = make_sliced_rank(OneMaxRank());
+  const SlicedRank<OneMaxRank, 4u> sliced256 = make_sliced_rank<4u>(OneMaxRank());
+  add(results, name_of("OneMaxRank(scalar)", N), time_per_call([&]{
+        for (size_t i=0; i<P; ++i) ranks[i] = scalar(arena[i]);
+        sink += static_cast<uint64_t>(ranks[0]);
+      }) * 1e9 / P, "ns/chromosome");
+  add(results, name_of("OneMaxRank(sliced)", N), time_per_call([&]{
+        sliced(genes, ranks.data());
+        sink += static_cast<uint64_t>(ranks[0]);
+      }) * 1e9 / P, "ns/chromosome");
+  add(results, name_of("OneMaxRank(sliced256)", N), time_per_call([&]{
+        sliced256(genes, ranks.data());
+        sink += static_cast<uint64_t>(ranks[0]);
+      }) * 1e9 / P, "ns/chromosome");
+}
+
+static void bench_niching(std::vector<Result> &results, const size_t N,
+                          ThreadPool &pool) {
+  const size_t P = 4096u;
+  Population<PopCountRank, float, Chromosome> population(PopCountRank(), nullptr);
+  population.init(RandomInitializer(N, 17u, 0.5f), P);
+  const double radius = N / 16.0;
+  std::vector<double> counts;
+  std::vector<NicheScratch> scratch;
+  BitSamplingLSH lsh(N, 8u, BitSamplingLSH::key_bits_for(N, radius), 18u);
+  std::ostringstream pool_name;
+  pool_name << ",pool=" << pool.size();
+  for (const string &suffix : { string(), pool_name.str() }) {
+    if (!suffix.empty()) population.setPool(&pool);
+    add(results, name_of("niche_counts(exact" + suffix + ")", N), time_per_call([&]{
+          niche_counts(population, radius, 1.0, counts, scratch);
+          sink += static_cast<uint64_t>(counts[0]);
+        }) * 1e9 / P, "ns/chromosome");
+    add(results, name_of("niche_counts(LSH" + suffix + ")", N), time_per_call([&]{
+          niche_counts(population, radius, 1.0, lsh, counts, scratch);
+          sink += static_cast<uint64_t>(counts[0]);
+        }) * 1e9 / P, "ns/chromosome");
+  }
+}
+
+static void bench_solve(std::vector<Result> &results, const size_t N,
+                        const size_t P) {
+  const size_t generations = 10u;
+  const double seconds = time_per_call([&]{
+      Chromosome best = solve(generations, P,
+                              RandomInitializer(N, 12u, 0.5f),
+                              TournamentSelection(13u, 2u),
+                              RandomMixCrossOver(14u),
+                              RandomMutate(15u, 1.0f / N),
+                              PopCountRank());
+      sink += best.blocks()[0];
+    });
+  std::ostringstream name;
+  name << "solve/N=" << N << "/P=" << P;
+  add(results, name.str(), generations / seconds, "gens/s");
+}
+
+static void write_json(std::ostream &out, const std::vector<Result> &results) {
+  out << "[\n";
+  for (size_t i=0; i<results.size(); ++i) {
+    out << "{\"name\":\"" << results[i].name << "\",\"value\":"
+        << results[i].value << ",\"unit\":\"" << results[i].unit << "\"}"
+        << (i + 1u < results.size() ? "," : "") << "\n";
+  }
+  out << "]\n";
+}
+
+/// Reads a file written by write_json(), one result per line
+static std::vector<Result> read_json(const string &path) {
+  std::ifstream in(path.c_str());
+  if (!in) {
+    cerr << "Unable to open " << path << endl;
+    std::exit(2);
+  }
+  std::vector<Result> results;
+  string line;
+  while (std::getline(in, line)) {
+    const size_t name = line.find("\"name\":\"");
+    const size_t value = line.find("\"value\":");
+    const size_t unit = line.find("\"unit\":\"");
+    if (name == string::npos || value == string::npos || unit == string::npos) continue;
+    Result r;
+    r.name = line.substr(name + 8u, line.find('"', name + 8u) - name - 8u);
+    r.value = std::atof(line.c_str() + value + 8u);
+    r.unit = line.substr(unit + 8u, line.find('"', unit + 8u) - unit - 8u);
+    results.push_back(r);
+  }
+  return results;
+}
+
+/// Prints the comparison, returns the number of regressions
+static size_t compare(const std::vector<Result> &baseline,
+                      const std::vector<Result> &results,
+                      const double threshold) {
+  std::map<string, Result> base;
+  for (const Result &r : baseline) base[r.name] = r;
+  size_t regressions = 0u;
+  for (const Result &r : results) {
+    auto it = base.find(r.name);
+    if (it == base.end() || it->second.unit != r.unit || it->second.value <= 0.0) {
+      cout << "NEW        " << r.name << " " << r.value << " " << r.unit << endl;
+      continue;
+    }
+    // positive change is always a slowdown
+    double change = r.value / it->second.value - 1.0;
+    if (higher_is_better(r.unit)) change = it->second.value / r.value - 1.0;
+    const bool regression = change > threshold;
+    if (regression) ++regressions;
+    cout << (regression ? "REGRESSION " : "ok         ") << r.name << " "
+         << it->second.value << " -> " << r.value << " " << r.unit
+         << " (" << (change > 0.0 ? "+" : "") << change * 100.0 << "%)"
+         << endl;
+  }
+  return regressions;
+}
+
+int main(int argc, char **argv) {
+  string output, baseline;
+  double threshold = 0.1;
+  for (int i=1; i<argc; ++i) {
+    const string arg = argv[i];
+    if (i + 1 < argc && arg == "--min-time") min_time = std::atof(argv[++i]);
+    else if (i + 1 < argc && arg == "--output") output = argv[++i];
+    else if (i + 1 < argc && arg == "--compare") baseline = argv[++i];
+    else if (i + 1 < argc && arg == "--threshold") threshold = std::atof(argv[++i]);
+    else {
+      cerr << "Usage: " << argv[0] << " [--min-time seconds] [--output file.json]"
+           << " [--compare baseline.json] [--threshold fraction]" << endl;
+      return 2;
+    }
+  }
+
+  std::vector<Result> results;
+  for (size_t N : { 64u, 1024u, 16384u }) bench_operators(results, N);
+  ThreadPool pool(4u);
+  for (size_t P : { 100u, 1000u, 10000u, 100000u }) bench_selection(results, P, pool);
+  for (size_t N : { 64u, 1024u }) bench_rank(results, N);
+  for (size_t N : { 64u, 1024u }) bench_niching(results, N, pool);
+  for (size_t N : { 64u, 1024u }) {
+    for (size_t P : { 100u, 1000u }) bench_solve(results, N, P);
+  }
+
+  write_json(cout, results);
+  if (!output.empty()) {
+    std::ofstream out(output.c_str());
+    write_json(out, results);
+  }
+  if (!baseline.empty()) {
+    const size_t regressions = compare(read_json(baseline), results, threshold);
+    cout << regressions << " regressions over " << threshold * 100.0
+         << "% threshold" << endl;
+    return regressions > 0u ? 1 : 0;
+  }
+  return 0;
+}
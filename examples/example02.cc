@@ -1,7 +1,9 @@
+#include <algorithm>
 #include <iostream>
 #include <random>
 #include <vector>
 
+#include "batch_rank.h"
 #include "chromosome.h"
 #include "crossovers.h"
 #include "genetic_solver.h"
@@ -39,6 +41,26 @@ struct MyRank {
     }
     return B;
   }
+  // batch version: the product of the gene matrix by weights and
+  // benefits, with the inner loop over rows, which can be vectorized
+  void operator()(const GeneMatrix &genes, float *ranks) const {
+    vector<float> W(genes.rows, 0.0f);
+    fill(ranks, ranks + genes.rows, 0.0f);
+    for (size_t j=0u; j<genes.num_gens; ++j) {
+      const size_t word = j / bits_per_block;
+      const size_t bit = j % bits_per_block;
+      const float w = _objects[j].second;
+      const float b = _objects[j].first;
+      for (size_t i=0u; i<genes.rows; ++i) {
+        const float x = static_cast<float>((genes.row(i)[word] >> bit) & 1u);
+        W[i] += x * w;
+        ranks[i] += x * b;
+      }
+    }
+    for (size_t i=0u; i<genes.rows; ++i) {
+      if (W[i] > _Q) ranks[i] = 0.0f;
+    }
+  }
   vector<object_t> _objects;
   float _Q;
 };
@@ -57,15 +79,15 @@ int main() {
   
   MyRank rank(objects, Q);
   Chromosome best =
-    solve(1000u,
-          1000u,
-          RandomInitializer(N, rng(), 0.1f),
-          FloatRouletteWheelSelection(rng()),
-          make_cross_over_on_prob(rng(), 0.5f,
-                                  RandomMixCrossOver(rng())),
-          RandomMutate(rng(), 0.001f),
-          rank,
-          1);
+    solve_until(MaxGenerations(1000u) || Stagnation(400u),
+                1000u,
+                RandomInitializer(N, rng(), 0.1f),
+                FloatRouletteWheelSelection(rng()),
+                make_cross_over_on_prob(rng(), 0.5f,
+                                        RandomMixCrossOver(rng())),
+                RandomMutate(rng(), 0.001f),
+                rank,
+                1);
   float w = 0.0f;
   for (size_t i=0; i<best.size(); ++i) {
     if (best[i]) w += objects[i].second;
@@ -0,0 +1,312 @@
+/*
+ * This file is part of GeneticAlgorithms toolkit
+ *
+ * Copyright 2017, Francisco Zamora-Martinez
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include "chromosome.h"
+
+namespace GeneticAlgorithms {
+
+  /// Alignment in bytes of the gene matrix rows of a ChromosomeArena
+  static const size_t ARENA_ALIGNMENT = 64u;
+
+  /**
+   * Allocator of memory aligned to Alignment bytes
+   *
+   * C++11 operator new only guarantees the alignment of fundamental
+   * types, so every block is over-allocated and the pointer given by
+   * operator new is stored just before the aligned address.
+   */
+  template<typename T, size_t Alignment=ARENA_ALIGNMENT>
+  class AlignedAllocator {
+    static_assert(Alignment >= sizeof(void*) && (Alignment & (Alignment - 1u)) == 0u,
+                  "AlignedAllocator requires a power of two alignment");
+  public:
+    typedef T value_type;
+
+    template<typename U>
+    struct rebind {
+      typedef AlignedAllocator<U, Alignment> other;
+    };
+
+    AlignedAllocator() {
+    }
+
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment> &) {
+    }
+
+    T *allocate(const size_t n) {
+      char *raw = static_cast<char*>(::operator new(n*sizeof(T) + Alignment));
+      // at least one pointer between raw and the aligned address
+      const uintptr_t address = reinterpret_cast<uintptr_t>(raw) + Alignment;
+      void **aligned = reinterpret_cast<void**>(address - address % Alignment);
+      aligned[-1] = raw;
+      return reinterpret_cast<T*>(aligned);
+    }
+
+    void deallocate(T *p, const size_t) {
+      ::operator delete(reinterpret_cast<void**>(p)[-1]);
+    }
+  }; // class AlignedAllocator
+
+  template<typename T, typename U, size_t Alignment>
+  bool operator==(const AlignedAllocator<T, Alignment> &,
+                  const AlignedAllocator<U, Alignment> &) {
+    return true;
+  }
+
+  template<typename T, typename U, size_t Alignment>
+  bool operator!=(const AlignedAllocator<T, Alignment> &,
+                  const AlignedAllocator<U, Alignment> &) {
+    return false;
+  }
+
+  /**
+   * Contiguous storage for the chromosomes of one population
+   *
+   * The arena keeps all gens of a population in one gene matrix, a
+   * row of stride() words for each chromosome, and it never releases
+   * memory when cleared. A population which is cleared and refilled
+   * every generation doesn't allocate memory after the first one.
+   *
+   * New chromosomes are added with emplace(), which returns a
+   * reference to the row where the caller should write the gens.
+   * Rows are reused from previous generations, so their content is
+   * undefined until written (but bits past size() are always zero).
+   *
+   * This generic version stores inline chromosomes, as
+   * FixedChromosome, in a vector aligned to ARENA_ALIGNMENT bytes, so
+   * every row is aligned when sizeof(ChromosomeType) is a multiple of
+   * it. There is a specialization for Chromosome which maps them over
+   * an aligned block of memory.
+   */
+  template<typename ChromosomeType>
+  class ChromosomeArena {
+    static_assert(std::is_trivially_copyable<ChromosomeType>::value,
+                  "ChromosomeArena requires inline chromosome types");
+  public:
+    ChromosomeArena() :
+      _size(0u) {
+    }
+
+    size_t size() const {
+      return _size;
+    }
+
+    /// Removes all rows, keeping the memory for later use
+    void clear() {
+      _size = 0u;
+    }
+
+    /// Prepares memory for n chromosomes of num_gens gens
+    void reserve(const size_t n, const size_t num_gens) {
+      while (_rows.size() < n) _rows.push_back(ChromosomeType(num_gens));
+    }
+
+    /// Adds a row at the end and returns it
+    ChromosomeType &emplace(const size_t num_gens) {
+      if (_size == _rows.size()) _rows.push_back(ChromosomeType(num_gens));
+      return _rows[_size++];
+    }
+
+    ChromosomeType &operator[](const size_t i) {
+      return _rows[i];
+    }
+
+    const ChromosomeType &operator[](const size_t i) const {
+      return _rows[i];
+    }
+
+    /// The gene matrix, with size() rows of stride() words
+    const block_type *data() const {
+      return _rows.empty() ? nullptr : _rows.front().blocks();
+    }
+
+    /// Number of words between two consecutive rows of data()
+    size_t stride() const {
+      return sizeof(ChromosomeType) / sizeof(block_type);
+    }
+
+  private:
+    std::vector<ChromosomeType, AlignedAllocator<ChromosomeType> > _rows;
+    size_t _size;
+  }; // class ChromosomeArena
+
+  /**
+   * ChromosomeArena specialization for dynamic size Chromosome
+   *
+   * Gens live in one block of memory aligned to ARENA_ALIGNMENT
+   * bytes, and every row is exposed as a Chromosome mapped over it.
+   * Row strides are rounded to 1, 2, 4 or a multiple of 8 words, so
+   * rows don't cross cache lines unnecessarily. All rows should
+   * contain the same number of gens, which can change only when the
+   * arena is empty.
+   */
+  template<>
+  class ChromosomeArena<Chromosome> {
+  public:
+    ChromosomeArena() :
+      _N(0u),
+      _stride(0u),
+      _size(0u),
+      _capacity(0u),
+      _data(nullptr) {
+    }
+
+    ChromosomeArena(const ChromosomeArena &other) :
+      ChromosomeArena() {
+      *this = other;
+    }
+
+    ChromosomeArena(ChromosomeArena &&other) :
+      ChromosomeArena() {
+      swap(other);
+    }
+
+    ChromosomeArena &operator=(const ChromosomeArena &other) {
+      if (this == &other) return *this;
+      clear();
+      reserve(other._size, other._N);
+      for (size_t i=0; i<other._size; ++i) emplace(other._N) = other[i];
+      return *this;
+    }
+
+    ChromosomeArena &operator=(ChromosomeArena &&other) {
+      swap(other);
+      return *this;
+    }
+
+    void swap(ChromosomeArena &other) {
+      std::swap(_N, other._N);
+      std::swap(_stride, other._stride);
+      std::swap(_size, other._size);
+      std::swap(_capacity, other._capacity);
+      std::swap(_data, other._data);
+      _storage.swap(other._storage);
+      _views.swap(other._views);
+    }
+
+    size_t size() const {
+      return _size;
+    }
+
+    /// Removes all rows, keeping the memory for later use
+    void clear() {
+      _size = 0u;
+    }
+
+    /// Prepares memory for n chromosomes of num_gens gens
+    void reserve(const size_t n, const size_t num_gens) {
+      reshape(num_gens);
+      if (n > _capacity) grow(n);
+    }
+
+    /// Adds a row at the end and returns it
+    Chromosome &emplace(const size_t num_gens) {
+      reshape(num_gens);
+      if (_size == _capacity) grow(std::max<size_t>(16u, 2u*_capacity));
+      return _views[_size++];
+    }
+
+    Chromosome &operator[](const size_t i) {
+      return _views[i];
+    }
+
+    const Chromosome &operator[](const size_t i) const {
+      return _views[i];
+    }
+
+    /// The gene matrix, with size() rows of stride() words
+    const block_type *data() const {
+      return _data;
+    }
+
+    /// Number of words between two consecutive rows of data()
+    size_t stride() const {
+      return _stride;
+    }
+
+  private:
+    size_t _N, _stride, _size, _capacity;
+    /// owned memory, _data is its first word
+    std::vector<block_type, AlignedAllocator<block_type> > _storage;
+    block_type *_data;
+    /// one Chromosome mapped over each row, _capacity in total
+    std::vector<Chromosome> _views;
+
+    static size_t strideFor(const size_t num_gens) {
+      const size_t words_per_line = ARENA_ALIGNMENT / sizeof(block_type);
+      size_t n = num_blocks_for(num_gens);
+      if (n >= words_per_line) {
+        return (n + words_per_line - 1u) / words_per_line * words_per_line;
+      }
+      size_t stride = 1u;
+      while (stride < n) stride <<= 1u;
+      return stride;
+    }
+
+    /// Changes the number of gens, only allowed when empty
+    void reshape(const size_t num_gens) {
+      if (num_gens == _N) return;
+      assert(_size == 0u);
+      _N = num_gens;
+      _stride = strideFor(num_gens);
+      _capacity = 0u;
+      _data = nullptr;
+      _storage.clear();
+      _views.clear();
+    }
+
+    /// Reallocates the gene matrix for capacity rows, keeping current ones
+    void grow(const size_t capacity) {
+      std::vector<block_type, AlignedAllocator<block_type> > storage(capacity * _stride, 0u);
+      block_type *data = storage.data();
+      if (_data != nullptr) std::copy(_data, _data + _size * _stride, data);
+      _storage.swap(storage);
+      _data = data;
+      _capacity = capacity;
+      // views are rebuilt in place, moving a mapped Chromosome copies it
+      _views.clear();
+      _views.reserve(_capacity);
+      for (size_t i=0; i<_capacity; ++i) {
+        _views.emplace_back(Chromosome::map_t(), _data + i*_stride, _N);
+      }
+    }
+  }; // class ChromosomeArena<Chromosome>
+
+} // namespace GeneticAlgorithms
+
+#endif // ARENA_H
@@ -0,0 +1,112 @@
+/*
+ * This file is part of GeneticAlgorithms toolkit
+ *
+ * Copyright 2017, Francisco Zamora-Martinez
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef BATCH_RANK_H
+#define BATCH_RANK_H
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+#include "chromosome.h"
+
+namespace GeneticAlgorithms {
+
+  /**
+   * Read-only view of consecutive rows of a gene matrix
+   *
+   * Row i has num_gens gens stored in words data + i*stride, in the
+   * same order as Chromosome::blocks(), and bits past num_gens are
+   * zero. Gens of every row are the gens of one chromosome, so the
+   * view is the bit matrix of rows x num_gens.
+   */
+  struct GeneMatrix {
+    const block_type *data;
+    size_t stride;
+    size_t rows;
+    size_t num_gens;
+
+    const block_type *row(const size_t i) const {
+      return data + i*stride;
+    }
+
+    /// returns gen j of row i
+    bool operator()(const size_t i, const size_t j) const {
+      return (row(i)[j / bits_per_block] >> (j % bits_per_block)) & 1u;
+    }
+  }; // struct GeneMatrix
+
+  /**
+   * Batch rank protocol
+   *
+   * A RankFunctor may implement, besides its usual operator(), a
+   * method which ranks many chromosomes in one call, writing
+   * ranks[i] for every row i of genes:
+   *
+   * @code
+   * void operator()(const GeneMatrix &genes, T *ranks) const;
+   * @endcode
+   *
+   * Population detects this method at compilation time, and then
+   * evaluate() hands it the pending rows of its arena in batches,
+   * which run in parallel when a ThreadPool is given. It allows to
+   * rank the whole batch with loops over rows, which the compiler can
+   * vectorize, or with a BLAS library. The batch method takes
+   * precedence over the incremental protocol (see incremental.h).
+   * The usual operator() is still required, because other solvers
+   * rank chromosomes one by one.
+   *
+   * @code
+   * // a linear rank: the product of the gene matrix by values
+   * struct LinearRank {
+   *   std::vector<float> values;
+   *   float operator()(const Chromosome &x) const;
+   *   void operator()(const GeneMatrix &genes, float *ranks) const {
+   *     std::fill(ranks, ranks + genes.rows, 0.0f);
+   *     for (size_t j=0; j<genes.num_gens; ++j) {
+   *       for (size_t i=0; i<genes.rows; ++i) ranks[i] += genes(i, j) * values[j];
+   *     }
+   *   }
+   * };
+   * @endcode
+   */
+  template<typename RankFunctor, typename T>
+  class has_batch_rank {
+    template<typename F>
+    static auto test(int) ->
+      decltype(std::declval<const F&>()(std::declval<const GeneMatrix&>(),
+                                        std::declval<T*>()),
+               std::true_type());
+    template<typename F>
+    static std::false_type test(...);
+  public:
+    static const bool value = decltype(test<RankFunctor>(0))::value;
+  }; // class has_batch_rank
+
+} // namespace GeneticAlgorithms
+
+#endif // BATCH_RANK_H
@@ -0,0 +1,420 @@
+/*
+ * This file is part of GeneticAlgorithms toolkit
+ *
+ * Copyright 2017, Francisco Zamora-Martinez
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef BIT_KERNELS_H
+#define BIT_KERNELS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX512F__) || defined(__AVX2__) || defined(__AVX512VPOPCNTDQ__)
+#include <immintrin.h>
+#endif
+
+#include "chromosome.h"
+
+namespace GeneticAlgorithms {
+
+  /**
+   * Word level kernels over chromosome gens
+   *
+   * These functions work over arrays of block_type words as stored by
+   * Chromosome and FixedChromosome. They are the building blocks of
+   * the genetic operators, which this way process 64 gens (or more,
+   * with SIMD) per instruction instead of one.
+   *
+   * AVX-512 and AVX2 versions are compiled when the compiler targets
+   * these instruction sets (e.g. CFLAGS=-march=native), otherwise a
+   * portable version is used.
+   */
+  namespace BitKernels {
+
+    /// Number of words in the mask buffer used by blend_random()
+    static const size_t RANDOM_MASK_BLOCKS = 64u;
+
+    /// dest[i] = (a[i] & mask[i]) | (b[i] & ~mask[i]) for i in [0,n)
+    inline void blend(block_type *dest,
+                      const block_type *a, const block_type *b,
+                      const block_type *mask, const size_t n) {
+      size_t i = 0u;
+#if defined(__AVX512F__)
+      for (; i+8u<=n; i+=8u) {
+        __m512i va = _mm512_loadu_si512(a + i);
+        __m512i vb = _mm512_loadu_si512(b + i);
+        __m512i vm = _mm512_loadu_si512(mask + i);
+        // 0xCA is the truth table of (m & a) | (~m & b)
+        _mm512_storeu_si512(dest + i,
+                            _mm512_ternarylogic_epi64(vm, va, vb, 0xCA));
+      }
+#elif defined(__AVX2__)
+      for (; i+4u<=n; i+=4u) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        __m256i vm = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(mask + i));
+        __m256i r = _mm256_or_si256(_mm256_and_si256(vm, va),
+                                    _mm256_andnot_si256(vm, vb));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i), r);
+      }
+#endif
+      for (; i<n; ++i) {
+        dest[i] = (a[i] & mask[i]) | (b[i] & ~mask[i]);
+      }
+    }
+
+    /**
+     * Copies gens in range [begin,end) from src to dest
+     *
+     * Whole words are copied directly and only the two boundary words
+     * are blended with a mask, the rest of dest is left untouched.
+     */
+    inline void copy_range(block_type *dest, const block_type *src,
+                           const size_t begin, const size_t end) {
+      if (begin >= end) return;
+      const size_t first = begin / bits_per_block;
+      const size_t last = (end - 1u) / bits_per_block;
+      const block_type first_mask = ~block_type(0u) << (begin % bits_per_block);
+      const block_type last_mask = last_block_mask(end);
+      if (first == last) {
+        const block_type m = first_mask & last_mask;
+        dest[first] = (src[first] & m) | (dest[first] & ~m);
+        return;
+      }
+      dest[first] = (src[first] & first_mask) | (dest[first] & ~first_mask);
+      std::copy(src + first + 1u, src + last, dest + first + 1u);
+      dest[last] = (src[last] & last_mask) | (dest[last] & ~last_mask);
+    }
+
+    /**
+     * Blends n words of a and b with uniformly random masks
+     *
+     * Every mask word is produced by one call to a 64 bits random
+     * engine, so each gen comes from a or b with 0.5 probability.
+     * Masks are generated in chunks into a stack buffer, which is
+     * then processed by blend().
+     */
+    template<typename RandomEngine>
+    void blend_random(block_type *dest,
+                      const block_type *a, const block_type *b,
+                      const size_t n, RandomEngine &rng) {
+      static_assert(RandomEngine::max() - RandomEngine::min() ==
+                    ~uint64_t(0u),
+                    "blend_random requires a 64 bits random engine");
+      block_type mask[RANDOM_MASK_BLOCKS];
+      for (size_t i=0; i<n; i+=RANDOM_MASK_BLOCKS) {
+        const size_t len = std::min(RANDOM_MASK_BLOCKS, n - i);
+        for (size_t j=0; j<len; ++j) {
+          mask[j] = static_cast<block_type>(rng() - RandomEngine::min());
+        }
+        blend(dest + i, a + i, b + i, mask, len);
+      }
+    }
+
+    /// Precision, in bits, of probabilities used by bernoulli_word()
+    static const unsigned BERNOULLI_PRECISION = 16u;
+
+    /**
+     * Binary expansion of a probability, see bernoulli_word()
+     *
+     * bits keeps the depth most significant bits of the expansion,
+     * without trailing zeros. Probabilities 0 and 1 have depth 0 and
+     * bits 0 and 1 respectively.
+     */
+    struct BernoulliExpansion {
+      uint32_t bits;
+      unsigned depth;
+    };
+
+    /// Expansion of p, rounded to a multiple of 2^-BERNOULLI_PRECISION
+    inline BernoulliExpansion bernoulli_expansion(const double p) {
+      const uint32_t one = uint32_t(1u) << BERNOULLI_PRECISION;
+      const double q = std::min(std::max(p, 0.0), 1.0);
+      BernoulliExpansion e;
+      e.bits = static_cast<uint32_t>(std::llround(q * one));
+      e.depth = BERNOULLI_PRECISION;
+      if (e.bits == 0u || e.bits == one) {
+        e.bits = (e.bits == one) ? 1u : 0u;
+        e.depth = 0u;
+      }
+      while (e.depth > 0u && (e.bits & 1u) == 0u) {
+        e.bits >>= 1u;
+        --e.depth;
+      }
+      return e;
+    }
+
+    /**
+     * A random word where every bit is set with the given probability
+     *
+     * It combines depth random words, from the least significant bit
+     * of the expansion to the most significant one: a 1 bit ORs the
+     * next random word, a 0 bit ANDs it. The result follows the
+     * probability of the expansion exactly, at a cost of at most
+     * BERNOULLI_PRECISION random words per 64 bits.
+     */
+    template<typename RandomEngine>
+    block_type bernoulli_word(const BernoulliExpansion &e, RandomEngine &rng) {
+      static_assert(RandomEngine::max() - RandomEngine::min() ==
+                    ~uint64_t(0u),
+                    "bernoulli_word requires a 64 bits random engine");
+      if (e.depth == 0u) return (e.bits != 0u) ? ~block_type(0u) : block_type(0u);
+      block_type m = 0u;
+      uint32_t bits = e.bits;
+      for (unsigned j=0; j<e.depth; ++j, bits >>= 1u) {
+        const block_type r = static_cast<block_type>(rng() - RandomEngine::min());
+        m = (bits & 1u) ? (m | r) : (m & r);
+      }
+      return m;
+    }
+
+    /**
+     * Flips every gen in [0,num_gens) with the probability of e
+     *
+     * Words past num_gens are left unchanged, so the unused bits of
+     * the last word stay zero.
+     */
+    template<typename RandomEngine>
+    void flip_bernoulli(block_type *dest, const size_t num_gens,
+                        const BernoulliExpansion &e, RandomEngine &rng) {
+      const size_t n = num_blocks_for(num_gens);
+      if (n == 0u) return;
+      for (size_t i=0; i+1u<n; ++i) dest[i] ^= bernoulli_word(e, rng);
+      dest[n - 1u] ^= bernoulli_word(e, rng) & last_block_mask(num_gens);
+    }
+
+    /**
+     * Writes gens [0,num_gens) of dest, each one set with the
+     * probability of e
+     *
+     * The unused bits of the last word are written as zero.
+     */
+    template<typename RandomEngine>
+    void fill_bernoulli(block_type *dest, const size_t num_gens,
+                        const BernoulliExpansion &e, RandomEngine &rng) {
+      const size_t n = num_blocks_for(num_gens);
+      if (n == 0u) return;
+      for (size_t i=0; i+1u<n; ++i) dest[i] = bernoulli_word(e, rng);
+      dest[n - 1u] = bernoulli_word(e, rng) & last_block_mask(num_gens);
+    }
+
+    /**
+     * Builds dest alternating a and b at the given sorted cut points
+     *
+     * The range [0,cuts[0]) comes from first, [cuts[0],cuts[1]) from
+     * second, and so on until the last gen at N. It covers one-point,
+     * two-point and k-point cross-over.
+     */
+    inline void blend_segments(block_type *dest,
+                               const block_type *first,
+                               const block_type *second,
+                               const size_t *cuts, const size_t num_cuts,
+                               const size_t N) {
+      size_t begin = 0u;
+      for (size_t k=0; k<=num_cuts; ++k) {
+        const size_t end = (k < num_cuts) ? std::min(cuts[k], N) : N;
+        copy_range(dest, (k % 2u == 0u) ? first : second, begin, end);
+        begin = std::max(begin, end);
+      }
+    }
+
+    /// Mask with the n least significant bits set, for n in [0,64]
+    inline uint64_t low_mask(const size_t n) {
+      return (n >= bits_per_block) ? ~uint64_t(0u) : ((uint64_t(1u) << n) - 1u);
+    }
+
+    /**
+     * Extracts gens [pos,pos+n) as an integer, for n in [0,64]
+     *
+     * Gen pos is the least significant bit of the result. It reads one
+     * or two words, never past the word of the last extracted gen.
+     */
+    inline uint64_t extract_bits(const block_type *blocks, const size_t pos,
+                                 const size_t n) {
+      if (n == 0u) return 0u;
+      const size_t w = pos / bits_per_block;
+      const size_t shift = pos % bits_per_block;
+      uint64_t x = blocks[w] >> shift;
+      if (shift + n > bits_per_block) {
+        x |= blocks[w + 1u] << (bits_per_block - shift);
+      }
+      return x & low_mask(n);
+    }
+
+    /**
+     * Writes the n least significant bits of x at gens [pos,pos+n)
+     *
+     * It is the inverse of extract_bits(), the rest of gens are left
+     * unchanged.
+     */
+    inline void deposit_bits(block_type *blocks, const size_t pos,
+                             const size_t n, const uint64_t x) {
+      if (n == 0u) return;
+      const size_t w = pos / bits_per_block;
+      const size_t shift = pos % bits_per_block;
+      const uint64_t m = low_mask(n);
+      blocks[w] = (blocks[w] & ~(m << shift)) | ((x & m) << shift);
+      if (shift + n > bits_per_block) {
+        const size_t r = bits_per_block - shift;
+        blocks[w + 1u] = (blocks[w + 1u] & ~(m >> r)) | ((x & m) >> r);
+      }
+    }
+
+    /**
+     * Transposes in place a 64x64 bit matrix, a word per row
+     *
+     * Bit j of word i moves to bit i of word j. Off-diagonal blocks
+     * of 32x32 bits are swapped, then blocks of 16x16 inside each
+     * one, and so on, with 6 passes of 32 masked word swaps instead
+     * of 4096 bit moves.
+     */
+    inline void transpose64(block_type *a) {
+      block_type m = 0x00000000FFFFFFFFuLL;
+      for (size_t j=32u; j!=0u; j>>=1u, m^=(m << j)) {
+        for (size_t k=0u; k<64u; k=((k | j) + 1u) & ~j) {
+          const block_type t = ((a[k] >> j) ^ a[k | j]) & m;
+          a[k] ^= t << j;
+          a[k | j] ^= t;
+        }
+      }
+    }
+
+    /// Number of bits set at x
+    inline size_t popcount(const block_type x) {
+      return static_cast<size_t>(__builtin_popcountll(x));
+    }
+
+    /**
+     * Number of different gens between the n words of a and b
+     *
+     * With AVX-512 VPOPCNTDQ it counts 8 words per instruction. With
+     * AVX2, the bits of every byte are counted by two lookups of 4
+     * bits into a shuffle table, and bytes are summed with a sum of
+     * absolute differences, 4 words per iteration.
+     */
+    inline size_t hamming(const block_type *a, const block_type *b,
+                          const size_t n) {
+      size_t i = 0u;
+      size_t d = 0u;
+#if defined(__AVX512VPOPCNTDQ__)
+      __m512i acc = _mm512_setzero_si512();
+      for (; i+8u<=n; i+=8u) {
+        __m512i x = _mm512_xor_si512(_mm512_loadu_si512(a + i),
+                                     _mm512_loadu_si512(b + i));
+        acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(x));
+      }
+      uint64_t lanes[8];
+      _mm512_storeu_si512(lanes, acc);
+      for (uint64_t x : lanes) d += static_cast<size_t>(x);
+#elif defined(__AVX2__)
+      const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+                                             1, 2, 2, 3, 2, 3, 3, 4,
+                                             0, 1, 1, 2, 1, 2, 2, 3,
+                                             1, 2, 2, 3, 2, 3, 3, 4);
+      const __m256i low = _mm256_set1_epi8(0x0f);
+      __m256i acc = _mm256_setzero_si256();
+      for (; i+4u<=n; i+=4u) {
+        __m256i x = _mm256_xor_si256(
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)),
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i)));
+        __m256i counts = _mm256_add_epi8(
+          _mm256_shuffle_epi8(table, _mm256_and_si256(x, low)),
+          _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(x, 4), low)));
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(counts, _mm256_setzero_si256()));
+      }
+      d += static_cast<size_t>(_mm256_extract_epi64(acc, 0) + _mm256_extract_epi64(acc, 1) +
+                               _mm256_extract_epi64(acc, 2) + _mm256_extract_epi64(acc, 3));
+#endif
+      for (; i<n; ++i) d += popcount(a[i] ^ b[i]);
+      return d;
+    }
+
+    /**
+     * Hamming distances from x to num_rows rows of a gene matrix
+     *
+     * Row r has n words starting at rows + r*stride, and out[r]
+     * receives its distance to the n words of x.
+     */
+    inline void hamming_rows(const block_type *x, const block_type *rows,
+                             const size_t stride, const size_t num_rows,
+                             const size_t n, uint32_t *out) {
+      if (n == 1u) {
+        // one word chromosomes, the inner loop is vectorized over rows
+        for (size_t r=0; r<num_rows; ++r) {
+          out[r] = static_cast<uint32_t>(popcount(x[0] ^ rows[r*stride]));
+        }
+        return;
+      }
+      for (size_t r=0; r<num_rows; ++r) {
+        out[r] = static_cast<uint32_t>(hamming(x, rows + r*stride, n));
+      }
+    }
+
+    /// Appends to positions the index of every gen different in a and b
+    inline void changed_positions(const block_type *a, const block_type *b,
+                                  const size_t n,
+                                  std::vector<size_t> &positions) {
+      for (size_t i=0; i<n; ++i) {
+        for (block_type x = a[i] ^ b[i]; x != 0u; x &= x - 1u) {
+          positions.push_back(i*bits_per_block +
+                              static_cast<size_t>(__builtin_ctzll(x)));
+        }
+      }
+    }
+
+    /// true when the n words of a and b are equal
+    inline bool equal(const block_type *a, const block_type *b, const size_t n) {
+      return std::equal(a, a + n, b);
+    }
+
+    /// 64 bits mixing function (MurmurHash3 finalizer)
+    inline uint64_t mix(uint64_t x) {
+      x ^= x >> 33u;
+      x *= 0xff51afd7ed558ccdULL;
+      x ^= x >> 33u;
+      x *= 0xc4ceb9fe1a85ec53ULL;
+      x ^= x >> 33u;
+      return x;
+    }
+
+    /// Fast 64 bits hash of n words, one multiply-rotate step per word
+    inline uint64_t hash(const block_type *blocks, const size_t n) {
+      uint64_t h = 0x9e3779b97f4a7c15ULL ^ n;
+      for (size_t i=0; i<n; ++i) {
+        h ^= blocks[i] * 0x87c37b91114253d5ULL;
+        h = (h << 31u) | (h >> 33u);
+        h *= 0x4cf5ad432745937fULL;
+      }
+      return mix(h);
+    }
+
+  } // namespace BitKernels
+
+} // namespace GeneticAlgorithms
+
+#endif // BIT_KERNELS_H
@@ -0,0 +1,340 @@
+/*
+ * This file is part of GeneticAlgorithms toolkit
+ *
+ * Copyright 2017, Francisco Zamora-Martinez
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef BIT_SLICE_H
+#define BIT_SLICE_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "arena.h"
+#include "batch_rank.h"
+#include "bit_kernels.h"
+#include "chromosome.h"
+
+namespace GeneticAlgorithms {
+
+  /**
+   * W consecutive words used as one word of W*64 bits
+   *
+   * Its bitwise operators are plain loops over the W words, which
+   * compilers turn into one SSE, AVX2 or AVX-512 instruction for W
+   * equal to 2, 4 or 8 when the target supports them.
+   */
+  template<size_t W>
+  struct WideBlock {
+    block_type w[W];
+
+    WideBlock &operator&=(const WideBlock &other) {
+      for (size_t k=0; k<W; ++k) w[k] &= other.w[k];
+      return *this;
+    }
+
+    WideBlock &operator|=(const WideBlock &other) {
+      for (size_t k=0; k<W; ++k) w[k] |= other.w[k];
+      return *this;
+    }
+
+    WideBlock &operator^=(const WideBlock &other) {
+      for (size_t k=0; k<W; ++k) w[k] ^= other.w[k];
+      return *this;
+    }
+
+    friend WideBlock operator&(WideBlock a, const WideBlock &b) { return a &= b; }
+    friend WideBlock operator|(WideBlock a, const WideBlock &b) { return a |= b; }
+    friend WideBlock operator^(WideBlock a, const WideBlock &b) { return a ^= b; }
+
+    friend WideBlock operator~(WideBlock a) {
+      for (size_t k=0; k<W; ++k) a.w[k] = ~a.w[k];
+      return a;
+    }
+  }; // struct WideBlock
+
+  /// Word of a slice of W lanes of 64 chromosomes
+  template<size_t W> struct slice_word { typedef WideBlock<W> type; };
+  /// A slice of 64 chromosomes uses plain words
+  template<> struct slice_word<1u> { typedef block_type type; };
+
+  /// Word k of a slice word, x itself for plain words
+  inline block_type &lane_block(block_type &x, size_t) { return x; }
+  inline const block_type &lane_block(const block_type &x, size_t) { return x; }
+  template<size_t W>
+  block_type &lane_block(WideBlock<W> &x, const size_t k) { return x.w[k]; }
+  template<size_t W>
+  const block_type &lane_block(const WideBlock<W> &x, const size_t k) { return x.w[k]; }
+
+  /// True when any bit of x is set
+  inline bool any_bit(const block_type x) { return x != 0u; }
+  template<size_t W>
+  bool any_bit(const WideBlock<W> &x) {
+    block_type r = 0u;
+    for (size_t k=0; k<W; ++k) r |= x.w[k];
+    return r != 0u;
+  }
+
+  /**
+   * Bit-sliced (transposed) view of up to W*64 chromosomes
+   *
+   * Word j of a slice contains gen j of all its chromosomes, one per
+   * bit: bit i of lane_block(word(j), k) is gen j of chromosome
+   * 64*k+i, and bits past rows() are zero. Boolean rank functions
+   * evaluate this way W*64 chromosomes with every bitwise operation,
+   * instead of one. BitSlice is the slice of 64 chromosomes, whose
+   * words are plain block_type; wider slices, e.g. BasicBitSlice<4>
+   * with 256 chromosomes, use WideBlock words.
+   *
+   * Slices are loaded from a GeneMatrix and stored back with
+   * BitKernels::transpose64(), 64 gens of 64 chromosomes at a time.
+   *
+   * ATTENTION: no thread safe object, use one slice by thread.
+   */
+  template<size_t W>
+  class BasicBitSlice {
+  public:
+    typedef typename slice_word<W>::type word_type;
+    /// Number of words by word_type
+    static const size_t WORDS = W;
+    /// Maximum number of chromosomes in a slice
+    static const size_t LANES = W*bits_per_block;
+
+    BasicBitSlice() : _rows(0u), _num_gens(0u) {}
+
+    /// Loads rows [first, first+LANES) of genes, or less at the end
+    void load(const GeneMatrix &genes, const size_t first) {
+      assert(first < genes.rows);
+      _rows = std::min(LANES, genes.rows - first);
+      _num_gens = genes.num_gens;
+      const size_t num_blocks = num_blocks_for(_num_gens);
+      _words.resize(num_blocks * bits_per_block);
+      block_type square[bits_per_block];
+      for (size_t w=0; w<num_blocks; ++w) {
+        word_type *dest = _words.data() + w*bits_per_block;
+        for (size_t k=0; k<W; ++k) {
+          const size_t n = laneRows(k);
+          for (size_t i=0; i<n; ++i) {
+            square[i] = genes.row(first + k*bits_per_block + i)[w];
+          }
+          std::fill(square + n, square + bits_per_block, block_type(0u));
+          BitKernels::transpose64(square);
+          for (size_t j=0; j<bits_per_block; ++j) lane_block(dest[j], k) = square[j];
+        }
+      }
+    }
+
+    /// Writes the slice back as rows() rows of stride words at rows
+    void store(block_type *rows, const size_t stride) const {
+      const size_t num_blocks = num_blocks_for(_num_gens);
+      block_type square[bits_per_block];
+      for (size_t w=0; w<num_blocks; ++w) {
+        const word_type *source = _words.data() + w*bits_per_block;
+        for (size_t k=0; k<W; ++k) {
+          for (size_t j=0; j<bits_per_block; ++j) square[j] = lane_block(source[j], k);
+          BitKernels::transpose64(square);
+          block_type *lane_rows = rows + k*bits_per_block*stride;
+          for (size_t i=0; i<laneRows(k); ++i) lane_rows[i*stride + w] = square[i];
+        }
+      }
+    }
+
+    /// Number of chromosomes in the slice
+    size_t rows() const {
+      return _rows;
+    }
+
+    size_t numGens() const {
+      return _num_gens;
+    }
+
+    /// Gen j of every chromosome, a bit per chromosome
+    const word_type &word(const size_t j) const {
+      return _words[j];
+    }
+
+    /// The words of gens [0,numGens()), consecutive
+    const word_type *words() const {
+      return _words.data();
+    }
+
+    /// A word with a bit set for every chromosome in the slice
+    word_type mask() const {
+      word_type m = word_type();
+      for (size_t k=0; k<W; ++k) lane_block(m, k) = BitKernels::low_mask(laneRows(k));
+      return m;
+    }
+
+  private:
+    size_t _rows;
+    size_t _num_gens;
+    /// Transposed squares of 64x64 bits, padded to a multiple of 64 gens
+    std::vector<word_type, AlignedAllocator<word_type> > _words;
+
+    /// Number of chromosomes in lane k
+    size_t laneRows(const size_t k) const {
+      const size_t first = k*bits_per_block;
+      return (first < _rows) ? std::min(bits_per_block, _rows - first) : 0u;
+    }
+  }; // class BasicBitSlice
+
+  template<size_t W> const size_t BasicBitSlice<W>::WORDS;
+  template<size_t W> const size_t BasicBitSlice<W>::LANES;
+
+  /// Slice of 64 chromosomes
+  typedef BasicBitSlice<1u> BitSlice;
+
+  /**
+   * W*64 counters, one per chromosome of a BasicBitSlice<W>, stored
+   * bit-sliced
+   *
+   * Plane k keeps bit k of all the counters, so add() increments the
+   * counters of all the bits set at a word with a ripple carry of a
+   * few bitwise operations, e.g. to count active gens, satisfied
+   * clauses or matches with a target.
+   *
+   * @code
+   * SlicedCounter ones;
+   * for (size_t j=0; j<slice.numGens(); ++j) ones.add(slice.word(j));
+   * ones.counts(ranks, slice.rows());
+   * @endcode
+   */
+  template<size_t W>
+  class BasicSlicedCounter {
+  public:
+    typedef typename slice_word<W>::type word_type;
+
+    BasicSlicedCounter() : _num_planes(0u) {
+      std::fill(_planes, _planes + bits_per_block, word_type());
+    }
+
+    /// Increments by one the counters of the bits set at x
+    void add(word_type x) {
+      for (size_t k=0; any_bit(x); ++k) {
+        const word_type carry = _planes[k] & x;
+        _planes[k] ^= x;
+        x = carry;
+        if (k == _num_planes) ++_num_planes;
+      }
+    }
+
+    /// Writes the first n counters at out
+    template<typename T>
+    void counts(T *out, const size_t n) const {
+      block_type square[bits_per_block];
+      for (size_t k=0; k*bits_per_block<n; ++k) {
+        for (size_t p=0; p<bits_per_block; ++p) square[p] = lane_block(_planes[p], k);
+        BitKernels::transpose64(square);
+        const size_t first = k*bits_per_block;
+        const size_t m = std::min(bits_per_block, n - first);
+        for (size_t i=0; i<m; ++i) out[first + i] = static_cast<T>(square[i]);
+      }
+    }
+
+    void clear() {
+      std::fill(_planes, _planes + _num_planes, word_type());
+      _num_planes = 0u;
+    }
+
+  private:
+    word_type _planes[bits_per_block];
+    size_t _num_planes;
+  }; // class BasicSlicedCounter
+
+  /// Counters of a BitSlice
+  typedef BasicSlicedCounter<1u> SlicedCounter;
+
+  /**
+   * Adapts a sliced RankFunctor to the batch protocol (batch_rank.h)
+   *
+   * The given RankFunctor implements, besides its usual operator(),
+   * a method which ranks all the chromosomes of a BasicBitSlice<W>:
+   *
+   * @code
+   * void operator()(const BasicBitSlice<W> &slice, T *ranks) const;
+   * @endcode
+   *
+   * This wrapper transposes every batch of Population in slices of
+   * W*64 chromosomes and calls it for each one. Instead of
+   * instantiated directly this class, use the helper function
+   * make_sliced_rank, whose optional template argument is W.
+   *
+   * @code
+   * struct OneMax {
+   *   float operator()(const Chromosome &x) const;
+   *   template<size_t W>
+   *   void operator()(const BasicBitSlice<W> &slice, float *ranks) const {
+   *     BasicSlicedCounter<W> ones;
+   *     for (size_t j=0; j<slice.numGens(); ++j) ones.add(slice.word(j));
+   *     ones.counts(ranks, slice.rows());
+   *   }
+   * };
+   * // 256 chromosomes by slice
+   * Chromosome best = solve(..., make_sliced_rank<4>(OneMax()));
+   * @endcode
+   */
+  template<typename RankFunctor, size_t W=1u>
+  class SlicedRank {
+  public:
+    typedef BasicBitSlice<W> slice_type;
+
+    SlicedRank(const RankFunctor &rank_func) : _rank_func(rank_func) {}
+
+    /// Ranks one chromosome with the usual operator() of RankFunctor
+    template<typename ChromosomeType>
+    auto operator()(const ChromosomeType &x) const
+      -> decltype(std::declval<const RankFunctor&>()(x)) {
+      return _rank_func(x);
+    }
+
+    /// Ranks every row of genes, a slice of W*64 chromosomes at a time
+    template<typename T>
+    auto operator()(const GeneMatrix &genes, T *ranks) const
+      -> decltype(std::declval<const RankFunctor&>()(std::declval<const slice_type&>(),
+                                                     ranks), void()) {
+      for (size_t first=0; first<genes.rows; first+=slice_type::LANES) {
+        _slice.load(genes, first);
+        _rank_func(_slice, ranks + first);
+      }
+    }
+
+  private:
+    RankFunctor _rank_func;
+    /// Scratch memory, every copy of the functor has its own one
+    mutable slice_type _slice;
+  }; // class SlicedRank
+
+  /// Helper for construction of SlicedRank instances
+  template<size_t W=1u, typename RankFunctor>
+  SlicedRank<RankFunctor, W> make_sliced_rank(const RankFunctor &rank_func) {
+    return SlicedRank<RankFunctor, W>(rank_func);
+  }
+
+} // namespace GeneticAlgorithms
+
+#endif // BIT_SLICE_H
@@ -0,0 +1,253 @@
+/*
+ * This file is part of GeneticAlgorithms toolkit
+ *
+ * Copyright 2017, Francisco Zamora-Martinez
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef BREEDING_H
+#define BREEDING_H
+
+#include <chrono>
+#include <cstddef>
+#include <utility>
+
+#include "chromosome.h"
+
+namespace GeneticAlgorithms {
+
+  /**
+   * Helpers to produce children directly into a destination chromosome
+   *
+   * Genetic operators can implement, besides the functional protocol
+   * returning a new chromosome, an in-place protocol which receives
+   * the destination as last argument:
+   *
+   * - CrossOverFunctor: void operator()(const C &a, const C &b, C &dest)
+   *
+   * - MutationFunctor: void operator()(const C &source, C &dest), where
+   *   source and dest can be the same object.
+   *
+   * The functions below use the in-place protocol when available, and
+   * fall back to assign the result of the functional protocol
+   * otherwise. This way the child is written directly into its final
+   * storage, e.g. a row of a ChromosomeArena, when operators allow it.
+   *
+   * Besides, operators can implement a word protocol, which produces
+   * the masks of the operator one word at a time:
+   *
+   * - CrossOverFunctor: void beginMask(size_t num_gens) const, which
+   *   draws the decisions taken once per child (e.g. cut points), and
+   *   block_type maskWord(size_t w) const, called for every word w in
+   *   order, which returns the gens of word w taken from the first
+   *   parent (bits set) or from the second one (bits unset).
+   *
+   * - MutationFunctor: void beginFlips(size_t num_gens) const and
+   *   block_type flipWord(size_t w) const, called the same way, which
+   *   returns the gens of word w to be flipped.
+   *
+   * When both operators implement it, breed_into() composes them at
+   * compilation time: the child is produced in one pass over the
+   * words of the parents, and every word is written once, already
+   * mutated, into dest. Random numbers are drawn in the same order
+   * than by the in-place protocol, so the child is the same.
+   *
+   * timed_breed_into() produces the same child, measuring the time
+   * of each operator, see BreedTimes.
+   */
+
+  /// dest = cross_over_func(a, b), in-place when possible
+  template<typename CrossOverFunctor, typename ChromosomeType>
+  auto cross_over_into(const CrossOverFunctor &cross_over_func,
+                       const ChromosomeType &a, const ChromosomeType &b,
+                       ChromosomeType &dest, int)
+    -> decltype(cross_over_func(a, b, dest), void()) {
+    cross_over_func(a, b, dest);
+  }
+
+  template<typename CrossOverFunctor, typename ChromosomeType>
+  void cross_over_into(const CrossOverFunctor &cross_over_func,
+                       const ChromosomeType &a, const ChromosomeType &b,
+                       ChromosomeType &dest, long) {
+    dest = cross_over_func(a, b);
+  }
+
+  template<typename CrossOverFunctor, typename ChromosomeType>
+  void cross_over_into(const CrossOverFunctor &cross_over_func,
+                       const ChromosomeType &a, const ChromosomeType &b,
+                       ChromosomeType &dest) {
+    cross_over_into(cross_over_func, a, b, dest, 0);
+  }
+
+  /// dest = mutate_func(source), in-place when possible
+  template<typename MutationFunctor, typename ChromosomeType>
+  auto mutate_into(const MutationFunctor &mutate_func,
+                   const ChromosomeType &source, ChromosomeType &dest, int)
+    -> decltype(mutate_func(source, dest), void()) {
+    mutate_func(source, dest);
+  }
+
+  template<typename MutationFunctor, typename ChromosomeType>
+  void mutate_into(const MutationFunctor &mutate_func,
+                   const ChromosomeType &source, ChromosomeType &dest, long) {
+    dest = mutate_func(source);
+  }
+
+  template<typename MutationFunctor, typename ChromosomeType>
+  void mutate_into(const MutationFunctor &mutate_func,
+                   const ChromosomeType &source, ChromosomeType &dest) {
+    mutate_into(mutate_func, source, dest, 0);
+  }
+
+  /// dest = mutate_func(cross_over_func(a, b)), fused in one pass
+  template<typename CrossOverFunctor, typename MutationFunctor,
+           typename ChromosomeType>
+  auto breed_into(const CrossOverFunctor &cross_over_func,
+                  const MutationFunctor &mutate_func,
+                  const ChromosomeType &a, const ChromosomeType &b,
+                  ChromosomeType &dest, int)
+    -> decltype(cross_over_func.beginMask(size_t()),
+                cross_over_func.maskWord(size_t()),
+                mutate_func.beginFlips(size_t()),
+                mutate_func.flipWord(size_t()), void()) {
+    const size_t num_gens = a.size();
+    const size_t n = a.num_blocks();
+    const block_type *pa = a.blocks();
+    const block_type *pb = b.blocks();
+    block_type *pdest = dest.blocks();
+    cross_over_func.beginMask(num_gens);
+    mutate_func.beginFlips(num_gens);
+    for (size_t w=0; w<n; ++w) {
+      const block_type m = cross_over_func.maskWord(w);
+      pdest[w] = ((pa[w] & m) | (pb[w] & ~m)) ^ mutate_func.flipWord(w);
+    }
+    // flips past the last gen are discarded
+    if (n > 0u) pdest[n - 1u] &= last_block_mask(num_gens);
+  }
+
+  /// dest = mutate_func(cross_over_func(a, b)), in-place when possible
+  template<typename CrossOverFunctor, typename MutationFunctor,
+           typename ChromosomeType>
+  void breed_into(const CrossOverFunctor &cross_over_func,
+                  const MutationFunctor &mutate_func,
+                  const ChromosomeType &a, const ChromosomeType &b,
+                  ChromosomeType &dest, long) {
+    cross_over_into(cross_over_func, a, b, dest);
+    mutate_into(mutate_func, dest, dest);
+  }
+
+  /// dest = mutate_func(cross_over_func(a, b)), see the word protocol above
+  template<typename CrossOverFunctor, typename MutationFunctor,
+           typename ChromosomeType>
+  void breed_into(const CrossOverFunctor &cross_over_func,
+                  const MutationFunctor &mutate_func,
+                  const ChromosomeType &a, const ChromosomeType &b,
+                  ChromosomeType &dest) {
+    breed_into(cross_over_func, mutate_func, a, b, dest, 0);
+  }
+
+  /**
+   * Time spent by the cross-over and mutation functors of a breed
+   *
+   * timed_breed_into() reads the clock three times per child. With the
+   * word protocol it produces the child in two passes, one writing the
+   * cross-over and another one applying the flips, so the time of
+   * every operator includes its own word work.
+   */
+  struct BreedTimes {
+    std::chrono::steady_clock::duration cross_over;
+    std::chrono::steady_clock::duration mutate;
+
+    BreedTimes() : cross_over(0), mutate(0) {}
+
+    BreedTimes &operator+=(const BreedTimes &other) {
+      cross_over += other.cross_over;
+      mutate += other.mutate;
+      return *this;
+    }
+  }; // struct BreedTimes
+
+  /// breed_into() of the word protocol, adding the times of every operator
+  template<typename CrossOverFunctor, typename MutationFunctor,
+           typename ChromosomeType>
+  auto timed_breed_into(const CrossOverFunctor &cross_over_func,
+                        const MutationFunctor &mutate_func,
+                        const ChromosomeType &a, const ChromosomeType &b,
+                        ChromosomeType &dest, BreedTimes &times, int)
+    -> decltype(cross_over_func.beginMask(size_t()),
+                cross_over_func.maskWord(size_t()),
+                mutate_func.beginFlips(size_t()),
+                mutate_func.flipWord(size_t()), void()) {
+    typedef std::chrono::steady_clock clock;
+    const size_t num_gens = a.size();
+    const size_t n = a.num_blocks();
+    const block_type *pa = a.blocks();
+    const block_type *pb = b.blocks();
+    block_type *pdest = dest.blocks();
+    const clock::time_point start = clock::now();
+    cross_over_func.beginMask(num_gens);
+    for (size_t w=0; w<n; ++w) {
+      const block_type m = cross_over_func.maskWord(w);
+      pdest[w] = (pa[w] & m) | (pb[w] & ~m);
+    }
+    const clock::time_point middle = clock::now();
+    // both operators draw from their own random streams, so the order
+    // of the words of each one is kept and the child is the same
+    mutate_func.beginFlips(num_gens);
+    for (size_t w=0; w<n; ++w) pdest[w] ^= mutate_func.flipWord(w);
+    if (n > 0u) pdest[n - 1u] &= last_block_mask(num_gens);
+    const clock::time_point end = clock::now();
+    times.cross_over += middle - start;
+    times.mutate += end - middle;
+  }
+
+  /// breed_into() of the other protocols, adding the times of every operator
+  template<typename CrossOverFunctor, typename MutationFunctor,
+           typename ChromosomeType>
+  void timed_breed_into(const CrossOverFunctor &cross_over_func,
+                        const MutationFunctor &mutate_func,
+                        const ChromosomeType &a, const ChromosomeType &b,
+                        ChromosomeType &dest, BreedTimes &times, long) {
+    typedef std::chrono::steady_clock clock;
+    const clock::time_point start = clock::now();
+    cross_over_into(cross_over_func, a, b, dest);
+    const clock::time_point middle = clock::now();
+    mutate_into(mutate_func, dest, dest);
+    const clock::time_point end = clock::now();
+    times.cross_over += middle - start;
+    times.mutate += end - middle;
+  }
+
+  /// breed_into() adding the time of every operator to times
+  template<typename CrossOverFunctor, typename MutationFunctor,
+           typename ChromosomeType>
+  void timed_breed_into(const CrossOverFunctor &cross_over_func,
+                        const MutationFunctor &mutate_func,
+                        const ChromosomeType &a, const ChromosomeType &b,
+                        ChromosomeType &dest, BreedTimes &times) {
+    timed_breed_into(cross_over_func, mutate_func, a, b, dest, times, 0);
+  }
+
+} // namespace GeneticAlgorithms
+
+#endif // BREEDING_H
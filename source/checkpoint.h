@@ -0,0 +1,329 @@
+/*
+ * This file is part of GeneticAlgorithms toolkit
+ *
+ * Copyright 2017, Francisco Zamora-Martinez
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "chromosome.h"
+
+namespace GeneticAlgorithms {
+
+  /// Alignment in bytes of every section of a checkpoint file
+  static const size_t CHECKPOINT_ALIGNMENT = 64u;
+
+  /**
+   * Header at the beginning of a checkpoint file
+   *
+   * All numbers use the native representation of the machine, so
+   * checkpoints are meant to be read by the same build which wrote
+   * them. Offsets are in bytes from the beginning of the file, and
+   * every section starts at a multiple of CHECKPOINT_ALIGNMENT:
+   *
+   * - rows: num_chromosomes rows of num_blocks_for(num_gens) words.
+   * - ranks: num_chromosomes ranks of rank_size bytes.
+   * - best: the best chromosome ever seen, one row of words, followed
+   *   by its rank.
+   * - state: state_size opaque bytes given by the caller.
+   */
+  struct CheckpointHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t rank_size;
+    uint64_t num_chromosomes;
+    uint64_t num_gens;
+    /// Number of generations completed when the checkpoint was written
+    uint64_t generation;
+    uint64_t rows_offset;
+    uint64_t ranks_offset;
+    uint64_t best_offset;
+    uint64_t state_offset;
+    uint64_t state_size;
+    uint64_t file_size;
+  }; // struct CheckpointHeader
+
+  static const char CHECKPOINT_MAGIC[8] = { 'G', 'A', 'C', 'K', 'P', 'T', '\n', '\0' };
+  static const uint32_t CHECKPOINT_VERSION = 1u;
+
+  /// Periodic checkpoints of solve()
+  struct CheckpointConfig {
+    /// Checkpoint file, see save_checkpoint()
+    std::string path;
+    /// Generations between checkpoints, 0 writes only the last one
+    size_t interval;
+    /// When path exists, solve() resumes from it instead of initializing
+    bool resume;
+
+    explicit CheckpointConfig(const std::string &path="",
+                              const size_t interval=100u,
+                              const bool resume=true) :
+      path(path),
+      interval(interval),
+      resume(resume) {
+    }
+  }; // struct CheckpointConfig
+
+  /// true when there is a file at path
+  inline bool checkpoint_exists(const std::string &path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+  }
+
+  /**
+   * Writes a population checkpoint atomically
+   *
+   * The file is written as path + ".tmp", flushed to disk with
+   * fsync() and renamed to path, so path contains either the previous
+   * checkpoint or the new one, never a partial file. state is stored
+   * as given, e.g. for the random engines of user functors, but
+   * solve() doesn't write it.
+   *
+   * Operators of this toolkit select their random streams from the
+   * generation number (see counter_rng.h), so the generation is all
+   * their random state, and a run resumed from a checkpoint continues
+   * exactly as the interrupted one. solve() only accepts checkpoints
+   * with operators implementing stream().
+   *
+   * It throws std::runtime_error when the file can't be written.
+   */
+  template<typename PopulationType>
+  void save_checkpoint(const std::string &path,
+                       const PopulationType &population,
+                       const typename PopulationType::Hypothesis &best,
+                       const uint64_t generation,
+                       const std::vector<char> &state=std::vector<char>()) {
+    typedef typename PopulationType::Hypothesis::second_type T;
+    const size_t n = population.size();
+    const size_t num_gens = best.first.size();
+    const size_t words = num_blocks_for(num_gens);
+    auto align = [](uint64_t x) {
+      return (x + CHECKPOINT_ALIGNMENT - 1u) / CHECKPOINT_ALIGNMENT * CHECKPOINT_ALIGNMENT;
+    };
+    CheckpointHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.version = CHECKPOINT_VERSION;
+    header.rank_size = sizeof(T);
+    header.num_chromosomes = n;
+    header.num_gens = num_gens;
+    header.generation = generation;
+    header.rows_offset = align(sizeof(header));
+    header.ranks_offset = align(header.rows_offset + n*words*sizeof(block_type));
+    header.best_offset = align(header.ranks_offset + n*sizeof(T));
+    header.state_offset = align(header.best_offset + words*sizeof(block_type) + sizeof(T));
+    header.state_size = state.size();
+    header.file_size = header.state_offset + state.size();
+
+    const std::string tmp_path = path + ".tmp";
+    FILE *f = std::fopen(tmp_path.c_str(), "wb");
+    if (f == nullptr) {
+      throw std::runtime_error("Unable to open " + tmp_path + ": " +
+                               std::strerror(errno));
+    }
+    const char zeros[CHECKPOINT_ALIGNMENT] = {};
+    uint64_t pos = 0u;
+    bool ok = true;
+    auto write = [&](const void *data, const size_t size) {
+      if (size > 0u) ok = ok && std::fwrite(data, 1u, size, f) == size;
+      pos += size;
+    };
+    auto pad = [&](const uint64_t offset) {
+      write(zeros, offset - pos);
+    };
+    write(&header, sizeof(header));
+    pad(header.rows_offset);
+    for (size_t i=0; i<n; ++i) {
+      write(population.chromosome(i).blocks(), words*sizeof(block_type));
+    }
+    pad(header.ranks_offset);
+    write(population.ranks().data(), n*sizeof(T));
+    pad(header.best_offset);
+    write(best.first.blocks(), words*sizeof(block_type));
+    write(&best.second, sizeof(T));
+    pad(header.state_offset);
+    write(state.data(), state.size());
+    ok = ok && std::fflush(f) == 0 && fsync(fileno(f)) == 0;
+    ok = (std::fclose(f) == 0) && ok;
+    if (!ok || std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+      const int error = errno;
+      std::remove(tmp_path.c_str());
+      throw std::runtime_error("Unable to write " + path + ": " +
+                               std::strerror(error));
+    }
+    // the rename itself is made durable by syncing the directory
+    const size_t slash = path.find_last_of('/');
+    const std::string dir = (slash == std::string::npos) ? "." :
+      path.substr(0u, std::max<size_t>(slash, 1u));
+    int dir_fd = open(dir.c_str(), O_RDONLY);
+    if (dir_fd >= 0) {
+      fsync(dir_fd);
+      close(dir_fd);
+    }
+  }
+
+  /**
+   * A checkpoint file mapped in memory
+   *
+   * The file is mapped read-only with mmap(), so opening it doesn't
+   * read nor parse the data, pages are loaded by the system as they
+   * are used, e.g. by Population::load(). The header is validated at
+   * construction, throwing std::runtime_error when the file is not a
+   * valid checkpoint.
+   *
+   * @code
+   * MappedCheckpoint checkpoint("run.ckpt");
+   * population.load(checkpoint.rows(), checkpoint.ranks<float>(),
+   *                 checkpoint.size(), checkpoint.numGens());
+   * @endcode
+   */
+  class MappedCheckpoint {
+  public:
+    explicit MappedCheckpoint(const std::string &path) :
+      _data(nullptr), _size(0u) {
+      int fd = open(path.c_str(), O_RDONLY);
+      if (fd < 0) {
+        throw std::runtime_error("Unable to open " + path + ": " +
+                                 std::strerror(errno));
+      }
+      struct stat st;
+      if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(CheckpointHeader)) {
+        close(fd);
+        throw std::runtime_error("Invalid checkpoint " + path);
+      }
+      _size = static_cast<size_t>(st.st_size);
+      void *data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+      close(fd);
+      if (data == MAP_FAILED) {
+        throw std::runtime_error("Unable to map " + path + ": " +
+                                 std::strerror(errno));
+      }
+      _data = static_cast<const char*>(data);
+      madvise(data, _size, MADV_SEQUENTIAL);
+      if (!valid()) {
+        munmap(data, _size);
+        throw std::runtime_error("Invalid checkpoint " + path);
+      }
+    }
+
+    ~MappedCheckpoint() {
+      munmap(const_cast<char*>(_data), _size);
+    }
+
+    MappedCheckpoint(const MappedCheckpoint &) = delete;
+    MappedCheckpoint &operator=(const MappedCheckpoint &) = delete;
+
+    const CheckpointHeader &header() const {
+      return *reinterpret_cast<const CheckpointHeader*>(_data);
+    }
+
+    /// Number of chromosomes of the population
+    size_t size() const {
+      return header().num_chromosomes;
+    }
+
+    size_t numGens() const {
+      return header().num_gens;
+    }
+
+    uint64_t generation() const {
+      return header().generation;
+    }
+
+    /// Gene matrix, with size() rows of num_blocks_for(numGens()) words
+    const block_type *rows() const {
+      return reinterpret_cast<const block_type*>(_data + header().rows_offset);
+    }
+
+    /// Ranks of the population, T should be the type used to write them
+    template<typename T>
+    const T *ranks() const {
+      checkRankType<T>();
+      return reinterpret_cast<const T*>(_data + header().ranks_offset);
+    }
+
+    /// Gens words of the best chromosome
+    const block_type *bestRow() const {
+      return reinterpret_cast<const block_type*>(_data + header().best_offset);
+    }
+
+    template<typename T>
+    T bestRank() const {
+      checkRankType<T>();
+      T rank;
+      std::memcpy(&rank, _data + header().best_offset +
+                  num_blocks_for(numGens())*sizeof(block_type), sizeof(T));
+      return rank;
+    }
+
+    /// Opaque state given to save_checkpoint()
+    std::vector<char> state() const {
+      const char *begin = _data + header().state_offset;
+      return std::vector<char>(begin, begin + header().state_size);
+    }
+
+  private:
+    const char *_data;
+    size_t _size;
+
+    template<typename T>
+    void checkRankType() const {
+      if (header().rank_size != sizeof(T)) {
+        throw std::runtime_error("Checkpoint with a different rank type");
+      }
+    }
+
+    bool valid() const {
+      const CheckpointHeader &h = header();
+      const uint64_t words = num_blocks_for(h.num_gens);
+      return std::memcmp(h.magic, CHECKPOINT_MAGIC, sizeof(h.magic)) == 0 &&
+        h.version == CHECKPOINT_VERSION &&
+        h.file_size == _size &&
+        h.rows_offset >= sizeof(CheckpointHeader) &&
+        h.ranks_offset >= h.rows_offset + h.num_chromosomes*words*sizeof(block_type) &&
+        h.best_offset >= h.ranks_offset + h.num_chromosomes*h.rank_size &&
+        h.state_offset >= h.best_offset + words*sizeof(block_type) + h.rank_size &&
+        h.state_offset + h.state_size <= _size &&
+        h.rows_offset % CHECKPOINT_ALIGNMENT == 0u &&
+        h.ranks_offset % CHECKPOINT_ALIGNMENT == 0u;
+    }
+  }; // class MappedCheckpoint
+
+} // namespace GeneticAlgorithms
+
+#endif // CHECKPOINT_H
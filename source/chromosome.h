@@ -28,53 +28,285 @@
 #ifndef CHROMOSOME_H
 #define CHROMOSOME_H
 
+#include <algorithm>
+#include <bitset>
 #include <boost/dynamic_bitset.hpp>
+#include <cassert>
 #include <cstdint>
 #include <cmath>
 #include <numeric>
+#include <utility>
+#include <vector>
 
 namespace GeneticAlgorithms {
 
   typedef boost::dynamic_bitset< > bitset;
-  
+
+  /// A couple of parents given as their indices in a population
+  typedef std::pair<size_t, size_t> IndexCouple;
+
+  /// Chromosome gens are stored in words of this type
+  typedef uint64_t block_type;
+
+  /// Number of gens stored in every block_type word
+  static const size_t bits_per_block = 64u;
+
+  /// Number of words needed to store n gens
+  inline size_t num_blocks_for(const size_t n) {
+    return (n + bits_per_block - 1u) / bits_per_block;
+  }
+
+  /// Mask of valid bits at the last word of n gens
+  inline block_type last_block_mask(const size_t n) {
+    const size_t r = n % bits_per_block;
+    return (r == 0u) ? ~block_type(0u) : ((block_type(1u) << r) - 1u);
+  }
+
   /**
    * A class which represents a complete chromosome for genetic algorithms
    *
    * A Chromosome is represented by its gens combination (a bits
-   * set). Indeed, it is a wrapper over a boost::dynamic_bitset in
-   * order to make it inmutable.
+   * set) with a number of bits known at run time. Gens are stored in
+   * block_type words, being gen i the bit i%64 of word i/64. Bits past
+   * size() at the last word are always zero.
+   *
+   * Genetic operators access gens through blocks() in order to work
+   * with whole words. The bits set can be retrieved as a
+   * boost::dynamic_bitset by calling gens().
    *
    * A set of utilities is available at `translators.h` which allow
    * the programmer to decode Chromosomes into a different C++
    * types.
+   *
+   * @see FixedChromosome for chromosomes with a number of bits known
+   * at compilation time.
    */
   class Chromosome {
   public:
     typedef std::pair<Chromosome, Chromosome > Couple;
 
+    /// Tag type for the constructor over external memory
+    struct map_t {};
+
     Chromosome(const bitset &gens) :
-      _gens(gens) {
+      _N(gens.size()),
+      _blocks(num_blocks_for(_N), 0u),
+      _data(_blocks.data()) {
+      for (size_t i=gens.find_first(); i!=bitset::npos; i=gens.find_next(i)) {
+        set(i, true);
+      }
     }
 
-    Chromosome() {
+    /// Builds a Chromosome with N gens, all of them zero
+    explicit Chromosome(const size_t N) :
+      _N(N),
+      _blocks(num_blocks_for(N), 0u),
+      _data(_blocks.data()) {
+    }
+
+    /// Builds a Chromosome with N gens copied from the given words
+    Chromosome(const block_type *blocks, const size_t N) :
+      _N(N),
+      _blocks(blocks, blocks + num_blocks_for(N)),
+      _data(_blocks.data()) {
+      if (_N > 0u) _blocks.back() &= last_block_mask(_N);
+    }
+
+    /**
+     * Builds a Chromosome over external memory, without owning it
+     *
+     * The given words are used as storage of the N gens. Copies of a
+     * mapped Chromosome own their gens, but assignments to it write
+     * the new gens into the mapped memory, which should be large
+     * enough. It is used by ChromosomeArena to keep a whole
+     * population in one block of memory.
+     */
+    Chromosome(map_t, block_type *blocks, const size_t N) :
+      _N(N),
+      _data(blocks) {
+    }
+
+    Chromosome() :
+      _N(0u),
+      _data(nullptr) {
+    }
+
+    Chromosome(const Chromosome &other) :
+      _N(other._N),
+      _blocks(other._data, other._data + other.num_blocks()),
+      _data(_blocks.data()) {
+    }
+
+    Chromosome(Chromosome &&other) :
+      _N(other._N) {
+      if (other.isMapped()) {
+        _blocks.assign(other._data, other._data + other.num_blocks());
+      }
+      else {
+        _blocks.swap(other._blocks);
+        other._N = 0u;
+        other._data = other._blocks.data();
+      }
+      _data = _blocks.data();
+    }
+
+    Chromosome &operator=(const Chromosome &other) {
+      if (this == &other) return *this;
+      if (isMapped()) {
+        assert(other._N == _N);
+        std::copy(other._data, other._data + num_blocks(), _data);
+      }
+      else {
+        _N = other._N;
+        _blocks.assign(other._data, other._data + other.num_blocks());
+        _data = _blocks.data();
+      }
+      return *this;
+    }
+
+    Chromosome &operator=(Chromosome &&other) {
+      if (this == &other) return *this;
+      if (isMapped() || other.isMapped()) return *this = other;
+      std::swap(_N, other._N);
+      _blocks.swap(other._blocks);
+      _data = _blocks.data();
+      other._data = other._blocks.data();
+      return *this;
     }
 
     bool operator[](const size_t i) const {
-      return _gens[i];
+      return (_data[i / bits_per_block] >> (i % bits_per_block)) & 1u;
+    }
+
+    void set(const size_t i, const bool value) {
+      const block_type mask = block_type(1u) << (i % bits_per_block);
+      if (value) _data[i / bits_per_block] |= mask;
+      else _data[i / bits_per_block] &= ~mask;
+    }
+
+    void flip(const size_t i) {
+      _data[i / bits_per_block] ^= block_type(1u) << (i % bits_per_block);
     }
 
     size_t size() const {
-      return _gens.size();
+      return _N;
     }
 
-    const bitset &gens() const {
-      return _gens;
+    size_t num_blocks() const {
+      return num_blocks_for(_N);
+    }
+
+    const block_type *blocks() const {
+      return _data;
+    }
+
+    block_type *blocks() {
+      return _data;
+    }
+
+    /// Returns a copy of the gens as a boost::dynamic_bitset
+    bitset gens() const {
+      bitset result(_N);
+      for (size_t i=0; i<_N; ++i) {
+        if ((*this)[i]) result.set(i);
+      }
+      return result;
     }
 
   private:
-    bitset _gens;
+    size_t _N;
+    /// owned storage, empty when the Chromosome is mapped
+    std::vector<block_type> _blocks;
+    /// the gens, pointing to _blocks or to mapped memory
+    block_type *_data;
+
+    bool isMapped() const {
+      return _N > 0u && _data != _blocks.data();
+    }
   }; // class Chromosome
 
+  /**
+   * A chromosome with a number of bits known at compilation time
+   *
+   * It has the same interface than Chromosome, but its words are
+   * stored inline, so it doesn't allocate heap memory and it is
+   * trivially copyable. It is the preferred representation when the
+   * number of gens is known at compilation time.
+   *
+   * All genetic operators and the solver are templates over the
+   * chromosome type, so this class can be used just by changing the
+   * initializer, e.g. using FixedRandomInitializer<N>.
+   */
+  template<size_t N>
+  class FixedChromosome {
+    static_assert(N > 0u, "FixedChromosome needs at least one gen");
+  public:
+    typedef std::pair<FixedChromosome, FixedChromosome > Couple;
+
+    static const size_t NUM_BLOCKS = (N + bits_per_block - 1u) / bits_per_block;
+
+    /// Builds a FixedChromosome with all gens zero, n should be N
+    explicit FixedChromosome(const size_t n = N) {
+      assert(n == N); (void)n;
+      for (size_t i=0; i<NUM_BLOCKS; ++i) _blocks[i] = 0u;
+    }
+
+    /// Builds a FixedChromosome with gens copied from the given words
+    FixedChromosome(const block_type *blocks, const size_t n = N) {
+      assert(n == N); (void)n;
+      for (size_t i=0; i<NUM_BLOCKS; ++i) _blocks[i] = blocks[i];
+      _blocks[NUM_BLOCKS - 1u] &= last_block_mask(N);
+    }
+
+    FixedChromosome(const std::bitset<N> &gens) :
+      FixedChromosome() {
+      for (size_t i=0; i<N; ++i) set(i, gens[i]);
+    }
+
+    bool operator[](const size_t i) const {
+      return (_blocks[i / bits_per_block] >> (i % bits_per_block)) & 1u;
+    }
+
+    void set(const size_t i, const bool value) {
+      const block_type mask = block_type(1u) << (i % bits_per_block);
+      if (value) _blocks[i / bits_per_block] |= mask;
+      else _blocks[i / bits_per_block] &= ~mask;
+    }
+
+    void flip(const size_t i) {
+      _blocks[i / bits_per_block] ^= block_type(1u) << (i % bits_per_block);
+    }
+
+    size_t size() const {
+      return N;
+    }
+
+    size_t num_blocks() const {
+      return NUM_BLOCKS;
+    }
+
+    const block_type *blocks() const {
+      return _blocks;
+    }
+
+    block_type *blocks() {
+      return _blocks;
+    }
+
+    /// Returns a copy of the gens as a std::bitset
+    std::bitset<N> gens() const {
+      std::bitset<N> result;
+      for (size_t i=0; i<N; ++i) result[i] = (*this)[i];
+      return result;
+    }
+
+  private:
+    block_type _blocks[NUM_BLOCKS];
+  }; // class FixedChromosome
+
+  template<size_t N>
+  const size_t FixedChromosome<N>::NUM_BLOCKS;
+
 } // namespace GeneticAlgorithms
 
 #endif // CHROMOSOME_H
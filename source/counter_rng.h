@@ -0,0 +1,152 @@
+/*
+ * This file is part of GeneticAlgorithms toolkit
+ *
+ * Copyright 2017, Francisco Zamora-Martinez
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef COUNTER_RNG_H
+#define COUNTER_RNG_H
+
+#include <cstdint>
+
+namespace GeneticAlgorithms {
+
+  /// Random streams of the genetic operators, see CounterRng::stream()
+  enum class RandomStream : uint32_t {
+    DEFAULT = 0u,
+    INITIALIZER = 1u,
+    SELECTION = 2u,
+    CROSS_OVER = 3u,
+    MUTATION = 4u,
+    /// Choice of CrossOverOnProbWrapper, apart from the wrapped cross-over
+    CROSS_OVER_CHOICE = 5u
+  };
+
+  /**
+   * Counter based random engine (Philox4x32-10)
+   *
+   * Every output is a function of a key and a counter, computed by
+   * ten rounds of multiplications and XORs, so there is no state to
+   * carry from one number to the next. The key is the seed, and the
+   * counter is made of four 32 bits words: the position in the
+   * stream, an individual index, a generation and a RandomStream.
+   *
+   * stream(generation, individual, kind) moves the engine to the
+   * beginning of the sequence of the given individual, so any thread
+   * can reproduce the random numbers used for a child without any
+   * shared state. The state is 48 bytes, instead of 2.5 KB of
+   * std::mt19937_64, so copies are cheap.
+   *
+   * It satisfies the UniformRandomBitGenerator requirements with
+   * 64 bits results, so it can be used with <random> distributions.
+   *
+   * ATTENTION: no thread safe object, it should be created for each
+   * thread in your program.
+   */
+  class CounterRng {
+  public:
+    typedef uint64_t result_type;
+
+    static constexpr result_type min() {
+      return 0u;
+    }
+
+    static constexpr result_type max() {
+      return ~result_type(0u);
+    }
+
+    explicit CounterRng(const uint64_t seed=0u) {
+      this->seed(seed);
+    }
+
+    /// Changes the key and moves to the default stream
+    void seed(const uint64_t seed) {
+      _key[0] = static_cast<uint32_t>(seed);
+      _key[1] = static_cast<uint32_t>(seed >> 32u);
+      stream(0u, 0u, RandomStream::DEFAULT);
+    }
+
+    /**
+     * Moves to the beginning of the given stream
+     *
+     * generation and individual are taken modulo 2^32, and every
+     * stream has 2^33 numbers.
+     */
+    void stream(const uint64_t generation, const uint64_t individual,
+                const RandomStream kind) {
+      _counter[0] = 0u;
+      _counter[1] = static_cast<uint32_t>(individual);
+      _counter[2] = static_cast<uint32_t>(generation);
+      _counter[3] = static_cast<uint32_t>(kind);
+      _index = 2u;
+    }
+
+    result_type operator()() {
+      if (_index == 2u) {
+        generate();
+        ++_counter[0];
+        _index = 0u;
+      }
+      return _output[_index++];
+    }
+
+    /// Advances the engine n numbers
+    void discard(unsigned long long n) {
+      for (; n > 0u; --n) (*this)();
+    }
+
+  private:
+    uint32_t _key[2];
+    uint32_t _counter[4];
+    uint64_t _output[2];
+    unsigned _index;
+
+    static void mulhilo(const uint32_t a, const uint32_t b,
+                        uint32_t &hi, uint32_t &lo) {
+      const uint64_t p = static_cast<uint64_t>(a) * b;
+      hi = static_cast<uint32_t>(p >> 32u);
+      lo = static_cast<uint32_t>(p);
+    }
+
+    /// Ten Philox rounds over the current counter
+    void generate() {
+      uint32_t c[4] = { _counter[0], _counter[1], _counter[2], _counter[3] };
+      uint32_t k[2] = { _key[0], _key[1] };
+      for (int round=0; round<10; ++round) {
+        uint32_t hi0, lo0, hi1, lo1;
+        mulhilo(0xD2511F53u, c[0], hi0, lo0);
+        mulhilo(0xCD9E8D57u, c[2], hi1, lo1);
+        const uint32_t x[4] = { hi1 ^ c[1] ^ k[0], lo1, hi0 ^ c[3] ^ k[1], lo0 };
+        c[0] = x[0]; c[1] = x[1]; c[2] = x[2]; c[3] = x[3];
+        k[0] += 0x9E3779B9u;
+        k[1] += 0xBB67AE85u;
+      }
+      _output[0] = (static_cast<uint64_t>(c[1]) << 32u) | c[0];
+      _output[1] = (static_cast<uint64_t>(c[3]) << 32u) | c[2];
+    }
+  }; // class CounterRng
+
+} // namespace GeneticAlgorithms
+
+#endif // COUNTER_RNG_H
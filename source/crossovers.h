@@ -29,10 +29,15 @@
 #define CROSSOVERS_H
 
 #include <algorithm>
-#include <boost/dynamic_bitset.hpp>
 #include <random>
+#include <utility>
+#include <vector>
 
+#include "bit_kernels.h"
+#include "breeding.h"
 #include "chromosome.h"
+#include "counter_rng.h"
+#include "seeding.h"
 
 namespace GeneticAlgorithms {
 
@@ -48,38 +53,70 @@ namespace GeneticAlgorithms {
    */
   class RandomSplitCrossOver {
   public:
-    RandomSplitCrossOver(size_t N, unsigned seed) :
+    RandomSplitCrossOver(size_t N, uint64_t seed) :
       _rng(seed),
       _int_dist(0uL, N-1),
-      _binary_dist(0uL, 1uL) {
+      _binary_dist(0uL, 1uL),
+      _pos(0u),
+      _swap(false) {
+    }
+
+    template<typename ChromosomeType>
+    ChromosomeType operator()(const ChromosomeType &a,
+                              const ChromosomeType &b) const {
+      ChromosomeType dest(a.size());
+      (*this)(a, b, dest);
+      return dest;
     }
 
-    Chromosome operator()(const Chromosome &a, const Chromosome &b) const {
-      bitset dest(a.size());
+    /// In-place version, dest should have the size of the parents
+    template<typename ChromosomeType>
+    void operator()(const ChromosomeType &a, const ChromosomeType &b,
+                    ChromosomeType &dest) const {
       // sample a random integer
       size_t pos = static_cast<size_t>(_int_dist(_rng));
+      // prefix [0,pos) from one parent, suffix [pos,N) from the other
       if (_binary_dist(_rng) == 0uL) {
-        for (size_t i=0; i<pos; ++i) {
-          dest[i] = a[i];
-        }
-        for (size_t i=pos; i<b.size(); ++i) {
-          dest[i] = b[i];
-        }
+        BitKernels::blend_segments(dest.blocks(), a.blocks(), b.blocks(),
+                                   &pos, 1u, a.size());
       }
       else {
-        for (size_t i=0; i<pos; ++i) {
-          dest[i] = b[i];
-        }
-        for (size_t i=pos; i<a.size(); ++i) {
-          dest[i] = a[i];
-        }
+        BitKernels::blend_segments(dest.blocks(), b.blocks(), a.blocks(),
+                                   &pos, 1u, a.size());
       }
-      return Chromosome(std::move(dest));
     }
+
+    /// Word protocol (see breeding.h), draws the split position
+    void beginMask(size_t) const {
+      _pos = static_cast<size_t>(_int_dist(_rng));
+      _swap = (_binary_dist(_rng) != 0uL);
+    }
+
+    /// Word protocol, gens before the split position from one parent
+    block_type maskWord(const size_t w) const {
+      const size_t begin = w * bits_per_block;
+      const block_type m =
+        BitKernels::low_mask((_pos > begin) ? _pos - begin : 0u);
+      return _swap ? ~m : m;
+    }
+
+    /// Restarts the random sequence of this functor with the given seed
+    void seed(uint64_t seed) {
+      _rng.seed(seed);
+    }
+
+    /// Moves to the random stream of (generation, individual), see counter_rng.h
+    void stream(uint64_t generation, uint64_t individual) const {
+      _rng.stream(generation, individual, RandomStream::CROSS_OVER);
+    }
+
   private:
-    mutable std::mt19937_64 _rng;
+    mutable CounterRng _rng;
     mutable std::uniform_int_distribution<size_t> _int_dist;
     mutable std::uniform_int_distribution<size_t> _binary_dist;
+    /// State of the word protocol between beginMask() and maskWord()
+    mutable size_t _pos;
+    mutable bool _swap;
   }; // class RandomSplitCrossOver
 
 
@@ -88,35 +125,169 @@ namespace GeneticAlgorithms {
    *
    * The functor implemented here mixes each gene based on a
    * random decision, so each gene has 0.5 probability to come
-   * from any of both parents.
+   * from any of both parents. Random decisions are drawn as 64 bits
+   * masks, one random number for every 64 gens.
    *
    * ATTENTION: no thread safe object, it should be created for each
    * thread in your program.
    */
   class RandomMixCrossOver {
   public:
-    RandomMixCrossOver(unsigned seed) :
+    RandomMixCrossOver(uint64_t seed) :
+      _rng(seed) {
+    }
+
+    template<typename ChromosomeType>
+    ChromosomeType operator()(const ChromosomeType &a,
+                              const ChromosomeType &b) const {
+      ChromosomeType dest(a.size());
+      (*this)(a, b, dest);
+      return dest;
+    }
+
+    /// In-place version, dest should have the size of the parents
+    template<typename ChromosomeType>
+    void operator()(const ChromosomeType &a, const ChromosomeType &b,
+                    ChromosomeType &dest) const {
+      // every random word decides the parent of 64 gens at once
+      BitKernels::blend_random(dest.blocks(), a.blocks(), b.blocks(),
+                               a.num_blocks(), _rng);
+    }
+
+    /// Word protocol (see breeding.h), nothing is drawn per child
+    void beginMask(size_t) const {
+    }
+
+    /// Word protocol, a random word as blend_random() draws it
+    block_type maskWord(size_t) const {
+      return static_cast<block_type>(_rng() - CounterRng::min());
+    }
+    /// Restarts the random sequence of this functor with the given seed
+    void seed(uint64_t seed) {
+      _rng.seed(seed);
+    }
+
+    /// Moves to the random stream of (generation, individual), see counter_rng.h
+    void stream(uint64_t generation, uint64_t individual) const {
+      _rng.stream(generation, individual, RandomStream::CROSS_OVER);
+    }
+
+  private:
+    mutable CounterRng _rng;
+  }; // class RandomMixCrossOver
+
+
+  /**
+   * A cross over class based on k random cut points
+   *
+   * The functor samples k different cut points and produces a child
+   * taking alternatively the segments between them from each parent.
+   * The parent which gives the first segment is chosen at random.
+   * With k=1 it is equivalent to RandomSplitCrossOver.
+   *
+   * ATTENTION: no thread safe object, it should be created for each
+   * thread in your program.
+   */
+  class KPointCrossOver {
+  public:
+    KPointCrossOver(size_t N, size_t k, uint64_t seed) :
       _rng(seed),
-      _int_dist(0u, 1u) {
+      _N(N),
+      _cuts(std::min(k, N - 1u)),
+      _binary_dist(0uL, 1uL),
+      _swap(false),
+      _next_cut(0u) {
     }
 
-    Chromosome operator()(const Chromosome &a, const Chromosome &b) const {
-      bitset dest(a.size());
-      for (size_t i=0; i<a.size(); ++i) {
-        // flip a coin to decide which parent gene copy is at i position
-        if (_int_dist(_rng) == 0u) {
-          dest[i] = a[i];
-        }
-        else {
-          dest[i] = b[i];
+    template<typename ChromosomeType>
+    ChromosomeType operator()(const ChromosomeType &a,
+                              const ChromosomeType &b) const {
+      ChromosomeType dest(a.size());
+      (*this)(a, b, dest);
+      return dest;
+    }
+
+    /// In-place version, dest should have the size of the parents
+    template<typename ChromosomeType>
+    void operator()(const ChromosomeType &a, const ChromosomeType &b,
+                    ChromosomeType &dest) const {
+      sampleCuts();
+      if (_binary_dist(_rng) == 0uL) {
+        BitKernels::blend_segments(dest.blocks(), a.blocks(), b.blocks(),
+                                   _cuts.data(), _cuts.size(), a.size());
+      }
+      else {
+        BitKernels::blend_segments(dest.blocks(), b.blocks(), a.blocks(),
+                                   _cuts.data(), _cuts.size(), a.size());
+      }
+    }
+
+    /// Word protocol (see breeding.h), draws the cut points
+    void beginMask(size_t) const {
+      sampleCuts();
+      _swap = (_binary_dist(_rng) != 0uL);
+      _next_cut = 0u;
+    }
+
+    /// Word protocol, even segments between cut points from one parent
+    block_type maskWord(const size_t w) const {
+      const size_t begin = w * bits_per_block;
+      size_t from = 0u;
+      block_type m = 0u;
+      while (_next_cut < _cuts.size() && _cuts[_next_cut] < begin + bits_per_block) {
+        const size_t to = _cuts[_next_cut] - begin;
+        if (_next_cut % 2u == 0u) {
+          m |= BitKernels::low_mask(to) & ~BitKernels::low_mask(from);
         }
+        from = to;
+        ++_next_cut;
       }
-      return Chromosome(std::move(dest));
+      if (_next_cut % 2u == 0u) m |= ~BitKernels::low_mask(from);
+      return _swap ? ~m : m;
+    }
+
+    /// Restarts the random sequence of this functor with the given seed
+    void seed(uint64_t seed) {
+      _rng.seed(seed);
+    }
+
+    /// Moves to the random stream of (generation, individual), see counter_rng.h
+    void stream(uint64_t generation, uint64_t individual) const {
+      _rng.stream(generation, individual, RandomStream::CROSS_OVER);
     }
+
   private:
-    mutable std::mt19937_64 _rng;
-    mutable std::uniform_int_distribution<size_t> _int_dist;
-  }; // class RandomMixCrossOver
+    mutable CounterRng _rng;
+    const size_t _N;
+    /// sorted cut points, reused between calls to avoid allocations
+    mutable std::vector<size_t> _cuts;
+    mutable std::uniform_int_distribution<size_t> _binary_dist;
+    /// State of the word protocol between beginMask() and maskWord()
+    mutable bool _swap;
+    mutable size_t _next_cut;
+
+    /// Floyd's sampling of k different cut points in range [1,N)
+    void sampleCuts() const {
+      const size_t k = _cuts.size();
+      for (size_t j=_N-k; j<_N; ++j) {
+        std::uniform_int_distribution<size_t> dist(1uL, j);
+        size_t t = dist(_rng);
+        size_t i = _N - k;
+        size_t *end = _cuts.data() + (j - i);
+        if (std::find(_cuts.data(), end, t) != end) t = j;
+        *end = t;
+      }
+      std::sort(_cuts.begin(), _cuts.end());
+    }
+  }; // class KPointCrossOver
+
+  /// A KPointCrossOver with two cut points
+  class TwoPointCrossOver : public KPointCrossOver {
+  public:
+    TwoPointCrossOver(size_t N, uint64_t seed) :
+      KPointCrossOver(N, 2u, seed) {
+    }
+  }; // class TwoPointCrossOver
 
 
   /**
@@ -128,17 +299,21 @@ namespace GeneticAlgorithms {
   template <typename CrossOverFunctor>
   class CrossOverOnProbWrapper {
   public:
-    CrossOverOnProbWrapper(unsigned seed, float prob,
+    CrossOverOnProbWrapper(uint64_t seed, float prob,
                            const CrossOverFunctor &crossover) :
       _rng(seed),
       _real_dist(0.0f, 1.0f),
       _binary_dist(0uL, 1uL),
       _prob(prob),
-      _crossover(crossover) {
+      _crossover(crossover),
+      _crossing(false),
+      _mask(0u) {
     }
 
     /// Cross-overs with _prob probability, else returns one random parent
-    Chromosome operator()(const Chromosome &a, const Chromosome &b) const {
+    template<typename ChromosomeType>
+    ChromosomeType operator()(const ChromosomeType &a,
+                              const ChromosomeType &b) const {
       if (_real_dist(_rng) < _prob) {
         return _crossover(a, b);
       }
@@ -148,18 +323,62 @@ namespace GeneticAlgorithms {
       }
     }
 
+    /// In-place version, it uses the in-place protocol of CrossOverFunctor if any
+    template<typename ChromosomeType>
+    void operator()(const ChromosomeType &a, const ChromosomeType &b,
+                    ChromosomeType &dest) const {
+      if (_real_dist(_rng) < _prob) {
+        cross_over_into(_crossover, a, b, dest);
+      }
+      else {
+        if (_binary_dist(_rng) == 0uL) dest = a;
+        else dest = b;
+      }
+    }
+
+    /// Word protocol (see breeding.h), when CrossOverFunctor implements it
+    template<typename F=CrossOverFunctor>
+    auto beginMask(const size_t num_gens) const
+      -> decltype(std::declval<const F&>().beginMask(num_gens), void()) {
+      _crossing = (_real_dist(_rng) < _prob);
+      if (_crossing) _crossover.beginMask(num_gens);
+      else _mask = (_binary_dist(_rng) == 0uL) ? ~block_type(0u) : block_type(0u);
+    }
+
+    /// Word protocol, a whole parent is a mask of all ones or zeros
+    template<typename F=CrossOverFunctor>
+    auto maskWord(const size_t w) const
+      -> decltype(std::declval<const F&>().maskWord(w)) {
+      return _crossing ? _crossover.maskWord(w) : _mask;
+    }
+
+    /// Restarts the random sequence of this functor with the given seed
+    void seed(uint64_t seed) {
+      _rng.seed(seed);
+      reseed(_crossover, derive_seed(seed, 1u));
+    }
+
+    /// Moves to the random stream of (generation, individual), see counter_rng.h
+    void stream(uint64_t generation, uint64_t individual) const {
+      _rng.stream(generation, individual, RandomStream::CROSS_OVER_CHOICE);
+      restream(_crossover, generation, individual);
+    }
+
   private:
-    mutable std::mt19937_64 _rng;
+    mutable CounterRng _rng;
     mutable std::uniform_real_distribution<float> _real_dist;
     mutable std::uniform_int_distribution<size_t> _binary_dist;
     float _prob;
     CrossOverFunctor _crossover;
+    /// State of the word protocol between beginMask() and maskWord()
+    mutable bool _crossing;
+    mutable block_type _mask;
   };
 
   /// Helper for construction of CrossOverOnProbWrapper instances
   template <typename CrossOverFunctor>
   CrossOverOnProbWrapper<CrossOverFunctor>
-  make_cross_over_on_prob(unsigned seed,
+  make_cross_over_on_prob(uint64_t seed,
                           float prob,
                           const CrossOverFunctor &crossover) {
     return CrossOverOnProbWrapper<CrossOverFunctor>(seed,
@@ -0,0 +1,85 @@
+/*
+ * This file is part of GeneticAlgorithms toolkit
+ *
+ * Copyright 2017, Francisco Zamora-Martinez
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef DIVERSITY_H
+#define DIVERSITY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "chromosome.h"
+
+namespace GeneticAlgorithms {
+
+  /**
+   * Counts how many chromosomes have every gen set
+   *
+   * counts is resized to the number of gens. Only set bits are
+   * visited, a word at a time.
+   */
+  template<typename PopulationType>
+  void gen_counts(const PopulationType &population,
+                  std::vector<uint32_t> &counts) {
+    const size_t n = population.size();
+    counts.assign(n > 0u ? population.chromosome(0u).size() : 0u, 0u);
+    for (size_t i=0; i<n; ++i) {
+      const block_type *blocks = population.chromosome(i).blocks();
+      const size_t num_blocks = population.chromosome(i).num_blocks();
+      for (size_t w=0; w<num_blocks; ++w) {
+        for (block_type x = blocks[w]; x != 0u; x &= x - 1u) {
+          ++counts[w*bits_per_block + static_cast<size_t>(__builtin_ctzll(x))];
+        }
+      }
+    }
+  }
+
+  /**
+   * Mean Hamming distance between all pairs of chromosomes
+   *
+   * A gen set at c of n chromosomes contributes c*(n-c) different
+   * pairs, so the mean over the n*(n-1)/2 pairs is computed from the
+   * gen counts in linear time, instead of comparing every pair. The
+   * result is divided by the number of gens, so it is in [0,0.5] for
+   * large populations: 0 when all chromosomes are equal, 0.5 for
+   * random ones. counts is used as scratch memory.
+   */
+  template<typename PopulationType>
+  double mean_pairwise_hamming(const PopulationType &population,
+                               std::vector<uint32_t> &counts) {
+    const size_t n = population.size();
+    if (n < 2u) return 0.0;
+    gen_counts(population, counts);
+    if (counts.empty()) return 0.0;
+    double sum = 0.0;
+    for (uint32_t c : counts) sum += double(c) * double(n - c);
+    return sum / (0.5 * double(n) * double(n - 1u)) / double(counts.size());
+  }
+
+} // namespace GeneticAlgorithms
+
+#endif // DIVERSITY_H
@@ -0,0 +1,234 @@
+/*
+ * This file is part of GeneticAlgorithms toolkit
+ *
+ * Copyright 2017, Francisco Zamora-Martinez
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef FITNESS_CACHE_H
+#define FITNESS_CACHE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "bit_kernels.h"
+#include "chromosome.h"
+
+namespace GeneticAlgorithms {
+
+  /**
+   * A bounded cache of ranks indexed by chromosome gens
+   *
+   * Children are often exact copies of their parents or of other
+   * children (cross-over not applied, no mutated gens, elitism), so
+   * their rank can be reused when RankFunctor is deterministic and
+   * expensive. The cache stores a copy of the gens of every entry,
+   * so a lookup hashes the gens and verifies full equality before
+   * answering, hash collisions never produce a wrong rank.
+   *
+   * Memory is allocated once for capacity entries. When the cache is
+   * full, entries are evicted following the CLOCK algorithm (an
+   * approximation of LRU), and a hit marks an entry as recently used.
+   * The number of hits and misses is recorded for reporting.
+   *
+   * All entries should have the same number of gens, the cache is
+   * cleared when a chromosome with a different size arrives.
+   *
+   * ATTENTION: no thread safe object. Population uses it from one
+   * thread, before and after the parallel evaluation.
+   *
+   * @code
+   * FitnessCache<float> cache(100000);
+   * Chromosome best = solve(1000u, 100u, ..., MyRank(), 0, 8, &cache);
+   * std::cout << cache.hits() << " " << cache.misses() << std::endl;
+   * @endcode
+   */
+  template<typename T>
+  class FitnessCache {
+  public:
+    explicit FitnessCache(const size_t capacity) :
+      _capacity(std::max<size_t>(capacity, 1u)),
+      _num_gens(0u),
+      _num_blocks(0u),
+      _size(0u),
+      _hand(0u),
+      _hits(0u),
+      _misses(0u) {
+      size_t table_size = 1u;
+      while (table_size < 2u*_capacity) table_size <<= 1u;
+      _table.assign(table_size, EMPTY);
+      _entries.resize(_capacity);
+    }
+
+    /// If x is in the cache, writes its rank and returns true
+    template<typename ChromosomeType>
+    bool find(const ChromosomeType &x, T &rank) {
+      if (x.size() != _num_gens || _size == 0u) {
+        ++_misses;
+        return false;
+      }
+      const uint64_t h = BitKernels::hash(x.blocks(), _num_blocks);
+      for (size_t pos=h & mask(); _table[pos] != EMPTY; pos=(pos+1u) & mask()) {
+        Entry &e = _entries[_table[pos]];
+        if (e.hash == h && BitKernels::equal(gens(_table[pos]), x.blocks(),
+                                             _num_blocks)) {
+          e.referenced = true;
+          rank = e.rank;
+          ++_hits;
+          return true;
+        }
+      }
+      ++_misses;
+      return false;
+    }
+
+    /// Stores the rank of x, evicting an old entry when needed
+    template<typename ChromosomeType>
+    void insert(const ChromosomeType &x, const T rank) {
+      if (x.size() != _num_gens) reshape(x.size());
+      const uint64_t h = BitKernels::hash(x.blocks(), _num_blocks);
+      size_t pos = h & mask();
+      for (; _table[pos] != EMPTY; pos=(pos+1u) & mask()) {
+        Entry &e = _entries[_table[pos]];
+        if (e.hash == h && BitKernels::equal(gens(_table[pos]), x.blocks(),
+                                             _num_blocks)) {
+          e.rank = rank;
+          return;
+        }
+      }
+      size_t slot;
+      if (_size < _capacity) {
+        slot = _size++;
+      }
+      else {
+        slot = evict();
+        // the table could change at eviction, search the position again
+        for (pos=h & mask(); _table[pos] != EMPTY; pos=(pos+1u) & mask()) { }
+      }
+      std::copy(x.blocks(), x.blocks() + _num_blocks, gens(slot));
+      Entry &e = _entries[slot];
+      e.hash = h;
+      e.rank = rank;
+      e.referenced = false;
+      _table[pos] = slot;
+    }
+
+    /// Removes all entries, keeping the counters
+    void clear() {
+      std::fill(_table.begin(), _table.end(), EMPTY);
+      _size = 0u;
+      _hand = 0u;
+    }
+
+    size_t size() const {
+      return _size;
+    }
+
+    size_t capacity() const {
+      return _capacity;
+    }
+
+    size_t hits() const {
+      return _hits;
+    }
+
+    size_t misses() const {
+      return _misses;
+    }
+
+    /// Ratio of lookups answered by the cache
+    double hitRate() const {
+      const size_t total = _hits + _misses;
+      return (total > 0u) ? double(_hits) / total : 0.0;
+    }
+
+  private:
+    static const size_t EMPTY = ~size_t(0u);
+
+    struct Entry {
+      uint64_t hash;
+      T rank;
+      bool referenced;
+    };
+
+    const size_t _capacity;
+    size_t _num_gens, _num_blocks, _size, _hand;
+    size_t _hits, _misses;
+    /// open addressing table of entry indices, linear probing
+    std::vector<size_t> _table;
+    std::vector<Entry> _entries;
+    /// gens of every entry, _num_blocks words each one
+    std::vector<block_type> _gens;
+
+    size_t mask() const {
+      return _table.size() - 1u;
+    }
+
+    block_type *gens(const size_t slot) {
+      return _gens.data() + slot*_num_blocks;
+    }
+
+    void reshape(const size_t num_gens) {
+      clear();
+      _num_gens = num_gens;
+      _num_blocks = num_blocks_for(num_gens);
+      _gens.assign(_capacity * _num_blocks, 0u);
+    }
+
+    /// CLOCK eviction, returns the freed entry index
+    size_t evict() {
+      while (_entries[_hand].referenced) {
+        _entries[_hand].referenced = false;
+        _hand = (_hand + 1u) % _capacity;
+      }
+      const size_t slot = _hand;
+      _hand = (_hand + 1u) % _capacity;
+      erase(slot);
+      return slot;
+    }
+
+    /// Removes slot from the table by backward shift deletion
+    void erase(const size_t slot) {
+      size_t pos = _entries[slot].hash & mask();
+      while (_table[pos] != slot) pos = (pos + 1u) & mask();
+      size_t next = (pos + 1u) & mask();
+      while (_table[next] != EMPTY) {
+        const size_t home = _entries[_table[next]].hash & mask();
+        // move the entry back when its home is not in (pos, next]
+        if (((next - home) & mask()) >= ((next - pos) & mask())) {
+          _table[pos] = _table[next];
+          pos = next;
+        }
+        next = (next + 1u) & mask();
+      }
+      _table[pos] = EMPTY;
+    }
+  }; // class FitnessCache
+
+  template<typename T>
+  const size_t FitnessCache<T>::EMPTY;
+
+} // namespace GeneticAlgorithms
+
+#endif // FITNESS_CACHE_H
@@ -28,24 +28,294 @@
 #ifndef GENETIC_SOLVER_H
 #define GENETIC_SOLVER_H
 
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
 #include <iostream>
+#include <numeric>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
+#include "breeding.h"
+#include "checkpoint.h"
 #include "chromosome.h"
+#include "diversity.h"
+#include "fitness_cache.h"
+#include "observer.h"
 #include "population.h"
+#include "seeding.h"
+#include "stopping.h"
+#include "thread_pool.h"
 
 namespace GeneticAlgorithms {
 
+  /**
+   * Copies of the cross-over and mutation functors, one per worker
+   *
+   * Solvers build them once, for the workers of their ThreadPool, and
+   * every generation moves them to the random streams of its children
+   * (see counter_rng.h), instead of copying the functors again.
+   */
+  template<typename CrossOverFunctor, typename MutationFunctor>
+  class WorkerOperators {
+  public:
+    WorkerOperators(const CrossOverFunctor &cross_over_func,
+                    const MutationFunctor &mutate_func,
+                    const size_t num_workers=1u) :
+      _cross_overs(std::max<size_t>(num_workers, 1u), cross_over_func),
+      _mutates(std::max<size_t>(num_workers, 1u), mutate_func) {
+    }
+
+    size_t size() const {
+      return _cross_overs.size();
+    }
+
+    const CrossOverFunctor &crossOver(const size_t worker) const {
+      return _cross_overs[worker];
+    }
+
+    const MutationFunctor &mutate(const size_t worker) const {
+      return _mutates[worker];
+    }
+
+  private:
+    std::vector<CrossOverFunctor> _cross_overs;
+    std::vector<MutationFunctor> _mutates;
+  }; // class WorkerOperators
+
+  /**
+   * Breeds children [first,last) of next from the given couples
+   *
+   * Child k is bred from couples[k - first] in the random streams of
+   * (generation, k), so its gens don't depend on which thread breeds
+   * it. When a ThreadPool is given, children are bred in parallel,
+   * every worker with its own operators. When times is given, the
+   * time of every operator is added there.
+   */
+  template<typename PopulationType,
+           typename CrossOverFunctor,
+           typename MutationFunctor>
+  void breed_children(const PopulationType &current,
+                      PopulationType &next,
+                      const std::vector<IndexCouple> &couples,
+                      const size_t first,
+                      const WorkerOperators<CrossOverFunctor,
+                                            MutationFunctor> &operators,
+                      const size_t generation,
+                      ThreadPool *pool,
+                      BreedTimes *times,
+                      std::true_type) {
+    const size_t num_workers = (pool != nullptr) ? pool->size() : 1u;
+    assert(num_workers <= operators.size());
+    std::vector<BreedTimes> worker_times((times != nullptr) ? num_workers : 0u);
+    auto breed_chunk = [&](size_t worker, size_t begin, size_t end) {
+      const CrossOverFunctor &cross_over = operators.crossOver(worker);
+      const MutationFunctor &mutate = operators.mutate(worker);
+      for (size_t k=begin; k<end; ++k) {
+        restream(cross_over, generation, first + k);
+        restream(mutate, generation, first + k);
+        if (times == nullptr) {
+          breed_into(cross_over, mutate,
+                     current.chromosome(couples[k].first),
+                     current.chromosome(couples[k].second),
+                     next.unranked(first + k));
+        }
+        else {
+          timed_breed_into(cross_over, mutate,
+                           current.chromosome(couples[k].first),
+                           current.chromosome(couples[k].second),
+                           next.unranked(first + k), worker_times[worker]);
+        }
+      }
+    };
+    if (num_workers > 1u) pool->parallel_for(couples.size(), 0u, breed_chunk);
+    else breed_chunk(0u, 0u, couples.size());
+    for (const BreedTimes &t : worker_times) *times += t;
+  }
+
+  /// Functors without random streams are used in order by one thread
+  template<typename PopulationType,
+           typename CrossOverFunctor,
+           typename MutationFunctor>
+  void breed_children(const PopulationType &current,
+                      PopulationType &next,
+                      const std::vector<IndexCouple> &couples,
+                      const size_t first,
+                      const WorkerOperators<CrossOverFunctor,
+                                            MutationFunctor> &operators,
+                      const size_t, ThreadPool *,
+                      BreedTimes *times,
+                      std::false_type) {
+    const CrossOverFunctor &cross_over = operators.crossOver(0u);
+    const MutationFunctor &mutate = operators.mutate(0u);
+    for (size_t k=0; k<couples.size(); ++k) {
+      if (times == nullptr) {
+        breed_into(cross_over, mutate,
+                   current.chromosome(couples[k].first),
+                   current.chromosome(couples[k].second),
+                   next.unranked(first + k));
+      }
+      else {
+        timed_breed_into(cross_over, mutate,
+                         current.chromosome(couples[k].first),
+                         current.chromosome(couples[k].second),
+                         next.unranked(first + k), *times);
+      }
+    }
+  }
+
+  /**
+   * Computes one generation of the genetic algorithm
+   *
+   * Breeds population_size-1 children of current into next, ranks
+   * them, swaps both populations and keeps the best Hypothesis ever
+   * seen at best, which is added to current (elitism). At return,
+   * current contains the new generation and next is empty. It is the
+   * body of the loop at solve(), shared with other solvers.
+   *
+   * generation is the number of the generation, used to select the
+   * random streams of the functors (see counter_rng.h), so it should
+   * be different at every call. When the cross-over and mutation
+   * functors implement stream(), children are bred in parallel using
+   * pool, with the same result for any number of workers, and
+   * operators should have a copy for every worker of pool.
+   *
+   * When times is given, the wall and CPU times of selection,
+   * breeding and ranking, and the times of the cross-over and
+   * mutation functors, are written there.
+   */
+  template<typename PopulationType,
+           typename SelectionFunctor,
+           typename CrossOverFunctor,
+           typename MutationFunctor>
+  void next_generation(PopulationType &current,
+                       PopulationType &next,
+                       typename PopulationType::Hypothesis &best,
+                       const SelectionFunctor &select_func,
+                       const WorkerOperators<CrossOverFunctor,
+                                             MutationFunctor> &operators,
+                       const size_t population_size,
+                       const size_t generation,
+                       ThreadPool *pool=nullptr,
+                       PhaseTimes *times=nullptr) {
+    const size_t num_gens = best.first.size();
+    PhaseTimer timer;
+    if (times != nullptr) timer.restart();
+    restream(select_func, generation, 0u);
+    const std::vector<IndexCouple> couples =
+      current.select(select_func, population_size - 1uL);
+    if (times != nullptr) timer.lap(times->select, times->select_cpu);
+    // children are written directly into their rows of next population
+    const size_t first = next.size();
+    for (const IndexCouple &couple : couples) {
+      next.emplace(num_gens, current, couple);
+    }
+    BreedTimes breed_times;
+    breed_children(current, next, couples, first, operators, generation, pool,
+                   (times != nullptr) ? &breed_times : nullptr,
+                   std::integral_constant<bool,
+                   has_stream<CrossOverFunctor>::value &&
+                   has_stream<MutationFunctor>::value>());
+    if (times != nullptr) {
+      timer.lap(times->breed, times->breed_cpu);
+      times->cross_over = std::chrono::duration<double>(breed_times.cross_over).count();
+      times->mutate = std::chrono::duration<double>(breed_times.mutate).count();
+    }
+    next.evaluate();
+    if (times != nullptr) timer.lap(times->rank, times->rank_cpu);
+    std::swap(current, next);
+    next.reset();
+    if (best.second < current.top().second) {
+      best = current.top();
+    }
+    // elitism: the best one passes directly, without ranking it again
+    current.push(best.first, best.second);
+  }
+
+  /**
+   * next_generation() followed by the statistics of the new generation
+   *
+   * Besides the times, record receives the best, mean and worst
+   * ranks and the diversity of current (see diversity.h), which uses
+   * counts as scratch memory.
+   */
+  template<typename PopulationType,
+           typename SelectionFunctor,
+           typename CrossOverFunctor,
+           typename MutationFunctor>
+  void observed_generation(PopulationType &current,
+                           PopulationType &next,
+                           typename PopulationType::Hypothesis &best,
+                           const SelectionFunctor &select_func,
+                           const WorkerOperators<CrossOverFunctor,
+                                                 MutationFunctor> &operators,
+                           const size_t population_size,
+                           const size_t generation,
+                           ThreadPool *pool,
+                           GenerationRecord &record,
+                           std::vector<uint32_t> &counts) {
+    const auto wall_start = std::chrono::steady_clock::now();
+    const std::clock_t cpu_start = std::clock();
+    PhaseTimes times;
+    next_generation(current, next, best, select_func, operators,
+                    population_size, generation, pool, &times);
+    record.wall_seconds = seconds_since(wall_start);
+    record.cpu_seconds = cpu_seconds_since(cpu_start);
+    record.select_seconds = times.select;
+    record.breed_seconds = times.breed;
+    record.rank_seconds = times.rank;
+    record.select_cpu_seconds = times.select_cpu;
+    record.breed_cpu_seconds = times.breed_cpu;
+    record.rank_cpu_seconds = times.rank_cpu;
+    record.cross_over_seconds = times.cross_over;
+    record.mutate_seconds = times.mutate;
+    record.generation = generation + 1u;
+    const auto &ranks = current.ranks();
+    const auto bounds = std::minmax_element(ranks.begin(), ranks.end());
+    record.best_rank = *bounds.second;
+    record.worst_rank = *bounds.first;
+    record.mean_rank = std::accumulate(ranks.begin(), ranks.end(), 0.0) /
+      std::max<size_t>(ranks.size(), 1u);
+    record.diversity = mean_pairwise_hamming(current, counts);
+  }
+
+  /// Prints a GenerationRecord for the given verbosity level
+  inline void print_generation(std::ostream &out, const GenerationRecord &r,
+                               const int verbosity) {
+    out << "generation " << r.generation
+        << " best " << r.best_rank
+        << " mean " << r.mean_rank
+        << " worst " << r.worst_rank
+        << " diversity " << r.diversity;
+    if (verbosity > 2) {
+      out << " select " << r.select_seconds << "s"
+          << " breed " << r.breed_seconds << "s"
+          << " rank " << r.rank_seconds << "s"
+          << " cross_over " << r.cross_over_seconds << "s"
+          << " mutate " << r.mutate_seconds << "s"
+          << " wall " << r.wall_seconds << "s"
+          << " cpu " << r.cpu_seconds << "s";
+    }
+    out << std::endl;
+  }
+
   /**
    * This function implements a generic genetic algorithm
    *
    * This algorithm is build on top of several genetic operators:
    *
    * - InitializerFunctor: a functor which returns a Chromosome each
-   *      time it is called.
+   *      time it is called. The type of its result decides the
+   *      chromosome type used by the algorithm, which can be
+   *      Chromosome or any FixedChromosome<N>.
    *
-   * - SelectionFunctor: a functor which receives a vector of
-   *      hypothesis and produces as output a vector of
-   *      Chromosome::Couple selected for cross over.
+   * - SelectionFunctor: a functor which receives the ranks of the
+   *      population (a random access sequence of T) and produces as
+   *      output a vector of IndexCouple selected for cross over.
    *
    * - CrossOverFunctor: a functor which receives two Chromosome and
    *      returns their child, mixing gens on both inputs.
@@ -53,6 +323,10 @@ namespace GeneticAlgorithms {
    * - MutationFunctor: a functor which receives a Chromosome and
    *      returns another one with some gens mutated (or not).
    *
+   * CrossOverFunctor and MutationFunctor may also implement the
+   * in-place protocol described at breeding.h, which allows to write
+   * children directly into the population memory.
+   *
    * - RankFunctor: a functor which receives a Chromosome and returns
    *      its rank (template typename T)
    *
@@ -62,6 +336,45 @@ namespace GeneticAlgorithms {
    * @note This function implements basic elitism algorithm, the best
    * candidate survives to next generation.
    *
+   * @note Every generation is bred completely before ranking it. When
+   * num_threads > 1, RankFunctor is executed in parallel by a
+   * ThreadPool with num_threads workers, each one using its own copy
+   * of RankFunctor. Operators of this toolkit use counter based
+   * random streams (see counter_rng.h), so children are also bred in
+   * parallel, and the result is the same for any num_threads.
+   *
+   * @note RankFunctor can implement the incremental protocol
+   * described at incremental.h, so children close to one of their
+   * parents are ranked from the parent rank and the changed gens.
+   *
+   * @note When a FitnessCache is given, ranks of repeated chromosomes
+   * are taken from it instead of calling RankFunctor again.
+   *
+   * @note verbosity 1 prints a summary at the end, 2 prints the
+   * statistics of every generation and 3 adds phase times, all of
+   * them to std::cerr.
+   *
+   * @note An Observer with enabled=true (see observer.h), as
+   * GenerationLog, receives a GenerationRecord after every
+   * generation, with statistics, diversity and phase times. With the
+   * default NullObserver nothing is measured.
+   *
+   * @note When a CheckpointConfig is given, the population is written
+   * to checkpoint->path every checkpoint->interval generations and at
+   * the end (see checkpoint.h). If the file already exists and
+   * checkpoint->resume is true, the run continues from it, and
+   * num_iterations counts the generations done before. The checkpoint
+   * keeps no random state: a resumed run continues exactly as the
+   * interrupted one because operators select their random streams
+   * from the generation (see counter_rng.h). So selection, cross-over
+   * and mutation functors should implement stream(), otherwise
+   * std::runtime_error is thrown. It is thrown too when the checkpoint
+   * has a different population size or number of gens.
+   *
+   * @note solve_until() runs until a stopping criterion fires, as a
+   * target rank, a time budget or stagnation, instead of a fixed
+   * number of generations.
+   *
    * @code
    *  struct MyRank {
    *    float operator()(const Chromosome &x) const {
@@ -85,33 +398,163 @@ namespace GeneticAlgorithms {
            typename CrossOverFunctor,
            typename MutationFunctor,
            typename RankFunctor,
-           typename T=float>
-  Chromosome solve(const size_t num_iterations,
-                   const size_t population_size,
-                   const InitializerFunctor &init_func,
-                   const SelectionFunctor &select_func,
-                   const CrossOverFunctor &cross_over_func,
-                   const MutationFunctor &mutate_func,
-                   const RankFunctor &rank_func,
-                   int verbosity=0) {
-    Population<RankFunctor, T> current(rank_func);
-    Population<RankFunctor, T> next(rank_func);
-
-    current.init(init_func, population_size);
-
-    typename Population<RankFunctor, T>::Hypothesis best = current.top();
-
-    for (size_t i=0; i<num_iterations; ++i) {
-      for (auto couple : current.select(select_func, population_size - 1uL)) {
-        next.push(mutate_func(cross_over_func(couple.first, couple.second)));
+           typename T=float,
+           typename ChromosomeType=typename std::decay<
+             decltype(std::declval<const InitializerFunctor&>()())>::type,
+           typename Observer=NullObserver>
+  ChromosomeType solve(const size_t num_iterations,
+                       const size_t population_size,
+                       const InitializerFunctor &init_func,
+                       const SelectionFunctor &select_func,
+                       const CrossOverFunctor &cross_over_func,
+                       const MutationFunctor &mutate_func,
+                       const RankFunctor &rank_func,
+                       int verbosity=0,
+                       size_t num_threads=1u,
+                       FitnessCache<T> *cache=nullptr,
+                       const CheckpointConfig *checkpoint=nullptr,
+                       Observer *observer=nullptr) {
+    return solve_until(MaxGenerations(num_iterations), population_size,
+                       init_func, select_func, cross_over_func, mutate_func,
+                       rank_func, verbosity, num_threads, cache, checkpoint,
+                       observer);
+  }
+
+  /**
+   * solve() running until the given stopping criterion fires
+   *
+   * The criterion is checked before every generation, see
+   * stopping.h for the available ones and how to compose them. When
+   * report is given, it receives which criterion fired, and the
+   * generations, evaluations and time of the run. Generations count
+   * the ones restored from a checkpoint, but evaluations and time
+   * only count this run. Evaluations are calls to the RankFunctor, so
+   * ranks found at the FitnessCache don't count.
+   *
+   * @code
+   * StopReport report;
+   * Chromosome best = solve_until(Stagnation(50u) || WallClock(60.0),
+   *                               100u, init, select, cross, mutate,
+   *                               MyRank(), 0, 1u,
+   *                               static_cast<FitnessCache<float>*>(nullptr),
+   *                               nullptr, static_cast<NullObserver*>(nullptr),
+   *                               &report);
+   * @endcode
+   */
+  template<typename Criterion,
+           typename InitializerFunctor,
+           typename SelectionFunctor,
+           typename CrossOverFunctor,
+           typename MutationFunctor,
+           typename RankFunctor,
+           typename T=float,
+           typename ChromosomeType=typename std::decay<
+             decltype(std::declval<const InitializerFunctor&>()())>::type,
+           typename Observer=NullObserver>
+  ChromosomeType solve_until(const Criterion &stop,
+                             const size_t population_size,
+                             const InitializerFunctor &init_func,
+                             const SelectionFunctor &select_func,
+                             const CrossOverFunctor &cross_over_func,
+                             const MutationFunctor &mutate_func,
+                             const RankFunctor &rank_func,
+                             int verbosity=0,
+                             size_t num_threads=1u,
+                             FitnessCache<T> *cache=nullptr,
+                             const CheckpointConfig *checkpoint=nullptr,
+                             Observer *observer=nullptr,
+                             StopReport *report=nullptr) {
+    ThreadPool pool(num_threads);
+    typedef Population<RankFunctor, T, ChromosomeType> PopulationType;
+    typedef typename PopulationType::Hypothesis Hypothesis;
+    PopulationType current(rank_func, &pool, cache);
+    PopulationType next(rank_func, &pool, cache);
+
+    SolverProgress progress = SolverProgress();
+    Hypothesis best;
+    if (checkpoint != nullptr &&
+        !(has_stream<SelectionFunctor>::value &&
+          has_stream<CrossOverFunctor>::value &&
+          has_stream<MutationFunctor>::value)) {
+      throw std::runtime_error("Checkpoints require operators with random streams");
+    }
+    if (checkpoint != nullptr && checkpoint->resume &&
+        checkpoint_exists(checkpoint->path)) {
+      MappedCheckpoint saved(checkpoint->path);
+      // a copy, so the initializer given by the caller is not advanced
+      const size_t num_gens = InitializerFunctor(init_func)().size();
+      if (saved.size() != population_size || saved.numGens() != num_gens) {
+        throw std::runtime_error("Checkpoint " + checkpoint->path +
+                                 " has a different population size or number of gens");
       }
-      std::swap(current, next);
-      next.reset();
-      if (best.second < current.top().second) {
-        best = current.top();
+      current.load(saved.rows(), saved.ranks<T>(), saved.size(),
+                   saved.numGens());
+      best = Hypothesis(ChromosomeType(saved.bestRow(), saved.numGens()),
+                        saved.bestRank<T>());
+      progress.generation = saved.generation();
+    }
+    else {
+      current.init(init_func, population_size);
+      best = current.top();
+      progress.evaluations = current.numEvaluations();
+    }
+
+    next.reserve(population_size, best.first.size());
+    const WorkerOperators<CrossOverFunctor, MutationFunctor>
+      operators(cross_over_func, mutate_func, pool.size());
+    const bool observe = (Observer::enabled && observer != nullptr) || verbosity > 1;
+    GenerationRecord record = GenerationRecord();
+    std::vector<uint32_t> counts;
+    const auto start = std::chrono::steady_clock::now();
+    progress.best_rank = best.second;
+    if (Criterion::uses_diversity) {
+      progress.diversity = mean_pairwise_hamming(current, counts);
+    }
+    bool saved = true;
+    while (!stop(progress)) {
+      const size_t i = progress.generation;
+      const T previous_rank = best.second;
+      if (!observe) {
+        next_generation(current, next, best, select_func, operators,
+                        population_size, i, &pool);
+        if (Criterion::uses_diversity) {
+          progress.diversity = mean_pairwise_hamming(current, counts);
+        }
+      }
+      else {
+        observed_generation(current, next, best, select_func, operators,
+                            population_size, i, &pool, record, counts);
+        if (Observer::enabled && observer != nullptr) (*observer)(record);
+        if (verbosity > 1) print_generation(std::cerr, record, verbosity);
+        progress.diversity = record.diversity;
       }
-      // elitism: the best one passes directly
-      current.push(best.first);
+      ++progress.generation;
+      progress.evaluations = current.numEvaluations() + next.numEvaluations();
+      progress.seconds = seconds_since(start);
+      progress.best_rank = best.second;
+      if (previous_rank < best.second) progress.stagnant_generations = 0u;
+      else ++progress.stagnant_generations;
+      saved = false;
+      if (checkpoint != nullptr && checkpoint->interval > 0u &&
+          progress.generation % checkpoint->interval == 0u) {
+        save_checkpoint(checkpoint->path, current, best, progress.generation);
+        saved = true;
+      }
+    }
+    if (checkpoint != nullptr && !saved) {
+      save_checkpoint(checkpoint->path, current, best, progress.generation);
+    }
+    progress.seconds = seconds_since(start);
+    if (verbosity > 0) {
+      std::cerr << "solve: " << progress.generation << " generations, best rank "
+                << best.second << ", " << progress.seconds << "s, stopped by "
+                << stop.reason(progress) << std::endl;
+    }
+    if (report != nullptr) {
+      report->reason = stop.reason(progress);
+      report->generations = progress.generation;
+      report->evaluations = progress.evaluations;
+      report->seconds = progress.seconds;
     }
 
     return best.first;
@@ -0,0 +1,97 @@
+/*
+ * This file is part of GeneticAlgorithms toolkit
+ *
+ * Copyright 2017, Francisco Zamora-Martinez
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace GeneticAlgorithms {
+
+  /**
+   * Incremental (delta) rank protocol
+   *
+   * A RankFunctor may implement, besides its usual operator(), a
+   * method which computes the rank of a child from the rank of one of
+   * its parents and the list of gens which differ between them:
+   *
+   * @code
+   * T delta(const C &child, const C &parent, T parent_rank,
+   *         const std::vector<size_t> &changed) const;
+   * @endcode
+   *
+   * Population detects this method at compilation time. Children
+   * added with Population::emplace(num_gens, parents, couple) know
+   * their parents, so evaluate() compares the child with both of them
+   * using word level XOR and popcount, and calls delta() with the
+   * closest one. When both parents differ in more than a fraction of
+   * the gens (see Population::setMaxDeltaFraction()), or when the
+   * method is not available, the usual operator() is used.
+   *
+   * It works with any cross-over and mutation functor, because
+   * changes are computed from the gens and not reported by them.
+   *
+   * @code
+   * // a linear rank: the sum of the values of active gens
+   * struct LinearRank {
+   *   std::vector<float> values;
+   *   float operator()(const Chromosome &x) const {
+   *     float r = 0.0f;
+   *     for (size_t i=0; i<x.size(); ++i) if (x[i]) r += values[i];
+   *     return r;
+   *   }
+   *   float delta(const Chromosome &child, const Chromosome &,
+   *               float parent_rank,
+   *               const std::vector<size_t> &changed) const {
+   *     for (size_t i : changed) {
+   *       parent_rank += child[i] ? values[i] : -values[i];
+   *     }
+   *     return parent_rank;
+   *   }
+   * };
+   * @endcode
+   */
+  template<typename RankFunctor, typename ChromosomeType, typename T>
+  class has_delta_rank {
+    template<typename F>
+    static auto test(int) ->
+      decltype(std::declval<const F&>().delta(std::declval<const ChromosomeType&>(),
+                                              std::declval<const ChromosomeType&>(),
+                                              std::declval<T>(),
+                                              std::declval<const std::vector<size_t>&>()),
+               std::true_type());
+    template<typename F>
+    static std::false_type test(...);
+  public:
+    static const bool value = decltype(test<RankFunctor>(0))::value;
+  }; // class has_delta_rank
+
+} // namespace GeneticAlgorithms
+
+#endif // INCREMENTAL_H
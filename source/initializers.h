@@ -29,10 +29,15 @@
 #define INITIALIZERS_H
 
 #include <boost/dynamic_bitset.hpp>
+#include <cassert>
 #include <limits>
 #include <random>
+#include <stdexcept>
+#include <vector>
 
+#include "bit_kernels.h"
 #include "chromosome.h"
+#include "counter_rng.h"
 
 namespace GeneticAlgorithms {
 
@@ -41,35 +46,151 @@ namespace GeneticAlgorithms {
    *
    * The functor uses the given probability to decide if a gen should
    * be 0 or 1, following a Bernoulli distribution with parameter
-   * p=prob.
+   * p=prob. Gens are generated a word at a time: for p=0.5 every
+   * random word gives 64 gens, other probabilities combine a few
+   * random words (see BitKernels::bernoulli_word()), so p is rounded
+   * to a multiple of 2^-16.
+   *
+   * The class is a template over the type of the produced
+   * chromosomes. RandomInitializer produces Chromosome instances and
+   * FixedRandomInitializer<N> produces FixedChromosome<N> instances.
    *
    * ATTENTION: no thread safe object, it should be created for each
    * thread in your program.
    */
-  class RandomInitializer {
+  template<typename ChromosomeType>
+  class BasicRandomInitializer {
   public:
-    RandomInitializer(size_t N, unsigned seed, float prob) :
+    /// Type of the chromosomes produced by this initializer
+    typedef ChromosomeType chromosome_type;
+
+    BasicRandomInitializer(size_t N, uint64_t seed, float prob) :
       _N(N),
       _rng(seed),
-      _real_dist(0.0f, 1.0f),
-      _prob(prob) {
+      _expansion(BitKernels::bernoulli_expansion(prob)) {
     }
 
-    Chromosome operator()() const {
-      bitset dest(_N);
-      for (size_t i=0; i<_N; ++i) {
-        // sample from the distribution and decide if 0 or 1
-        dest[i] = (_real_dist(_rng) < _prob);
+    ChromosomeType operator()() const {
+      ChromosomeType dest(_N);
+      (*this)(dest);
+      return dest;
+    }
+
+    /**
+     * In-place version, overwrites all the gens of dest
+     *
+     * dest should have the size given to the constructor. It allows
+     * Population::init() to write directly into its memory.
+     */
+    void operator()(ChromosomeType &dest) const {
+      assert(dest.size() == _N);
+      BitKernels::fill_bernoulli(dest.blocks(), _N, _expansion, _rng);
+    }
+
+    /// Restarts the random sequence of this functor with the given seed
+    void seed(uint64_t seed) {
+      _rng.seed(seed);
+    }
+
+    /// Moves to the random stream of (generation, individual), see counter_rng.h
+    void stream(uint64_t generation, uint64_t individual) const {
+      _rng.stream(generation, individual, RandomStream::INITIALIZER);
+    }
+
+  private:
+    const size_t _N;
+    mutable CounterRng _rng;
+    BitKernels::BernoulliExpansion _expansion;
+  }; // class BasicRandomInitializer
+
+  typedef BasicRandomInitializer<Chromosome> RandomInitializer;
+
+  template<size_t N>
+  using FixedRandomInitializer = BasicRandomInitializer<FixedChromosome<N> >;
+
+  /**
+   * This class starts a population from known solutions
+   *
+   * The first calls return the given seed chromosomes, unchanged and
+   * in order. Next calls return, with probability perturbed_fraction,
+   * a copy of a random seed where every gen is flipped with
+   * probability perturb_prob, and otherwise a random chromosome as
+   * BasicRandomInitializer with probability random_prob. Seeds are
+   * usually the best solutions of previous runs, e.g. written with
+   * Encoder, so solve() can continue from them while keeping some
+   * diversity.
+   *
+   * ATTENTION: no thread safe object, it should be created for each
+   * thread in your program.
+   *
+   * @code
+   * std::vector<Chromosome> seeds = load_my_previous_bests();
+   * Chromosome best = solve(1000u, 100u,
+   *                         SeededInitializer(seeds, N, rng(), 0.5f, 0.01f),
+   *                         ...);
+   * @endcode
+   */
+  template<typename ChromosomeType>
+  class BasicSeededInitializer {
+  public:
+    /// Type of the chromosomes produced by this initializer
+    typedef ChromosomeType chromosome_type;
+
+    BasicSeededInitializer(const std::vector<ChromosomeType> &seeds,
+                           size_t N, uint64_t seed,
+                           float perturbed_fraction=0.5f,
+                           float perturb_prob=0.01f,
+                           float random_prob=0.5f) :
+      _seeds(seeds),
+      _N(N),
+      _rng(seed),
+      _next(0u),
+      _perturbed_fraction(perturbed_fraction),
+      _perturbation(BitKernels::bernoulli_expansion(perturb_prob)),
+      _random(BitKernels::bernoulli_expansion(random_prob)) {
+      for (const ChromosomeType &x : _seeds) {
+        if (x.size() != _N) {
+          throw std::invalid_argument("Seed chromosome of a wrong size");
+        }
       }
-      return Chromosome(std::move(dest));
+    }
+
+    ChromosomeType operator()() const {
+      if (_next < _seeds.size()) return _seeds[_next++];
+      ChromosomeType dest(_N);
+      std::uniform_real_distribution<float> real_dist(0.0f, 1.0f);
+      if (!_seeds.empty() && real_dist(_rng) < _perturbed_fraction) {
+        std::uniform_int_distribution<size_t> int_dist(0u, _seeds.size() - 1u);
+        dest = _seeds[int_dist(_rng)];
+        BitKernels::flip_bernoulli(dest.blocks(), _N, _perturbation, _rng);
+      }
+      else {
+        BitKernels::fill_bernoulli(dest.blocks(), _N, _random, _rng);
+      }
+      return dest;
+    }
+
+    /// Restarts the random sequence and the seeds of this functor
+    void seed(uint64_t seed) {
+      _rng.seed(seed);
+      _next = 0u;
     }
 
   private:
-    const unsigned _N;
-    mutable std::mt19937_64 _rng;
-    mutable std::uniform_real_distribution<float> _real_dist;
-    const float _prob;
-  }; // class RandomMutate
+    const std::vector<ChromosomeType> _seeds;
+    const size_t _N;
+    mutable CounterRng _rng;
+    /// Next seed to be returned unchanged
+    mutable size_t _next;
+    const float _perturbed_fraction;
+    BitKernels::BernoulliExpansion _perturbation;
+    BitKernels::BernoulliExpansion _random;
+  }; // class BasicSeededInitializer
+
+  typedef BasicSeededInitializer<Chromosome> SeededInitializer;
+
+  template<size_t N>
+  using FixedSeededInitializer = BasicSeededInitializer<FixedChromosome<N> >;
 
 } // namespace GeneticAlgorithms
 
@@ -0,0 +1,320 @@
+/*
+ * This file is part of GeneticAlgorithms toolkit
+ *
+ * Copyright 2017, Francisco Zamora-Martinez
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef ISLAND_SOLVER_H
+#define ISLAND_SOLVER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "chromosome.h"
+#include "genetic_solver.h"
+#include "lockfree_queue.h"
+#include "population.h"
+#include "seeding.h"
+#include "thread_pool.h"
+
+namespace GeneticAlgorithms {
+
+  /// How islands exchange migrants
+  enum class MigrationTopology {
+    RING,            ///< island k sends to island k+1
+    FULLY_CONNECTED, ///< every island sends to all the others
+    RANDOM           ///< every migration goes to a random island
+  };
+
+  /// Configuration of solve_islands()
+  struct IslandConfig {
+    /// Number of islands, each one runs in its own thread
+    size_t num_islands;
+    /// Number of generations between migrations, 0 means no migration
+    size_t migration_interval;
+    /// Number of best individuals sent at every migration
+    size_t num_migrants;
+    MigrationTopology topology;
+    /// Seed used to derive the seeds of the operators of every island
+    uint64_t seed;
+    /// Capacity of the mailbox of every island, overflowing migrants are dropped
+    size_t mailbox_capacity;
+
+    IslandConfig() :
+      num_islands(4u),
+      migration_interval(10u),
+      num_migrants(1u),
+      topology(MigrationTopology::RING),
+      seed(0u),
+      mailbox_capacity(64u) {
+    }
+  }; // struct IslandConfig
+
+  /// Statistics of one island after solve_islands()
+  template<typename T>
+  struct IslandStats {
+    T best_rank;
+    double mean_rank;
+    size_t generations;
+    size_t migrants_sent;
+    size_t migrants_dropped;
+    size_t migrants_received;
+  }; // struct IslandStats
+
+  /// Result of solve_islands()
+  template<typename ChromosomeType, typename T>
+  struct IslandResult {
+    ChromosomeType best;
+    T best_rank;
+    std::vector<IslandStats<T> > islands;
+  }; // struct IslandResult
+
+  /**
+   * Writes at order the positions of the n best ranks, best first
+   *
+   * order is resized to the number of ranks, and only its first n
+   * positions are sorted.
+   */
+  template<typename T>
+  void best_positions(const std::vector<T> &ranks, const size_t n,
+                      std::vector<size_t> &order) {
+    order.resize(ranks.size());
+    std::iota(order.begin(), order.end(), 0u);
+    std::partial_sort(order.begin(), order.begin() + std::min(n, ranks.size()),
+                      order.end(),
+                      [&](size_t a, size_t b) { return ranks[b] < ranks[a]; });
+  }
+
+  /**
+   * Replaces the worst individuals of a population by the arrivals
+   *
+   * best is updated when an arrival improves it. order is used as
+   * scratch memory. Returns the number of replaced individuals.
+   */
+  template<typename PopulationType>
+  size_t immigrate(PopulationType &population,
+                   const std::vector<typename PopulationType::Hypothesis> &arrivals,
+                   typename PopulationType::Hypothesis &best,
+                   std::vector<size_t> &order) {
+    const std::vector<typename PopulationType::Hypothesis::second_type> &ranks =
+      population.ranks();
+    const size_t n = std::min(arrivals.size(), ranks.size());
+    order.resize(ranks.size());
+    std::iota(order.begin(), order.end(), 0u);
+    std::partial_sort(order.begin(), order.begin() + n, order.end(),
+                      [&](size_t a, size_t b) { return ranks[a] < ranks[b]; });
+    for (size_t j=0; j<n; ++j) {
+      population.replace(order[j], arrivals[j].first, arrivals[j].second);
+      if (best.second < arrivals[j].second) best = arrivals[j];
+    }
+    return n;
+  }
+
+  /// Destination islands of a migration from island k, following topology
+  template<typename RandomEngine>
+  void migration_destinations(const MigrationTopology topology,
+                              const size_t k, const size_t K,
+                              RandomEngine &rng, std::vector<size_t> &dests) {
+    dests.clear();
+    if (K < 2u) return;
+    switch (topology) {
+    case MigrationTopology::RING:
+      dests.push_back((k + 1u) % K);
+      break;
+    case MigrationTopology::RANDOM:
+      dests.push_back((k + 1u + rng() % (K - 1u)) % K);
+      break;
+    case MigrationTopology::FULLY_CONNECTED:
+      for (size_t d=1u; d<K; ++d) dests.push_back((k + d) % K);
+      break;
+    }
+  }
+
+  /**
+   * Genetic algorithm over several islands with periodic migration
+   *
+   * It runs config.num_islands independent populations, each one in
+   * its own thread, following the same generational algorithm than
+   * solve(). Every island works with its own copies of the given
+   * functors, reseeded from config.seed (see seeding.h), so islands
+   * explore different regions of the search space.
+   *
+   * Every config.migration_interval generations, each island sends
+   * copies of its config.num_migrants best individuals to other
+   * islands, following config.topology, and replaces its worst
+   * individuals by the migrants it has received. Migrants travel
+   * through lock-free mailboxes (BoundedQueue): no island ever waits
+   * for another one, a migrant arriving late is used at the next
+   * migration, and a migrant which finds a full mailbox is dropped.
+   *
+   * It returns the best individual of all islands, and statistics of
+   * every island. An exception thrown at any island is rethrown here,
+   * once all islands have finished.
+   *
+   * ATTENTION: functor copies run concurrently, so they should not
+   * share mutable state.
+   *
+   * @code
+   * IslandConfig config;
+   * config.num_islands = 8;
+   * config.seed = rng();
+   * auto result = solve_islands(config, 1000u, 100u,
+   *                             RandomInitializer(N, rng(), 0.5f),
+   *                             TournamentSelection(rng(), 2),
+   *                             RandomSplitCrossOver(N, rng()),
+   *                             RandomMutate(rng(), 0.01f),
+   *                             MyRank());
+   * std::cout << result.best_rank << std::endl;
+   * @endcode
+   */
+  template<typename InitializerFunctor,
+           typename SelectionFunctor,
+           typename CrossOverFunctor,
+           typename MutationFunctor,
+           typename RankFunctor,
+           typename T=float,
+           typename ChromosomeType=typename std::decay<
+             decltype(std::declval<const InitializerFunctor&>()())>::type>
+  IslandResult<ChromosomeType, T>
+  solve_islands(const IslandConfig &config,
+                const size_t num_iterations,
+                const size_t population_size,
+                const InitializerFunctor &init_func,
+                const SelectionFunctor &select_func,
+                const CrossOverFunctor &cross_over_func,
+                const MutationFunctor &mutate_func,
+                const RankFunctor &rank_func) {
+    typedef Population<RankFunctor, T, ChromosomeType> PopulationType;
+    typedef typename PopulationType::Hypothesis Hypothesis;
+    const size_t K = std::max<size_t>(config.num_islands, 1u);
+    std::vector<std::unique_ptr<BoundedQueue<Hypothesis> > > mailboxes;
+    for (size_t k=0; k<K; ++k) {
+      mailboxes.emplace_back(new BoundedQueue<Hypothesis>(config.mailbox_capacity));
+    }
+    std::vector<Hypothesis> bests(K);
+    std::vector<IslandStats<T> > stats(K);
+    std::vector<std::exception_ptr> errors(K);
+    const bool migrates = (K > 1u && config.migration_interval > 0u);
+
+    auto run_island = [&](const size_t k) {
+      // every island has its own operators, with independent seeds
+      InitializerFunctor init(init_func);
+      SelectionFunctor select(select_func);
+      CrossOverFunctor cross_over(cross_over_func);
+      MutationFunctor mutate(mutate_func);
+      reseed(init, derive_seed(config.seed, 4u*k));
+      reseed(select, derive_seed(config.seed, 4u*k + 1u));
+      reseed(cross_over, derive_seed(config.seed, 4u*k + 2u));
+      reseed(mutate, derive_seed(config.seed, 4u*k + 3u));
+      const WorkerOperators<CrossOverFunctor, MutationFunctor>
+        operators(cross_over, mutate);
+      std::mt19937_64 rng(derive_seed(config.seed, 4u*K + k));
+      IslandStats<T> &island_stats = stats[k];
+      island_stats = IslandStats<T>();
+
+      PopulationType current(rank_func);
+      PopulationType next(rank_func);
+      current.init(init, population_size);
+      Hypothesis best = current.top();
+      next.reserve(population_size, best.first.size());
+      std::vector<size_t> order(population_size);
+      std::vector<size_t> dests;
+      std::vector<Hypothesis> arrivals;
+
+      for (size_t i=0; i<num_iterations; ++i) {
+        next_generation(current, next, best, select, operators,
+                        population_size, i);
+        if (!migrates || (i + 1u) % config.migration_interval != 0u) continue;
+        // emigration: copies of the best individuals
+        const std::vector<T> &ranks = current.ranks();
+        const size_t n = std::min(config.num_migrants, ranks.size());
+        best_positions(ranks, n, order);
+        for (size_t j=0; j<n; ++j) {
+          Hypothesis migrant(current.chromosome(order[j]), ranks[order[j]]);
+          migration_destinations(config.topology, k, K, rng, dests);
+          for (size_t dest : dests) {
+            if (mailboxes[dest]->try_push(migrant)) ++island_stats.migrants_sent;
+            else ++island_stats.migrants_dropped;
+          }
+        }
+        // immigration: migrants replace the worst individuals
+        arrivals.clear();
+        Hypothesis migrant;
+        while (arrivals.size() < ranks.size() &&
+               mailboxes[k]->try_pop(migrant)) {
+          arrivals.push_back(std::move(migrant));
+        }
+        island_stats.migrants_received += immigrate(current, arrivals, best, order);
+      }
+
+      const std::vector<T> &ranks = current.ranks();
+      island_stats.best_rank = best.second;
+      island_stats.mean_rank = std::accumulate(ranks.begin(), ranks.end(), 0.0) /
+        std::max<size_t>(ranks.size(), 1u);
+      island_stats.generations = num_iterations;
+      bests[k] = best;
+    };
+    // exceptions are rethrown by the caller, once all islands have finished
+    auto run_island_safe = [&](const size_t k) {
+      try {
+        run_island(k);
+      }
+      catch (...) {
+        errors[k] = std::current_exception();
+      }
+    };
+
+    {
+      // islands already started are joined even if starting another throws
+      ThreadJoiner threads;
+      threads.reserve(K - 1u);
+      for (size_t k=1u; k<K; ++k) threads.start(run_island_safe, k);
+      run_island_safe(0u);
+    }
+    for (const std::exception_ptr &error : errors) {
+      if (error) std::rethrow_exception(error);
+    }
+
+    IslandResult<ChromosomeType, T> result;
+    size_t best_k = 0u;
+    for (size_t k=1u; k<K; ++k) {
+      if (bests[best_k].second < bests[k].second) best_k = k;
+    }
+    result.best = bests[best_k].first;
+    result.best_rank = bests[best_k].second;
+    result.islands = stats;
+    return result;
+  }
+
+} // namespace GeneticAlgorithms
+
+#endif // ISLAND_SOLVER_H
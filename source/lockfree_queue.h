@@ -0,0 +1,145 @@
+/*
+ * This file is part of GeneticAlgorithms toolkit
+ *
+ * Copyright 2017, Francisco Zamora-Martinez
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef LOCKFREE_QUEUE_H
+#define LOCKFREE_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace GeneticAlgorithms {
+
+  /**
+   * A bounded multi-producer multi-consumer lock-free queue
+   *
+   * It implements Dmitry Vyukov's bounded queue: a ring of cells with
+   * a sequence number each, and two atomic positions for producers
+   * and consumers. try_push() and try_pop() never block, they return
+   * false when the queue is full or empty respectively.
+   *
+   * The capacity is rounded up to a power of two. Element type should
+   * be default constructible and move assignable.
+   */
+  template<typename T>
+  class BoundedQueue {
+  public:
+    explicit BoundedQueue(const size_t capacity) {
+      size_t n = 2u;
+      while (n < capacity) n <<= 1u;
+      _mask = n - 1u;
+      _cells.reset(new Cell[n]);
+      for (size_t i=0; i<n; ++i) {
+        _cells[i].sequence.store(i, std::memory_order_relaxed);
+      }
+      _enqueue_pos.store(0u, std::memory_order_relaxed);
+      _dequeue_pos.store(0u, std::memory_order_relaxed);
+    }
+
+    BoundedQueue(const BoundedQueue &) = delete;
+    BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+    size_t capacity() const {
+      return _mask + 1u;
+    }
+
+    /// Pushes x at the end of the queue, returns false when full
+    bool try_push(T x) {
+      Cell *cell;
+      size_t pos = _enqueue_pos.load(std::memory_order_relaxed);
+      for (;;) {
+        cell = &_cells[pos & _mask];
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+          if (_enqueue_pos.compare_exchange_weak(pos, pos + 1u,
+                                                 std::memory_order_relaxed)) {
+            break;
+          }
+        }
+        else if (diff < 0) {
+          return false;
+        }
+        else {
+          pos = _enqueue_pos.load(std::memory_order_relaxed);
+        }
+      }
+      cell->data = std::move(x);
+      cell->sequence.store(pos + 1u, std::memory_order_release);
+      return true;
+    }
+
+    /// Pops the front of the queue into x, returns false when empty
+    bool try_pop(T &x) {
+      Cell *cell;
+      size_t pos = _dequeue_pos.load(std::memory_order_relaxed);
+      for (;;) {
+        cell = &_cells[pos & _mask];
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1u);
+        if (diff == 0) {
+          if (_dequeue_pos.compare_exchange_weak(pos, pos + 1u,
+                                                 std::memory_order_relaxed)) {
+            break;
+          }
+        }
+        else if (diff < 0) {
+          return false;
+        }
+        else {
+          pos = _dequeue_pos.load(std::memory_order_relaxed);
+        }
+      }
+      x = std::move(cell->data);
+      cell->sequence.store(pos + _mask + 1u, std::memory_order_release);
+      return true;
+    }
+
+  private:
+    struct Cell {
+      std::atomic<size_t> sequence;
+      T data;
+    };
+
+    static const size_t CACHE_LINE = 64u;
+
+    std::unique_ptr<Cell[]> _cells;
+    size_t _mask;
+    // producers and consumers positions live in different cache lines,
+    // padding is used because C++11 new doesn't honor extended alignment
+    char _pad0[CACHE_LINE];
+    std::atomic<size_t> _enqueue_pos;
+    char _pad1[CACHE_LINE - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> _dequeue_pos;
+    char _pad2[CACHE_LINE - sizeof(std::atomic<size_t>)];
+  }; // class BoundedQueue
+
+} // namespace GeneticAlgorithms
+
+#endif // LOCKFREE_QUEUE_H
@@ -0,0 +1,196 @@
+/*
+ * This file is part of GeneticAlgorithms toolkit
+ *
+ * Copyright 2017, Francisco Zamora-Martinez
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef LSH_H
+#define LSH_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <unordered_map>
+#include <vector>
+
+#include "chromosome.h"
+#include "counter_rng.h"
+
+namespace GeneticAlgorithms {
+
+  /**
+   * Bit-sampling locality sensitive hashing for Hamming distance
+   *
+   * Every one of num_tables hash tables keys chromosomes by key_bits
+   * gens sampled at random positions. Two chromosomes at Hamming
+   * distance d over N gens get the same key of a table with
+   * probability (1-d/N)^key_bits, so close chromosomes share some
+   * bucket with high probability, and far ones rarely do. It finds
+   * approximate neighbors looking only at a few candidates, instead
+   * of comparing with the whole population.
+   *
+   * Chromosomes are identified by an integer id, usually their
+   * position in the population, and can be inserted and erased as
+   * the population changes.
+   *
+   * ATTENTION: no thread safe object. Only candidates() given a Marks
+   * of every thread can be called by several threads at once, while
+   * no chromosome is inserted or erased.
+   *
+   * @code
+   * const size_t bits = BitSamplingLSH::key_bits_for(N, radius);
+   * BitSamplingLSH lsh(N, 8u, bits, seed);
+   * for (size_t i=0; i<population.size(); ++i) {
+   *   lsh.insert(i, population.chromosome(i).blocks());
+   * }
+   * lsh.candidates(x.blocks(), ids);
+   * @endcode
+   */
+  class BitSamplingLSH {
+  public:
+    /// Marks of the ids already written by candidates(), reused between calls
+    struct Marks {
+      Marks() : current(0u) {}
+      std::vector<uint32_t> stamps;
+      uint32_t current;
+    };
+
+    BitSamplingLSH(const size_t num_gens, const size_t num_tables,
+                   const size_t key_bits, const uint64_t seed) :
+      _key_bits(std::min<size_t>(std::min(key_bits, num_gens), bits_per_block)),
+      _positions(num_tables * _key_bits),
+      _tables(num_tables),
+      _num_ids(0u) {
+      // key_bits different positions for every table, Fisher-Yates
+      CounterRng rng(seed);
+      std::vector<size_t> gens(num_gens);
+      for (size_t t=0; t<num_tables; ++t) {
+        std::iota(gens.begin(), gens.end(), 0u);
+        for (size_t k=0; k<_key_bits; ++k) {
+          std::swap(gens[k], gens[k + rng() % (num_gens - k)]);
+          _positions[t*_key_bits + k] = gens[k];
+        }
+        std::sort(_positions.begin() + t*_key_bits,
+                  _positions.begin() + (t + 1u)*_key_bits);
+      }
+    }
+
+    /**
+     * Number of key bits so that chromosomes at the given radius
+     * share the key of a table with probability 0.5
+     *
+     * With L tables, they share at least one bucket with probability
+     * 1 - 0.5^L, e.g. above 0.99 for L=8.
+     */
+    static size_t key_bits_for(const size_t num_gens, const double radius) {
+      if (num_gens == 0u || !(radius > 0.0)) return bits_per_block;
+      const double q = 1.0 - std::min(radius / num_gens, 0.5);
+      const double bits = std::log(0.5) / std::log(q);
+      return static_cast<size_t>(std::min(std::max(std::round(bits), 1.0),
+                                          double(bits_per_block)));
+    }
+
+    size_t numTables() const {
+      return _tables.size();
+    }
+
+    /// Removes all chromosomes, keeping the sampled positions
+    void clear() {
+      for (auto &table : _tables) table.clear();
+    }
+
+    /// Adds the chromosome with the given gens
+    void insert(const size_t id, const block_type *x) {
+      for (size_t t=0; t<_tables.size(); ++t) _tables[t][key(t, x)].push_back(id);
+      _num_ids = std::max(_num_ids, id + 1u);
+    }
+
+    /// Removes a chromosome, x should be the gens given to insert()
+    void erase(const size_t id, const block_type *x) {
+      for (size_t t=0; t<_tables.size(); ++t) {
+        auto bucket = _tables[t].find(key(t, x));
+        if (bucket == _tables[t].end()) continue;
+        std::vector<size_t> &ids = bucket->second;
+        auto it = std::find(ids.begin(), ids.end(), id);
+        if (it == ids.end()) continue;
+        *it = ids.back();
+        ids.pop_back();
+        if (ids.empty()) _tables[t].erase(bucket);
+      }
+    }
+
+    /// Writes at ids, without repetitions, the ids sharing a bucket with x
+    void candidates(const block_type *x, std::vector<size_t> &ids) const {
+      candidates(x, ids, _marks);
+    }
+
+    /// As candidates(x, ids), but using the given marks, see Marks
+    void candidates(const block_type *x, std::vector<size_t> &ids,
+                    Marks &marks) const {
+      ids.clear();
+      if (marks.stamps.size() < _num_ids) marks.stamps.resize(_num_ids, 0u);
+      if (++marks.current == 0u) {
+        // stamps overflow, every id is unseen again
+        std::fill(marks.stamps.begin(), marks.stamps.end(), 0u);
+        marks.current = 1u;
+      }
+      for (size_t t=0; t<_tables.size(); ++t) {
+        auto bucket = _tables[t].find(key(t, x));
+        if (bucket == _tables[t].end()) continue;
+        for (size_t id : bucket->second) {
+          if (marks.stamps[id] != marks.current) {
+            marks.stamps[id] = marks.current;
+            ids.push_back(id);
+          }
+        }
+      }
+    }
+
+  private:
+    size_t _key_bits;
+    /// Sorted sampled positions, _key_bits for every table
+    std::vector<size_t> _positions;
+    std::vector<std::unordered_map<uint64_t, std::vector<size_t> > > _tables;
+    /// Largest inserted id plus one
+    size_t _num_ids;
+    /// Marks of candidates() when none is given
+    mutable Marks _marks;
+
+    /// Key of x at table t, its sampled gens packed in one word
+    uint64_t key(const size_t t, const block_type *x) const {
+      const size_t *positions = _positions.data() + t*_key_bits;
+      uint64_t k = 0u;
+      for (size_t j=0; j<_key_bits; ++j) {
+        const size_t p = positions[j];
+        k |= ((x[p / bits_per_block] >> (p % bits_per_block)) & 1u) << j;
+      }
+      return k;
+    }
+  }; // class BitSamplingLSH
+
+} // namespace GeneticAlgorithms
+
+#endif // LSH_H
@@ -29,10 +29,13 @@
 #define TRANSFORMS_H
 
 #include <boost/dynamic_bitset.hpp>
+#include <algorithm>
+#include <cmath>
 #include <random>
-#include <unordered_set>
 
+#include "bit_kernels.h"
 #include "chromosome.h"
+#include "counter_rng.h"
 
 namespace GeneticAlgorithms {
 
@@ -49,63 +52,125 @@ namespace GeneticAlgorithms {
    */
   class RandomMutate {
   public:
-    RandomMutate(unsigned seed, float prob) :
+    RandomMutate(uint64_t seed, float prob) :
       _rng(seed),
-      _real_dist(0.0f, 1.0f),
-      _prob(prob) {
+      _prob(prob),
+      _expansion(BitKernels::bernoulli_expansion(prob)),
+      _log_q(std::log1p(-static_cast<double>(std::min(prob, 0.5f)))),
+      // sparse when expected flips per word, each one costing about
+      // three random words, are cheaper than building one mask word,
+      // and always when prob rounds to 0 at mask words
+      _sparse(prob > 0.0f && (_expansion.bits == 0u ||
+                              prob * bits_per_block * 3u < _expansion.depth)),
+      _num_gens(0u),
+      _next(0.0),
+      _next_word(NO_WORD) {
     }
 
     /**
      * Functor which applies random mutations to a given Chromosome
      *
-     * The functor follows two code paths:
+     * The functor follows two code paths, none of them allocates
+     * memory:
      *
-     * - When the probability of mutation is very high, we assume it
-     *   is better to ask every bit if it should be or not mutated.
+     * - When the probability of mutation is low, the distance to the
+     *   next mutated gen is drawn from a geometric distribution, so
+     *   the cost is proportional to the number of mutations.
      *
-     * - Otherwise, we assume it is better to draw the number of
-     *   mutated bits from a binomial distribution, and proceed
-     *   sampling as many bits as necessary from a uniform
-     *   distribution.
+     * - Otherwise, random masks with the mutation probability are
+     *   built a word at a time (see BitKernels::bernoulli_word()) and
+     *   XORed with the gens, so the probability is rounded to a
+     *   multiple of 2^-16. Probabilities below 2^-17, which would
+     *   round to 0, always follow the first code path.
      */
-    Chromosome operator()(const Chromosome &source) const {
-      bitset dest(source.gens());
-      
-      if (_prob > 0.2f) {
-        // high mutation probability, traverse all bits
-        for (size_t i=0; i<source.size(); ++i) {
-          if (_real_dist(_rng) < _prob) dest.flip(i);
+    template<typename ChromosomeType>
+    ChromosomeType operator()(const ChromosomeType &source) const {
+      ChromosomeType dest(source);
+      (*this)(dest, dest);
+      return dest;
+    }
+
+    /// In-place version, source and dest can be the same object
+    template<typename ChromosomeType>
+    void operator()(const ChromosomeType &source, ChromosomeType &dest) const {
+      if (&source != &dest) dest = source;
+      if (!(_prob > 0.0f)) return;
+      const size_t N = dest.size();
+      if (_sparse) {
+        // positions are kept as double, which avoids overflow of huge gaps
+        for (double pos = gap(); pos < N; pos += 1.0 + gap()) {
+          dest.flip(static_cast<size_t>(pos));
         }
       }
-      else { // _prob <= 0.2f
-        // low mutation probability, draw from a binomial
-        
-        // This set avoids possible repeated mutation candidates
-        std::unordered_set<size_t> positions;
-        // Sample the number of bits to mutate from this distribution
-        std::binomial_distribution<size_t> bdist(source.size(), _prob);
-        size_t n_gens_to_mutate = bdist(_rng);
-        if (n_gens_to_mutate > 0uL) {
-          // Sample which bit should be mutated from next distribution
-          std::uniform_int_distribution<size_t> dist(0uL, source.size() - 1);
-          size_t n_mutations = 0uL;
-          while(n_mutations < n_gens_to_mutate) {
-            size_t pos = dist(_rng);
-            if (positions.find(pos) == positions.end()) {
-              dest.flip(pos);
-              positions.insert(pos);
-              ++n_mutations;
-            }
-          }
-        }
+      else {
+        BitKernels::flip_bernoulli(dest.blocks(), N, _expansion, _rng);
+      }
+    }
+
+    /// Word protocol (see breeding.h), draws the first sparse mutation
+    void beginFlips(const size_t num_gens) const {
+      _num_gens = num_gens;
+      if (!(_prob > 0.0f)) _next_word = NO_WORD;
+      else if (!_sparse) _next_word = 0u;
+      else {
+        _next = gap();
+        updateNextWord();
+      }
+    }
+
+    /// Word protocol, the gens of word w flipped by both code paths
+    block_type flipWord(const size_t w) const {
+      // words without sparse mutations cost one comparison
+      if (w < _next_word) return 0u;
+      if (!_sparse) return BitKernels::bernoulli_word(_expansion, _rng);
+      const size_t begin = w * bits_per_block;
+      const double end = static_cast<double>(std::min(begin + bits_per_block,
+                                                      _num_gens));
+      block_type m = 0u;
+      for (; _next < end; _next += 1.0 + gap()) {
+        m |= block_type(1u) << (static_cast<size_t>(_next) - begin);
       }
-      return Chromosome(std::move(dest));
+      updateNextWord();
+      return m;
+    }
+
+    /// Restarts the random sequence of this functor with the given seed
+    void seed(uint64_t seed) {
+      _rng.seed(seed);
+    }
+
+    /// Moves to the random stream of (generation, individual), see counter_rng.h
+    void stream(uint64_t generation, uint64_t individual) const {
+      _rng.stream(generation, individual, RandomStream::MUTATION);
     }
 
   private:
-    mutable std::mt19937_64 _rng;
-    mutable std::uniform_real_distribution<float> _real_dist;
+    mutable CounterRng _rng;
     float _prob;
+    BitKernels::BernoulliExpansion _expansion;
+    /// log(1 - prob), parameter of the geometric distribution
+    double _log_q;
+    bool _sparse;
+    /// State of the word protocol between beginFlips() and flipWord()
+    mutable size_t _num_gens;
+    mutable double _next;
+    mutable size_t _next_word;
+
+    /// Marks that no more words are mutated
+    static const size_t NO_WORD = ~size_t(0u);
+
+    /// Word of the next sparse mutation at _next
+    void updateNextWord() const {
+      _next_word = (_next < _num_gens) ?
+        static_cast<size_t>(_next) / bits_per_block : NO_WORD;
+    }
+
+    /// Number of gens until the next mutation, geometric distribution
+    double gap() const {
+      // uniform in (0,1], so the logarithm is finite
+      const double u = ((_rng() >> 11u) + 1u) * (1.0 / 9007199254740992.0);
+      return std::floor(std::log(u) / _log_q);
+    }
   }; // class RandomMutate
   
 } // namespace GeneticAlgorithms
@@ -0,0 +1,320 @@
+/*
+ * This file is part of GeneticAlgorithms toolkit
+ *
+ * Copyright 2017, Francisco Zamora-Martinez
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef NICHING_H
+#define NICHING_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "bit_kernels.h"
+#include "chromosome.h"
+#include "lsh.h"
+#include "seeding.h"
+#include "selections.h"
+#include "thread_pool.h"
+
+namespace GeneticAlgorithms {
+
+  /// Sharing function: 1 at distance 0, down to 0 at radius
+  inline double sharing(const double distance, const double radius,
+                        const double alpha) {
+    if (!(distance < radius)) return 0.0;
+    return 1.0 - std::pow(distance / radius, alpha);
+  }
+
+  /// Rows of niche_counts() computed by each task of the ThreadPool
+  static const size_t NICHE_ROWS_GRAIN = 16u;
+
+  /// Scratch memory of niche_counts() for every worker, reused between calls
+  struct NicheScratch {
+    std::vector<uint32_t> distances;
+    std::vector<size_t> ids;
+    BitSamplingLSH::Marks marks;
+  }; // struct NicheScratch
+
+  /// Runs func(worker, begin, end) over the rows, at the pool if any
+  template<typename F>
+  void for_niche_rows(ThreadPool *pool, const size_t n,
+                      std::vector<NicheScratch> &scratch, const F &func) {
+    scratch.resize((pool != nullptr) ? pool->size() : 1u);
+    if (pool != nullptr) pool->parallel_for(n, NICHE_ROWS_GRAIN, func);
+    else func(0u, 0u, n);
+  }
+
+  /**
+   * Niche count of every chromosome, comparing all the pairs
+   *
+   * counts[i] is the sum of sharing() between chromosome i and all
+   * the population, itself included, so it is at least 1. Distances
+   * of every chromosome to all rows of the arena are computed by
+   * BitKernels::hamming_rows(), in O(n^2*N/64) word operations.
+   * Rows are split over population.pool(), and every count is summed
+   * by one worker in the same order, so counts don't depend on the
+   * number of workers.
+   */
+  template<typename PopulationType>
+  void niche_counts(const PopulationType &population, const double radius,
+                    const double alpha, std::vector<double> &counts,
+                    std::vector<NicheScratch> &scratch) {
+    const size_t n = population.size();
+    counts.assign(n, 1.0);
+    if (n < 2u) return;
+    const block_type *rows = population.arena().data();
+    const size_t stride = population.arena().stride();
+    const size_t num_blocks = population.chromosome(0u).num_blocks();
+    for_niche_rows(population.pool(), n, scratch,
+                   [&](size_t worker, size_t begin, size_t end) {
+                     std::vector<uint32_t> &distances = scratch[worker].distances;
+                     distances.resize(n);
+                     for (size_t i=begin; i<end; ++i) {
+                       BitKernels::hamming_rows(rows + i*stride, rows, stride, n,
+                                                num_blocks, distances.data());
+                       for (size_t j=0; j<n; ++j) {
+                         if (j != i) counts[i] += sharing(distances[j], radius, alpha);
+                       }
+                     }
+                   });
+  }
+
+  /**
+   * Approximate niche counts, comparing only candidates of lsh
+   *
+   * The population is indexed at lsh, which is cleared first, and
+   * every chromosome is compared only with the ones sharing some
+   * bucket with it. Neighbors inside the radius are found with the
+   * probability given by the parameters of lsh (see
+   * BitSamplingLSH::key_bits_for()). Indexing is serial, and the
+   * candidates of every row are compared in parallel over
+   * population.pool().
+   */
+  template<typename PopulationType>
+  void niche_counts(const PopulationType &population, const double radius,
+                    const double alpha, BitSamplingLSH &lsh,
+                    std::vector<double> &counts, std::vector<NicheScratch> &scratch) {
+    const size_t n = population.size();
+    counts.assign(n, 1.0);
+    lsh.clear();
+    for (size_t i=0; i<n; ++i) lsh.insert(i, population.chromosome(i).blocks());
+    const BitSamplingLSH &index = lsh;
+    for_niche_rows(population.pool(), n, scratch,
+                   [&](size_t worker, size_t begin, size_t end) {
+                     std::vector<size_t> &ids = scratch[worker].ids;
+                     for (size_t i=begin; i<end; ++i) {
+                       const auto &x = population.chromosome(i);
+                       index.candidates(x.blocks(), ids, scratch[worker].marks);
+                       for (size_t j : ids) {
+                         if (j == i) continue;
+                         counts[i] += sharing(BitKernels::hamming(x.blocks(),
+                                                                  population.chromosome(j).blocks(),
+                                                                  x.num_blocks()),
+                                              radius, alpha);
+                       }
+                     }
+                   });
+  }
+
+  /// Result of nearest_neighbor() for an empty population
+  static const size_t NO_NEIGHBOR = ~size_t(0u);
+
+  /**
+   * Position of the closest row of the arena to x
+   *
+   * When lsh is given and it returns some candidate, only candidates
+   * are compared, otherwise all rows. distances and ids are scratch
+   * memory. Ties are won by the first position.
+   */
+  template<typename PopulationType, typename ChromosomeType>
+  size_t nearest_neighbor(const PopulationType &population,
+                          const ChromosomeType &x, const BitSamplingLSH *lsh,
+                          std::vector<uint32_t> &distances,
+                          std::vector<size_t> &ids) {
+    size_t best = NO_NEIGHBOR;
+    size_t best_distance = std::numeric_limits<size_t>::max();
+    if (lsh != nullptr) {
+      lsh->candidates(x.blocks(), ids);
+      for (size_t j : ids) {
+        const size_t d = BitKernels::hamming(x.blocks(),
+                                             population.chromosome(j).blocks(),
+                                             x.num_blocks());
+        if (d < best_distance || (d == best_distance && j < best)) {
+          best = j;
+          best_distance = d;
+        }
+      }
+      if (best != NO_NEIGHBOR) return best;
+    }
+    const size_t n = population.size();
+    distances.resize(n);
+    BitKernels::hamming_rows(x.blocks(), population.arena().data(),
+                             population.arena().stride(), n, x.num_blocks(),
+                             distances.data());
+    for (size_t j=0; j<n; ++j) {
+      if (distances[j] < best_distance) {
+        best = j;
+        best_distance = distances[j];
+      }
+    }
+    return best;
+  }
+
+  /**
+   * Selection with fitness sharing, a wrapper of any SelectionFunctor
+   *
+   * The rank of every chromosome is divided by its niche count (see
+   * niche_counts()), so chromosomes in crowded regions of the search
+   * space are less likely selected, and the population keeps several
+   * niches instead of converging to one. Ranks should be positive.
+   * The shared ranks are given to the wrapped SelectionFunctor, with
+   * the ThreadPool of the population when it accepts one, and
+   * best tracking and elitism of the solvers still use raw ranks.
+   *
+   * radius is measured in gens. Populations smaller than
+   * lsh_threshold compare all pairs of chromosomes, larger ones only
+   * the candidates of a BitSamplingLSH with lsh_tables tables, which
+   * samples its key gens from lsh_seed. Niche counts are computed
+   * over the ThreadPool of the population, if any.
+   *
+   * It declares uses_population=true, so Population::select() gives
+   * it the whole population instead of only the ranks, and it can be
+   * given to solve() as any other SelectionFunctor. Instead of
+   * instantiated directly this class, use the helper function
+   * make_fitness_sharing.
+   *
+   * ATTENTION: no thread safe object, it should be created for each
+   * thread in your program.
+   *
+   * @code
+   * Chromosome best = solve(1000u, 1000u, init,
+   *                         make_fitness_sharing(0.1*N, 1.0,
+   *                                              TournamentSelection(rng(), 2)),
+   *                         cross_over, mutate, MyRank());
+   * @endcode
+   */
+  template<typename SelectionFunctor>
+  class FitnessSharing {
+  public:
+    static const bool uses_population = true;
+
+    /// Default population size from which neighbors are found by LSH
+    static const size_t DEFAULT_LSH_THRESHOLD = 2048u;
+
+    /// Default number of tables of the BitSamplingLSH
+    static const size_t DEFAULT_LSH_TABLES = 8u;
+
+    FitnessSharing(const double radius, const double alpha,
+                   const SelectionFunctor &select,
+                   const size_t lsh_threshold=DEFAULT_LSH_THRESHOLD,
+                   const size_t lsh_tables=DEFAULT_LSH_TABLES,
+                   const uint64_t lsh_seed=0u) :
+      _radius(radius),
+      _alpha(alpha),
+      _select(select),
+      _lsh_threshold(lsh_threshold),
+      _lsh_tables(lsh_tables),
+      _lsh_seed(lsh_seed),
+      _lsh_gens(0u) {
+    }
+
+    template<typename PopulationType>
+    std::vector<IndexCouple>
+    operator()(const PopulationType &population, size_t result_size) const {
+      const size_t n = population.size();
+      if (n >= _lsh_threshold) {
+        const size_t num_gens = population.chromosome(0u).size();
+        if (_lsh.empty() || _lsh_gens != num_gens) {
+          // built on first use, reused by next generations
+          _lsh.assign(1u, BitSamplingLSH(num_gens, _lsh_tables,
+                                         BitSamplingLSH::key_bits_for(num_gens, _radius),
+                                         _lsh_seed));
+          _lsh_gens = num_gens;
+        }
+        niche_counts(population, _radius, _alpha, _lsh.front(), _counts, _scratch);
+      }
+      else {
+        niche_counts(population, _radius, _alpha, _counts, _scratch);
+      }
+      _shared.resize(n);
+      for (size_t i=0; i<n; ++i) _shared[i] = population.rank(i) / _counts[i];
+      return select_couples(_select, _shared, result_size, population.pool());
+    }
+
+    /// Restarts the random sequence of the wrapped functor with the given seed
+    void seed(uint64_t seed) {
+      reseed(_select, seed);
+    }
+
+    /// Moves to the random stream of (generation, individual), see counter_rng.h
+    void stream(uint64_t generation, uint64_t individual) const {
+      restream(_select, generation, individual);
+    }
+
+  private:
+    double _radius;
+    double _alpha;
+    SelectionFunctor _select;
+    size_t _lsh_threshold;
+    size_t _lsh_tables;
+    uint64_t _lsh_seed;
+    /// Scratch memory, reused between calls
+    mutable std::vector<BitSamplingLSH> _lsh;
+    mutable size_t _lsh_gens;
+    mutable std::vector<double> _counts;
+    mutable std::vector<double> _shared;
+    mutable std::vector<NicheScratch> _scratch;
+  }; // class FitnessSharing
+
+  template<typename SelectionFunctor>
+  const bool FitnessSharing<SelectionFunctor>::uses_population;
+
+  template<typename SelectionFunctor>
+  const size_t FitnessSharing<SelectionFunctor>::DEFAULT_LSH_THRESHOLD;
+
+  template<typename SelectionFunctor>
+  const size_t FitnessSharing<SelectionFunctor>::DEFAULT_LSH_TABLES;
+
+  /// Helper for construction of FitnessSharing instances
+  template<typename SelectionFunctor>
+  FitnessSharing<SelectionFunctor>
+  make_fitness_sharing(const double radius, const double alpha,
+                       const SelectionFunctor &select,
+                       const size_t lsh_threshold=
+                       FitnessSharing<SelectionFunctor>::DEFAULT_LSH_THRESHOLD,
+                       const size_t lsh_tables=
+                       FitnessSharing<SelectionFunctor>::DEFAULT_LSH_TABLES,
+                       const uint64_t lsh_seed=0u) {
+    return FitnessSharing<SelectionFunctor>(radius, alpha, select, lsh_threshold,
+                                            lsh_tables, lsh_seed);
+  }
+
+} // namespace GeneticAlgorithms
+
+#endif // NICHING_H
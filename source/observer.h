@@ -0,0 +1,246 @@
+/*
+ * This file is part of GeneticAlgorithms toolkit
+ *
+ * Copyright 2017, Francisco Zamora-Martinez
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef OBSERVER_H
+#define OBSERVER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <ostream>
+#include <vector>
+
+namespace GeneticAlgorithms {
+
+  /// Statistics of one generation, as received by solve() observers
+  struct GenerationRecord {
+    uint64_t generation;
+    double best_rank;
+    double mean_rank;
+    double worst_rank;
+    /// Mean pairwise Hamming distance per gen, see diversity.h
+    double diversity;
+    /// Wall time of selection, breeding and ranking, in seconds
+    double select_seconds;
+    double breed_seconds;
+    double rank_seconds;
+    /// Time spent by cross-over and mutation functors, summed over workers
+    double cross_over_seconds;
+    double mutate_seconds;
+    /// Wall and process CPU time of the whole generation
+    double wall_seconds;
+    double cpu_seconds;
+    /**
+     * Process CPU time of selection, breeding and ranking, over all the
+     * threads. Cross-over and mutation share breed_cpu_seconds: there
+     * is no CPU time of each operator, because a per thread CPU clock
+     * read per child costs more than most operators.
+     */
+    double select_cpu_seconds;
+    double breed_cpu_seconds;
+    double rank_cpu_seconds;
+  }; // struct GenerationRecord
+
+  /// Seconds since start, from a steady clock
+  inline double seconds_since(const std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start).count();
+  }
+
+  /// Process CPU seconds since start, as measured by std::clock()
+  inline double cpu_seconds_since(const std::clock_t start) {
+    return double(std::clock() - start) / CLOCKS_PER_SEC;
+  }
+
+  /// Times of the phases of next_generation(), in seconds
+  struct PhaseTimes {
+    double select;
+    double breed;
+    double rank;
+    double select_cpu;
+    double breed_cpu;
+    double rank_cpu;
+    /// Summed over the workers, see BreedTimes at breeding.h
+    double cross_over;
+    double mutate;
+  }; // struct PhaseTimes
+
+  /// Wall and process CPU clocks of a phase, started by restart()
+  struct PhaseTimer {
+    std::chrono::steady_clock::time_point wall_start;
+    std::clock_t cpu_start;
+
+    void restart() {
+      wall_start = std::chrono::steady_clock::now();
+      cpu_start = std::clock();
+    }
+
+    /// Writes the times since restart() and restarts for the next phase
+    void lap(double &wall, double &cpu) {
+      wall = seconds_since(wall_start);
+      cpu = cpu_seconds_since(cpu_start);
+      restart();
+    }
+  }; // struct PhaseTimer
+
+  /**
+   * Observer which does nothing, the default of solve()
+   *
+   * Observers declare a static constant enabled. When it is false,
+   * solve() doesn't compute statistics nor measure times, so the
+   * observer costs nothing. Otherwise, operator() receives a
+   * GenerationRecord after every generation.
+   */
+  struct NullObserver {
+    static const bool enabled = false;
+
+    void operator()(const GenerationRecord &) {
+    }
+  }; // struct NullObserver
+
+  /**
+   * Observer keeping the last records in a preallocated ring buffer
+   *
+   * It never allocates memory after construction: when it is full,
+   * every new record replaces the oldest one. Records are indexed
+   * from the oldest, at 0, to the newest, at size()-1.
+   *
+   * @code
+   * GenerationLog log(1000u);
+   * solve(..., &log);
+   * write_csv(std::cout, log);
+   * @endcode
+   */
+  class GenerationLog {
+  public:
+    static const bool enabled = true;
+
+    explicit GenerationLog(const size_t capacity) :
+      _records(std::max<size_t>(capacity, 1u)),
+      _first(0u),
+      _size(0u) {
+    }
+
+    void operator()(const GenerationRecord &record) {
+      if (_size < _records.size()) {
+        _records[(_first + _size++) % _records.size()] = record;
+      }
+      else {
+        _records[_first] = record;
+        _first = (_first + 1u) % _records.size();
+      }
+    }
+
+    size_t size() const {
+      return _size;
+    }
+
+    size_t capacity() const {
+      return _records.size();
+    }
+
+    const GenerationRecord &operator[](const size_t i) const {
+      return _records[(_first + i) % _records.size()];
+    }
+
+    /// Removes all records, keeping the memory
+    void clear() {
+      _first = _size = 0u;
+    }
+
+  private:
+    std::vector<GenerationRecord> _records;
+    size_t _first, _size;
+  }; // class GenerationLog
+
+  /// Number of GenerationRecord fields, besides generation
+  static const size_t GENERATION_RECORD_VALUES = 14u;
+
+  /// Names of GenerationRecord fields, in the order of the exporters
+  static const char *const GENERATION_RECORD_FIELDS[GENERATION_RECORD_VALUES + 1u] = {
+    "generation", "best_rank", "mean_rank", "worst_rank", "diversity",
+    "select_seconds", "breed_seconds", "rank_seconds",
+    "cross_over_seconds", "mutate_seconds", "wall_seconds", "cpu_seconds",
+    "select_cpu_seconds", "breed_cpu_seconds", "rank_cpu_seconds"
+  };
+
+  /// Values of GenerationRecord fields, except generation
+  inline void generation_record_values(const GenerationRecord &r,
+                                       double values[GENERATION_RECORD_VALUES]) {
+    values[0] = r.best_rank;
+    values[1] = r.mean_rank;
+    values[2] = r.worst_rank;
+    values[3] = r.diversity;
+    values[4] = r.select_seconds;
+    values[5] = r.breed_seconds;
+    values[6] = r.rank_seconds;
+    values[7] = r.cross_over_seconds;
+    values[8] = r.mutate_seconds;
+    values[9] = r.wall_seconds;
+    values[10] = r.cpu_seconds;
+    values[11] = r.select_cpu_seconds;
+    values[12] = r.breed_cpu_seconds;
+    values[13] = r.rank_cpu_seconds;
+  }
+
+  /// Writes the records of log as CSV, with a header line
+  inline void write_csv(std::ostream &out, const GenerationLog &log) {
+    for (size_t j=0; j<=GENERATION_RECORD_VALUES; ++j) {
+      out << (j > 0u ? "," : "") << GENERATION_RECORD_FIELDS[j];
+    }
+    out << "\n";
+    double values[GENERATION_RECORD_VALUES];
+    for (size_t i=0; i<log.size(); ++i) {
+      generation_record_values(log[i], values);
+      out << log[i].generation;
+      for (double v : values) out << "," << v;
+      out << "\n";
+    }
+  }
+
+  /// Writes the records of log as JSON lines, one object per record
+  inline void write_jsonl(std::ostream &out, const GenerationLog &log) {
+    double values[GENERATION_RECORD_VALUES];
+    for (size_t i=0; i<log.size(); ++i) {
+      generation_record_values(log[i], values);
+      out << "{\"" << GENERATION_RECORD_FIELDS[0] << "\":" << log[i].generation;
+      for (size_t j=0; j<GENERATION_RECORD_VALUES; ++j) {
+        out << ",\"" << GENERATION_RECORD_FIELDS[j + 1u] << "\":";
+        // JSON has no representation for infinities nor NaN
+        if (std::isfinite(values[j])) out << values[j];
+        else out << "null";
+      }
+      out << "}\n";
+    }
+  }
+
+} // namespace GeneticAlgorithms
+
+#endif // OBSERVER_H
@@ -0,0 +1,442 @@
+/*
+ * This file is part of GeneticAlgorithms toolkit
+ *
+ * Copyright 2017, Francisco Zamora-Martinez
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef PIPELINE_SOLVER_H
+#define PIPELINE_SOLVER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "batch_rank.h"
+#include "breeding.h"
+#include "chromosome.h"
+#include "lockfree_queue.h"
+#include "observer.h"
+#include "population.h"
+#include "seeding.h"
+#include "thread_pool.h"
+
+namespace GeneticAlgorithms {
+
+  /// Configuration of solve_pipeline()
+  struct PipelineConfig {
+    /// Number of threads breeding children
+    size_t breed_threads;
+    /// Number of threads ranking children
+    size_t rank_threads;
+    /// Number of children passed at once from breeding to ranking
+    size_t batch_size;
+    /// Capacity, in batches, of the queue between both stages
+    size_t queue_capacity;
+
+    PipelineConfig() :
+      breed_threads(1u),
+      rank_threads(1u),
+      batch_size(64u),
+      queue_capacity(64u) {
+    }
+  }; // struct PipelineConfig
+
+  /**
+   * Statistics of solve_pipeline()
+   *
+   * Utilization is the busy time of a stage divided by its number of
+   * threads and the wall time of all generations. A stage close to 1
+   * is the bottleneck, and it should receive threads of the other
+   * one. Waits count how many times a breeding thread found the queue
+   * full, or a ranking thread found it empty.
+   */
+  struct PipelineStats {
+    size_t generations;
+    double wall_seconds;
+    /// Time of selection and bookkeeping between generations
+    double select_seconds;
+    double breed_utilization;
+    double rank_utilization;
+    uint64_t full_queue_waits;
+    uint64_t empty_queue_waits;
+  }; // struct PipelineStats
+
+  /// Result of solve_pipeline()
+  template<typename ChromosomeType, typename T>
+  struct PipelineResult {
+    ChromosomeType best;
+    T best_rank;
+    PipelineStats stats;
+  }; // struct PipelineResult
+
+  /// Number of retries of a full or empty queue before sleeping
+  static const size_t PIPELINE_SPINS = 64u;
+
+  /**
+   * Puts to sleep the stage threads waiting for the queue
+   *
+   * A thread which finds the queue full or empty calls retry(), which
+   * spins PIPELINE_SPINS times and then blocks at a condition variable
+   * until notify() is called, after every push or pop. notify() costs
+   * a fence and an atomic load while no thread sleeps.
+   */
+  class PipelineSignal {
+  public:
+    PipelineSignal() : _sleepers(0u), _epoch(0u) {}
+
+    /// Calls op until it returns true, op is called with a lock held
+    template<typename Operation>
+    void retry(const Operation &op) {
+      for (size_t i=0; i<PIPELINE_SPINS; ++i) {
+        if (op()) return;
+      }
+      std::unique_lock<std::mutex> lock(_mutex);
+      _sleepers.fetch_add(1u);
+      // pairs with the fence at notify(): either op() sees the change,
+      // or notify() sees this sleeper
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      for (;;) {
+        const uint64_t seen = _epoch;
+        if (op()) break;
+        _cv.wait(lock, [&]{ return _epoch != seen; });
+      }
+      _sleepers.fetch_sub(1u);
+    }
+
+    /// Wakes up the sleeping threads, to call again their op
+    void notify() {
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (_sleepers.load(std::memory_order_relaxed) > 0u) {
+        {
+          std::lock_guard<std::mutex> lock(_mutex);
+          ++_epoch;
+        }
+        _cv.notify_all();
+      }
+    }
+
+  private:
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    std::atomic<size_t> _sleepers;
+    /// Number of notifications with sleepers, protected by _mutex
+    uint64_t _epoch;
+  }; // class PipelineSignal
+
+  /// Ranks rows [first,last) of population one by one
+  template<typename PopulationType, typename RankFunctor, typename T>
+  void rank_rows(PopulationType &population, const RankFunctor &rank_func,
+                 const size_t first, const size_t last, std::vector<T> &,
+                 std::false_type) {
+    for (size_t i=first; i<last; ++i) {
+      population.setRank(i, rank_func(population.chromosome(i)));
+    }
+  }
+
+  /// Ranks rows [first,last) of population with the batch protocol
+  template<typename PopulationType, typename RankFunctor, typename T>
+  void rank_rows(PopulationType &population, const RankFunctor &rank_func,
+                 const size_t first, const size_t last, std::vector<T> &ranks,
+                 std::true_type) {
+    const size_t stride = population.arena().stride();
+    const GeneMatrix genes = {
+      population.arena().data() + first*stride, stride, last - first,
+      population.chromosome(first).size()
+    };
+    ranks.resize(last - first);
+    rank_func(genes, ranks.data());
+    for (size_t i=first; i<last; ++i) population.setRank(i, ranks[i - first]);
+  }
+
+  /**
+   * A genetic algorithm where breeding and ranking run as a pipeline
+   *
+   * The generations are the same as at solve(): selection, breeding
+   * of population_size-1 children and elitism. But the children of
+   * every generation are produced in batches by config.breed_threads
+   * threads, and every batch is pushed into a BoundedQueue as soon as
+   * it is bred. config.rank_threads threads pop batches and rank them,
+   * so children are ranked while later ones are still being bred.
+   * When the last rank lands, the selection of the next generation
+   * starts.
+   *
+   * Every thread uses its own copy of the functors. Children are bred
+   * in the random streams of (generation, child), so functors should
+   * implement stream() (see counter_rng.h), and then the result is
+   * the same than solve() with the same functors, for any number of
+   * threads. RankFunctor can implement the batch protocol described
+   * at batch_rank.h, and it receives whole batches. The incremental
+   * protocol (see incremental.h) is not used.
+   *
+   * The initial population is ranked by the same rank stage. Threads
+   * waiting for the queue between both stages spin a while and then
+   * sleep (see PipelineSignal). An exception thrown by any stage
+   * stops all of them, and it is rethrown once they are joined.
+   *
+   * The stats of the result tell how busy both stages were, so the
+   * number of threads of each one can be balanced.
+   *
+   * @code
+   * PipelineConfig config;
+   * config.breed_threads = 2u;
+   * config.rank_threads = 6u;
+   * auto result = solve_pipeline(config, 1000u, 1000u, init, select,
+   *                              cross_over, mutate, MyRank());
+   * std::cout << result.stats.breed_utilization << " "
+   *           << result.stats.rank_utilization << std::endl;
+   * @endcode
+   */
+  template<typename InitializerFunctor,
+           typename SelectionFunctor,
+           typename CrossOverFunctor,
+           typename MutationFunctor,
+           typename RankFunctor,
+           typename T=float,
+           typename ChromosomeType=typename std::decay<
+             decltype(std::declval<const InitializerFunctor&>()())>::type>
+  PipelineResult<ChromosomeType, T>
+  solve_pipeline(const PipelineConfig &config,
+                 const size_t num_iterations,
+                 const size_t population_size,
+                 const InitializerFunctor &init_func,
+                 const SelectionFunctor &select_func,
+                 const CrossOverFunctor &cross_over_func,
+                 const MutationFunctor &mutate_func,
+                 const RankFunctor &rank_func) {
+    static_assert(has_stream<CrossOverFunctor>::value &&
+                  has_stream<MutationFunctor>::value,
+                  "solve_pipeline requires operators with random streams");
+    typedef Population<RankFunctor, T, ChromosomeType> PopulationType;
+    typedef typename PopulationType::Hypothesis Hypothesis;
+    typedef std::chrono::steady_clock clock;
+    const size_t num_breeders = std::max<size_t>(config.breed_threads, 1u);
+    const size_t num_rankers = std::max<size_t>(config.rank_threads, 1u);
+    const size_t batch_size = std::max<size_t>(config.batch_size, 1u);
+
+    // the initial population is ranked by the threads of the rank stage
+    PopulationType current(rank_func, nullptr);
+    PopulationType next(rank_func, nullptr);
+    current.initUnranked(init_func, population_size);
+
+    BoundedQueue<size_t> queue(config.queue_capacity);
+    PipelineSignal queue_signal;
+    std::vector<IndexCouple> couples;
+    size_t generation = 0u;
+    // every round breeds (or not, for the initial population) and
+    // ranks num_rows rows of ranked, in num_batches batches
+    bool breeding = false;
+    PopulationType *ranked = &current;
+    size_t num_rows = current.size();
+    size_t num_batches = 0u;
+    std::atomic<size_t> next_batch(0u);
+    std::atomic<size_t> ranked_batches(0u);
+    std::atomic<uint64_t> full_waits(0u), empty_waits(0u);
+    std::atomic<uint64_t> breed_ns(0u), rank_ns(0u);
+    // the first exception thrown, rethrown once all threads are joined
+    std::atomic<bool> failed(false);
+    std::exception_ptr error;
+
+    // stage threads wait for a new round id, and report when done
+    std::mutex mutex;
+    std::condition_variable start_cv, done_cv;
+    size_t round_id = 0u;
+    size_t threads_done = 0u;
+    bool quit = false;
+    auto stage_loop = [&](const std::function<void()> &work) {
+      size_t last_id = 0u;
+      for (;;) {
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          start_cv.wait(lock, [&]{ return quit || round_id != last_id; });
+          if (quit) return;
+          last_id = round_id;
+        }
+        try {
+          work();
+        }
+        catch (...) {
+          {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!error) error = std::current_exception();
+          }
+          failed = true;
+          // the threads waiting for the queue give up
+          queue_signal.notify();
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        if (++threads_done == num_breeders + num_rankers) done_cv.notify_one();
+      }
+    };
+    auto nanoseconds_since = [](const clock::time_point &start) {
+      return static_cast<uint64_t>(std::chrono::duration_cast<
+                                   std::chrono::nanoseconds>(clock::now() - start).count());
+    };
+
+    // every thread uses its own copy of the functors
+    std::vector<CrossOverFunctor> cross_overs(num_breeders, cross_over_func);
+    std::vector<MutationFunctor> mutates(num_breeders, mutate_func);
+    std::vector<RankFunctor> rank_funcs(num_rankers, rank_func);
+    std::vector<std::vector<T> > rank_buffers(num_rankers);
+    // the stage threads quit and are joined however this function ends
+    ThreadJoiner threads([&]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+        start_cv.notify_all();
+      });
+    threads.reserve(num_breeders + num_rankers);
+    for (size_t t=0; t<num_breeders; ++t) {
+      threads.start(stage_loop, std::function<void()>([&, t]() {
+          const CrossOverFunctor &cross_over = cross_overs[t];
+          const MutationFunctor &mutate = mutates[t];
+          for (size_t b; !failed && (b = next_batch.fetch_add(1u)) < num_batches; ) {
+            if (breeding) {
+              const clock::time_point start = clock::now();
+              const size_t last = std::min((b + 1u)*batch_size, num_rows);
+              for (size_t k=b*batch_size; k<last; ++k) {
+                restream(cross_over, generation, k);
+                restream(mutate, generation, k);
+                breed_into(cross_over, mutate,
+                           current.chromosome(couples[k].first),
+                           current.chromosome(couples[k].second),
+                           next.unranked(k));
+              }
+              breed_ns += nanoseconds_since(start);
+            }
+            if (!queue.try_push(b)) {
+              ++full_waits;
+              queue_signal.retry([&]{ return queue.try_push(b) || failed; });
+            }
+            queue_signal.notify();
+          }
+        }));
+    }
+    for (size_t t=0; t<num_rankers; ++t) {
+      threads.start(stage_loop, std::function<void()>([&, t]() {
+          size_t b;
+          while (!failed && ranked_batches.load() < num_batches) {
+            if (!queue.try_pop(b)) {
+              ++empty_waits;
+              bool popped = false;
+              queue_signal.retry([&]{
+                  return (popped = queue.try_pop(b)) || failed ||
+                    ranked_batches.load() >= num_batches;
+                });
+              if (!popped) continue;
+            }
+            queue_signal.notify();
+            const clock::time_point start = clock::now();
+            rank_rows(*ranked, rank_funcs[t], b*batch_size,
+                      std::min((b + 1u)*batch_size, num_rows),
+                      rank_buffers[t],
+                      std::integral_constant<bool,
+                      has_batch_rank<RankFunctor, T>::value>());
+            rank_ns += nanoseconds_since(start);
+            // the last batch releases the rankers waiting for more
+            if (++ranked_batches == num_batches) queue_signal.notify();
+          }
+        }));
+    }
+    // runs a round of both stages, returns false if a stage threw
+    auto run_round = [&]() {
+      num_batches = (num_rows + batch_size - 1u) / batch_size;
+      next_batch = 0u;
+      ranked_batches = 0u;
+      std::unique_lock<std::mutex> lock(mutex);
+      threads_done = 0u;
+      ++round_id;
+      start_cv.notify_all();
+      done_cv.wait(lock, [&]{ return threads_done == num_breeders + num_rankers; });
+      return !failed;
+    };
+
+    PipelineResult<ChromosomeType, T> result;
+    result.stats = PipelineStats();
+    clock::time_point start = clock::now();
+    double select_seconds = 0.0;
+    try {
+      if (run_round()) {
+        current.commitRanks();
+        Hypothesis best = current.top();
+        next.reserve(population_size, best.first.size());
+        // the stats account only the generations
+        rank_ns = 0u;
+        full_waits = empty_waits = 0u;
+        start = clock::now();
+        breeding = true;
+        ranked = &next;
+        for (generation=0u; generation<num_iterations; ++generation) {
+          const clock::time_point select_start = clock::now();
+          restream(select_func, generation, 0u);
+          couples = current.select(select_func, population_size - 1uL);
+          for (size_t k=0; k<couples.size(); ++k) next.emplace(best.first.size());
+          num_rows = couples.size();
+          select_seconds += seconds_since(select_start);
+          if (!run_round()) break;
+          const clock::time_point commit_start = clock::now();
+          next.commitRanks();
+          std::swap(current, next);
+          next.reset();
+          if (best.second < current.top().second) best = current.top();
+          // elitism: the best one passes directly, without ranking it again
+          current.push(best.first, best.second);
+          select_seconds += seconds_since(commit_start);
+        }
+        result.best = best.first;
+        result.best_rank = best.second;
+      }
+    }
+    catch (...) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!error) error = std::current_exception();
+    }
+    threads.join();
+    if (error) std::rethrow_exception(error);
+
+    PipelineStats &stats = result.stats;
+    stats.generations = num_iterations;
+    stats.wall_seconds = seconds_since(start);
+    stats.select_seconds = select_seconds;
+    if (stats.wall_seconds > 0.0) {
+      stats.breed_utilization =
+        breed_ns.load() * 1e-9 / (num_breeders * stats.wall_seconds);
+      stats.rank_utilization =
+        rank_ns.load() * 1e-9 / (num_rankers * stats.wall_seconds);
+    }
+    stats.full_queue_waits = full_waits.load();
+    stats.empty_queue_waits = empty_waits.load();
+    return result;
+  }
+
+} // namespace GeneticAlgorithms
+
+#endif // PIPELINE_SOLVER_H
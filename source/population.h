@@ -28,41 +28,358 @@
 #ifndef POPULATION_H
 #define POPULATION_H
 
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <initializer_list>
 #include <iostream>
+#include <limits>
 #include <numeric>
 #include <queue>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#include "arena.h"
+#include "batch_rank.h"
+#include "bit_kernels.h"
 #include "chromosome.h"
+#include "fitness_cache.h"
+#include "incremental.h"
+#include "seeding.h"
+#include "selections.h"
+#include "thread_pool.h"
 
 namespace GeneticAlgorithms {
 
+  /**
+   * Detects selection functors which receive the whole population
+   *
+   * A SelectionFunctor declaring a static constant
+   * uses_population=true, as FitnessSharing (see niching.h), is called
+   * by Population::select() with the population instead of its ranks:
+   *
+   * @code
+   * template<typename PopulationType>
+   * std::vector<IndexCouple> operator()(const PopulationType &population,
+   *                                     size_t result_size) const;
+   * @endcode
+   */
+  template<typename SelectionFunctor>
+  class uses_population {
+    template<typename F>
+    static std::integral_constant<bool, F::uses_population> test(int);
+    template<typename F>
+    static std::false_type test(...);
+  public:
+    static const bool value = decltype(test<SelectionFunctor>(0))::value;
+  }; // class uses_population
+
   /**
    * A class representing a population of Chromosome
    *
    * This class is responsible of the association of Chromosome
    * with their rank and of the selection of couples. Both operations
    * are delegated on two functors.
+   *
+   * Chromosomes and ranks are stored separately: gens live in a
+   * contiguous ChromosomeArena and ranks in a vector. The selection
+   * functor receives a read-only reference to the ranks and answers
+   * with indices, without copying any Chromosome. reset() keeps all
+   * the memory, so a Population reused every generation doesn't
+   * allocate memory after the first one.
+   *
+   * Chromosomes can be ranked one by one with push(), or appended
+   * without rank by append() and ranked all together by evaluate(). In
+   * the later case, when a ThreadPool is given, the RankFunctor is
+   * executed in parallel. Every worker uses its own copy of the
+   * RankFunctor, so it is not required to be thread safe, but it
+   * should be copyable and its copies should produce the same ranks.
+   *
+   * When a FitnessCache is given, evaluate() looks up every
+   * Chromosome at the cache before ranking it, and stores the new
+   * ranks at the cache afterwards. It is only valid for deterministic
+   * RankFunctor.
+   *
+   * Children can be added with their parents, and then they are
+   * ranked incrementally when RankFunctor supports it (see
+   * incremental.h).
+   *
+   * When RankFunctor implements the batch protocol described at
+   * batch_rank.h, evaluate() ranks consecutive rows of the arena with
+   * one call, in batches of RANK_BATCH_SIZE rows.
+   *
+   * ChromosomeType can be Chromosome or any FixedChromosome<N>.
    */
-  template<typename RankFunctor, typename T = float>
+  template<typename RankFunctor, typename T = float,
+           typename ChromosomeType = Chromosome>
   class Population {
   public:
     /// a Hypothesis is the combination of gens and their rank
-    typedef std::pair<Chromosome, T> Hypothesis;
+    typedef std::pair<ChromosomeType, T> Hypothesis;
+
+    /// Marks unknown parents
+    static const size_t NO_PARENT = ~size_t(0u);
+
+    /// Default limit for incremental ranking, see setMaxDeltaFraction()
+    static constexpr float DEFAULT_MAX_DELTA_FRACTION = 0.1f;
+
+    /// Number of chromosomes initialized by each task of init()
+    static const size_t INIT_CHUNK_SIZE = 256u;
+
+    /// Maximum number of rows ranked by each call to a batch RankFunctor
+    static const size_t RANK_BATCH_SIZE = 256u;
     
-    Population(const RankFunctor &rank_func) :
+    Population(const RankFunctor &rank_func, ThreadPool *pool=nullptr,
+               FitnessCache<T> *cache=nullptr) :
       _rank_func(rank_func),
-      _top(Chromosome(), std::numeric_limits<T>::min()) {
+      _pool(pool),
+      _cache(cache),
+      _parents(nullptr),
+      _max_delta_fraction(DEFAULT_MAX_DELTA_FRACTION),
+      _num_ranked(0u),
+      _num_evaluations(0u),
+      _top(ChromosomeType(), std::numeric_limits<T>::lowest()) {
     }
 
     size_t size() const {
-      return _queue.size();
+      return _chromosomes.size();
+    }
+
+    /// returns the ThreadPool used by this population, it can be nullptr
+    ThreadPool *pool() const {
+      return _pool;
+    }
+
+    /**
+     * Changes the ThreadPool used by next operations
+     *
+     * nullptr runs them in the calling thread, e.g. when the
+     * population is used from the workers of its own pool.
+     */
+    void setPool(ThreadPool *pool) {
+      _pool = pool;
+    }
+
+    /// returns the Chromosome at position i
+    const ChromosomeType &chromosome(const size_t i) const {
+      return _chromosomes[i];
+    }
+
+    /**
+     * returns for writing the Chromosome at position i
+     *
+     * Only Chromosome added by emplace() and not ranked yet can be
+     * written, e.g. by several threads breeding in parallel.
+     */
+    ChromosomeType &unranked(const size_t i) {
+      assert(_num_ranked <= i && i < size());
+      return _chromosomes[i];
+    }
+
+    /// returns the rank of the Chromosome at position i
+    T rank(const size_t i) const {
+      return _ranks[i];
+    }
+
+    /// returns the ranks of all the population, in order
+    const std::vector<T> &ranks() const {
+      return _ranks;
+    }
+
+    /**
+     * returns how many Chromosome were ranked by the RankFunctor
+     *
+     * It counts every evaluate() since construction, but not the
+     * ranks found at the FitnessCache nor the ones given by push(),
+     * load() or setRank().
+     */
+    uint64_t numEvaluations() const {
+      return _num_evaluations;
     }
 
     /// push and rank the given Chromosome
-    void push(const Chromosome &x) {
-      _queue.push_back(Hypothesis(x, _rank_func(x)));
-      if (_top.second < _queue.back().second) _top = _queue.back();
+    void push(const ChromosomeType &x) {
+      append(x);
+      evaluate();
+    }
+
+    /// push the given Chromosome with an already known rank
+    void push(const ChromosomeType &x, const T rank) {
+      assert(_num_ranked == size());
+      emplace(x.size()) = x;
+      _ranks.back() = rank;
+      ++_num_ranked;
+      if (_top.second < rank) _top = Hypothesis(x, rank);
+    }
+
+    /// replaces the Chromosome at position i by x, with a known rank
+    void replace(const size_t i, const ChromosomeType &x, const T rank) {
+      assert(i < _num_ranked);
+      _chromosomes[i] = x;
+      _ranks[i] = rank;
+      if (_top.second < rank) _top = Hypothesis(x, rank);
+    }
+
+    /**
+     * Appends n ranked Chromosome from a gene matrix and their ranks
+     *
+     * rows contains n rows of num_blocks_for(num_gens) words, e.g. as
+     * mapped from a checkpoint file (see checkpoint.h). Gens are
+     * copied into the arena without any per Chromosome allocation.
+     */
+    void load(const block_type *rows, const T *ranks, const size_t n,
+              const size_t num_gens) {
+      assert(_num_ranked == size());
+      const size_t words = num_blocks_for(num_gens);
+      reserve(size() + n, num_gens);
+      size_t best = NO_PARENT;
+      for (size_t i=0; i<n; ++i) {
+        ChromosomeType &x = emplace(num_gens);
+        std::copy(rows + i*words, rows + (i + 1u)*words, x.blocks());
+        _ranks.back() = ranks[i];
+        if (best == NO_PARENT || ranks[best] < ranks[i]) best = i;
+      }
+      _num_ranked = size();
+      if (best != NO_PARENT && _top.second < ranks[best]) {
+        _top = Hypothesis(_chromosomes[size() - n + best], ranks[best]);
+      }
+    }
+
+    /// push the given Chromosome without ranking it, see evaluate()
+    void append(const ChromosomeType &x) {
+      emplace(x.size()) = x;
+    }
+
+    /**
+     * Adds a Chromosome without ranking it and returns it for writing
+     *
+     * The returned Chromosome is a row of the arena with undefined
+     * gens, which should be completely written by the caller before
+     * calling evaluate(), e.g. using breed_into().
+     */
+    ChromosomeType &emplace(const size_t num_gens) {
+      _ranks.push_back(T());
+      _origins.push_back(IndexCouple(NO_PARENT, NO_PARENT));
+      return _chromosomes.emplace(num_gens);
+    }
+
+    /**
+     * As emplace(), but remembering the parents of the new Chromosome
+     *
+     * couple refers to positions at parents population, which should
+     * be the same for all children and stay unchanged until
+     * evaluate() is called. It allows incremental ranking when the
+     * RankFunctor implements the protocol described at incremental.h.
+     */
+    ChromosomeType &emplace(const size_t num_gens, const Population &parents,
+                            const IndexCouple &couple) {
+      assert(_parents == nullptr || _parents == &parents);
+      _parents = &parents;
+      ChromosomeType &x = emplace(num_gens);
+      _origins.back() = couple;
+      return x;
+    }
+
+    /**
+     * Changes the limit for incremental ranking
+     *
+     * Children which differ from both parents in more than the given
+     * fraction of their gens are ranked from scratch.
+     */
+    void setMaxDeltaFraction(const float fraction) {
+      _max_delta_fraction = fraction;
+    }
+
+    /// Prepares memory for n chromosomes of num_gens gens
+    void reserve(const size_t n, const size_t num_gens) {
+      _chromosomes.reserve(n, num_gens);
+      _ranks.reserve(n);
+    }
+
+    /// returns the arena where gens are stored
+    const ChromosomeArena<ChromosomeType> &arena() const {
+      return _chromosomes;
+    }
+
+    /**
+     * Ranks all Chromosome appended since last evaluation
+     *
+     * Work is distributed over the ThreadPool in small chunks, and
+     * the best Hypothesis is reduced from every worker result once
+     * all of them have finished.
+     */
+    void evaluate() {
+      const size_t first = _num_ranked;
+      const size_t last = _chromosomes.size();
+      if (first == last) return;
+      const size_t num_workers = (_pool != nullptr) ? _pool->size() : 1u;
+      while (_worker_rank_funcs.size() + 1u < num_workers) {
+        _worker_rank_funcs.push_back(_rank_func);
+      }
+      _worker_changes.resize(num_workers);
+      const size_t none = last;
+      // last position is the best one found at the cache
+      std::vector<size_t> worker_top(num_workers + 1u, none);
+      // ties are broken by position, so the best one doesn't depend
+      // on how positions are distributed between workers
+      auto better = [&](size_t i, size_t j) {
+        return j == none || _ranks[j] < _ranks[i] ||
+          (!(_ranks[i] < _ranks[j]) && i < j);
+      };
+      _pending.clear();
+      for (size_t i=first; i<last; ++i) {
+        if (_cache != nullptr && _cache->find(_chromosomes[i], _ranks[i])) {
+          size_t &best = worker_top[num_workers];
+          if (better(i, best)) best = i;
+        }
+        else {
+          _pending.push_back(i);
+        }
+      }
+      rankPending(worker_top, better,
+                  std::integral_constant<bool,
+                  has_batch_rank<RankFunctor, T>::value>());
+      _num_evaluations += _pending.size();
+      if (_cache != nullptr) {
+        for (size_t i : _pending) _cache->insert(_chromosomes[i], _ranks[i]);
+      }
+      // reduction of the best Hypothesis found by every worker
+      size_t best = none;
+      for (size_t i : worker_top) {
+        if (i != none && better(i, best)) best = i;
+      }
+      if (best != none && _top.second < _ranks[best]) {
+        _top = Hypothesis(_chromosomes[best], _ranks[best]);
+      }
+      _num_ranked = _chromosomes.size();
+      _parents = nullptr;
+    }
+
+    /**
+     * Writes the rank of the unranked Chromosome at position i
+     *
+     * It allows to rank chromosomes outside of evaluate(), e.g. by
+     * several threads, each one writing different positions. Once all
+     * of them are written, commitRanks() should be called.
+     */
+    void setRank(const size_t i, const T rank) {
+      assert(_num_ranked <= i && i < size());
+      _ranks[i] = rank;
+    }
+
+    /// Marks as ranked all Chromosome written by setRank(), updating top()
+    void commitRanks() {
+      size_t best = _num_ranked;
+      for (size_t i=_num_ranked + 1u; i<_chromosomes.size(); ++i) {
+        // the first one wins ties, as at evaluate()
+        if (_ranks[best] < _ranks[i]) best = i;
+      }
+      if (best < _chromosomes.size() && _top.second < _ranks[best]) {
+        _top = Hypothesis(_chromosomes[best], _ranks[best]);
+      }
+      _num_ranked = _chromosomes.size();
+      _parents = nullptr;
     }
 
     /// returns the best Hypothesis in the population set
@@ -75,44 +392,268 @@ namespace GeneticAlgorithms {
      *
      * All new Chromosome are push_back into the population without
      * clearing the vector.
+     *
+     * When InitializerFunctor has an in-place operator()(dest) and a
+     * seed() method, as RandomInitializer, chromosomes are written
+     * directly into the population memory, in chunks of
+     * INIT_CHUNK_SIZE which run in parallel when a ThreadPool is
+     * given. Every chunk uses a copy of init_func reseeded from a seed
+     * drawn from init_func itself, so the result doesn't depend on the
+     * number of workers.
      */
     template<typename InitializerFunctor>
     void init(const InitializerFunctor init_func,
               const size_t size) {
-      for (size_t i=0; i<size; ++i) {
-        push(init_func());
-        // std::cout << "    " << x.rank() << " " << x.gens() << std::endl;
-      }
-      // std::cout << "\n" << std::endl;
+      initUnranked(init_func, size);
+      evaluate();
+    }
+
+    /**
+     * As init(), but leaving the new Chromosome unranked
+     *
+     * They should be ranked by setRank() and commitRanks(), e.g. by
+     * threads of a solver which rank them besides other work.
+     */
+    template<typename InitializerFunctor>
+    void initUnranked(const InitializerFunctor init_func,
+                      const size_t size) {
+      if (size > 0u) initChunks(init_func, size, 0);
     }
 
     /**
      * Given a selection functor, returns the selection of couples
      *
+     * The SelectionFunctor receives ranks() and returns the couples
+     * as pairs of indices into this population, which can be
+     * retrieved using chromosome(). SelectionFunctor declaring
+     * uses_population=true receives this population instead. Parallel
+     * selections receive also the ThreadPool of this population (see
+     * select_couples() at selections.h).
+     *
      * @note It is expected that SelectionFunctor produces a result
      * with the given size.
      */
     template<typename SelectionFunctor>
-    std::vector<typename Chromosome::Couple >
-    select(const SelectionFunctor &select_func, size_t result_size=0uL) {
-      if (result_size == 0uL) result_size = _queue.size();
-      return select_func(_queue, result_size);
+    std::vector<IndexCouple>
+    select(const SelectionFunctor &select_func, size_t result_size=0uL) const {
+      if (result_size == 0uL) result_size = _chromosomes.size();
+      return selectWith(select_func, result_size,
+                        std::integral_constant<bool,
+                        uses_population<SelectionFunctor>::value>());
     }
 
-    /// Clears the vector
+    /// Clears the population, keeping its memory
     void reset() {
-      _queue.clear();
-      _top = Hypothesis(Chromosome(), std::numeric_limits<T>::min());
+      _chromosomes.clear();
+      _ranks.clear();
+      _origins.clear();
+      _parents = nullptr;
+      _num_ranked = 0u;
+      _top = Hypothesis(ChromosomeType(), std::numeric_limits<T>::lowest());
     }
 
   private:
     RankFunctor _rank_func;
+    /// Copies of _rank_func for workers 1 to N-1 of the ThreadPool
+    std::vector<RankFunctor> _worker_rank_funcs;
+    /// Optional ThreadPool used at evaluate()
+    ThreadPool *_pool;
+    /// Optional FitnessCache used at evaluate()
+    FitnessCache<T> *_cache;
+    /// Positions to be ranked at evaluate(), reused between calls
+    std::vector<size_t> _pending;
+    /// Ranges of rows ranked by each batch call, reused between calls
+    std::vector<IndexCouple> _batches;
+    /// Population of the parents of pending Chromosome, if known
+    const Population *_parents;
+    /// Parents of every Chromosome, NO_PARENT when unknown
+    std::vector<IndexCouple> _origins;
+    /// Limit of changed gens for incremental ranking
+    float _max_delta_fraction;
+    /// Changed positions buffer of every worker, reused between calls
+    std::vector<std::vector<size_t> > _worker_changes;
+
+    /// Chunked initialization, for in-place and seedable initializers
+    template<typename InitializerFunctor>
+    auto initChunks(const InitializerFunctor &init_func, const size_t size, int)
+      -> decltype(init_func(std::declval<ChromosomeType&>()),
+                  std::declval<InitializerFunctor&>().seed(0u), void()) {
+      // the first one gives the number of gens and the chunks base seed
+      append(init_func());
+      const size_t first = _chromosomes.size();
+      const size_t num_gens = _chromosomes[first - 1u].size();
+      const uint64_t base_seed =
+        BitKernels::hash(_chromosomes[first - 1u].blocks(),
+                         _chromosomes[first - 1u].num_blocks());
+      for (size_t i=1u; i<size; ++i) emplace(num_gens);
+      const size_t num_chunks = (size - 1u + INIT_CHUNK_SIZE - 1u) / INIT_CHUNK_SIZE;
+      auto init_chunk = [&](size_t, size_t begin, size_t end) {
+        for (size_t c=begin; c<end; ++c) {
+          InitializerFunctor chunk_init(init_func);
+          chunk_init.seed(derive_seed(base_seed, c));
+          const size_t last = std::min(first + (c + 1u)*INIT_CHUNK_SIZE,
+                                       first + size - 1u);
+          for (size_t i=first + c*INIT_CHUNK_SIZE; i<last; ++i) {
+            chunk_init(_chromosomes[i]);
+          }
+        }
+      };
+      if (_pool != nullptr && _pool->size() > 1u) {
+        _pool->parallel_for(num_chunks, 1u, init_chunk);
+      }
+      else {
+        init_chunk(0u, 0u, num_chunks);
+      }
+    }
+
+    /// Sequential initialization, for any other initializer
+    template<typename InitializerFunctor>
+    void initChunks(const InitializerFunctor &init_func, const size_t size, long) {
+      for (size_t i=0; i<size; ++i) {
+        append(init_func());
+      }
+    }
+
+    /// Selection functors which receive the ranks
+    template<typename SelectionFunctor>
+    std::vector<IndexCouple>
+    selectWith(const SelectionFunctor &select_func, const size_t result_size,
+               std::false_type) const {
+      return select_couples(select_func, _ranks, result_size, _pool);
+    }
+
+    /// Selection functors which receive the population, see uses_population
+    template<typename SelectionFunctor>
+    std::vector<IndexCouple>
+    selectWith(const SelectionFunctor &select_func, const size_t result_size,
+               std::true_type) const {
+      return select_func(*this, result_size);
+    }
+
+    /// Ranks the _pending positions one by one
+    template<typename Better>
+    void rankPending(std::vector<size_t> &worker_top, const Better &better,
+                     std::false_type) {
+      const size_t num_workers = worker_top.size() - 1u;
+      auto rank_chunk = [&](size_t worker, size_t begin, size_t end) {
+        const RankFunctor &rank_func =
+          (worker == 0u) ? _rank_func : _worker_rank_funcs[worker - 1u];
+        size_t &best = worker_top[worker];
+        for (size_t k=begin; k<end; ++k) {
+          const size_t i = _pending[k];
+          _ranks[i] = rankOne(rank_func, i, _worker_changes[worker]);
+          if (better(i, best)) best = i;
+        }
+      };
+      if (num_workers > 1u) _pool->parallel_for(_pending.size(), 1u, rank_chunk);
+      else rank_chunk(0u, 0u, _pending.size());
+    }
+
+    /**
+     * Ranks the _pending positions with the batch protocol
+     *
+     * Pending positions are consecutive unless some ranks were found
+     * at the FitnessCache, so they are split into runs of consecutive
+     * rows, and every run in batches of RANK_BATCH_SIZE rows at most.
+     */
+    template<typename Better>
+    void rankPending(std::vector<size_t> &worker_top, const Better &better,
+                     std::true_type) {
+      if (_pending.empty()) return;
+      const size_t num_workers = worker_top.size() - 1u;
+      _batches.clear();
+      for (size_t k=0; k<_pending.size(); ) {
+        size_t end = k + 1u;
+        while (end < _pending.size() && end - k < RANK_BATCH_SIZE &&
+               _pending[end] == _pending[end - 1u] + 1u) ++end;
+        _batches.push_back(IndexCouple(_pending[k], _pending[end - 1u] + 1u));
+        k = end;
+      }
+      const size_t num_gens = _chromosomes[_pending[0]].size();
+      const size_t stride = _chromosomes.stride();
+      auto rank_batches = [&](size_t worker, size_t begin, size_t end) {
+        const RankFunctor &rank_func =
+          (worker == 0u) ? _rank_func : _worker_rank_funcs[worker - 1u];
+        size_t &best = worker_top[worker];
+        for (size_t b=begin; b<end; ++b) {
+          const size_t first = _batches[b].first;
+          const size_t last = _batches[b].second;
+          const GeneMatrix genes = {
+            _chromosomes.data() + first*stride, stride, last - first, num_gens
+          };
+          rank_func(genes, &_ranks[first]);
+          for (size_t i=first; i<last; ++i) {
+            if (better(i, best)) best = i;
+          }
+        }
+      };
+      if (num_workers > 1u) _pool->parallel_for(_batches.size(), 1u, rank_batches);
+      else rank_batches(0u, 0u, _batches.size());
+    }
+
+    /// Ranks position i using the incremental protocol when available
+    T rankOne(const RankFunctor &rank_func, const size_t i,
+              std::vector<size_t> &changes) const {
+      return rankOne(rank_func, i, changes,
+                     std::integral_constant<bool,
+                     has_delta_rank<RankFunctor, ChromosomeType, T>::value>());
+    }
+
+    T rankOne(const RankFunctor &rank_func, const size_t i,
+              std::vector<size_t> &, std::false_type) const {
+      return rank_func(_chromosomes[i]);
+    }
+
+    T rankOne(const RankFunctor &rank_func, const size_t i,
+              std::vector<size_t> &changes, std::true_type) const {
+      const ChromosomeType &x = _chromosomes[i];
+      if (_parents != nullptr && _origins[i].first != NO_PARENT) {
+        // look for the closest parent under the limit of changes
+        size_t best = NO_PARENT;
+        size_t best_distance = static_cast<size_t>(_max_delta_fraction * x.size());
+        for (size_t p : { _origins[i].first, _origins[i].second }) {
+          size_t d = BitKernels::hamming(x.blocks(),
+                                         _parents->chromosome(p).blocks(),
+                                         x.num_blocks());
+          if (d <= best_distance) {
+            best = p;
+            best_distance = d;
+          }
+        }
+        if (best != NO_PARENT) {
+          const ChromosomeType &parent = _parents->chromosome(best);
+          changes.clear();
+          BitKernels::changed_positions(x.blocks(), parent.blocks(),
+                                        x.num_blocks(), changes);
+          return rank_func.delta(x, parent, _parents->rank(best), changes);
+        }
+      }
+      return rank_func(x);
+    }
     /// The population set is stored here
-    std::vector<Hypothesis> _queue;
+    ChromosomeArena<ChromosomeType> _chromosomes;
+    /// The rank of every Chromosome in _chromosomes
+    std::vector<T> _ranks;
+    /// Number of Chromosome in _chromosomes with a valid rank
+    size_t _num_ranked;
+    /// Chromosome ranked by the RankFunctor, see numEvaluations()
+    uint64_t _num_evaluations;
     /// The best hypothesis in the set
     Hypothesis _top;
   }; // class Population
 
+  template<typename RankFunctor, typename T, typename ChromosomeType>
+  const size_t Population<RankFunctor, T, ChromosomeType>::NO_PARENT;
+
+  template<typename RankFunctor, typename T, typename ChromosomeType>
+  constexpr float Population<RankFunctor, T, ChromosomeType>::DEFAULT_MAX_DELTA_FRACTION;
+
+  template<typename RankFunctor, typename T, typename ChromosomeType>
+  const size_t Population<RankFunctor, T, ChromosomeType>::INIT_CHUNK_SIZE;
+
+  template<typename RankFunctor, typename T, typename ChromosomeType>
+  const size_t Population<RankFunctor, T, ChromosomeType>::RANK_BATCH_SIZE;
+
 } // GeneticAlgorithms
 
 #endif // POPULATION_H
@@ -0,0 +1,493 @@
+/*
+ * This file is part of GeneticAlgorithms toolkit
+ *
+ * Copyright 2017, Francisco Zamora-Martinez
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef PROCESS_ISLANDS_H
+#define PROCESS_ISLANDS_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <poll.h>
+#include <random>
+#include <signal.h>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <type_traits>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "chromosome.h"
+#include "genetic_solver.h"
+#include "island_solver.h"
+#include "population.h"
+#include "seeding.h"
+#include "serialization.h"
+
+namespace GeneticAlgorithms {
+
+  /**
+   * Message transport between a coordinator and worker processes
+   *
+   * It is based on Unix domain sockets of type SOCK_SEQPACKET, one
+   * socket pair per worker, created before forking. Messages keep
+   * their boundaries and are delivered atomically, so a non-blocking
+   * send either delivers a whole message or nothing.
+   *
+   * This class defines the interface expected by solve_processes()
+   * from any transport, which allows to replace it, e.g. by a
+   * network transport spanning several nodes:
+   *
+   * - setupCoordinator() and setupWorker(k) are called after fork()
+   *   at the coordinator and at worker k respectively.
+   *
+   * - Worker side: send(msg) blocks until the message is sent to the
+   *   coordinator, tryReceive(msg) returns false when there is no
+   *   message waiting.
+   *
+   * - Coordinator side: trySend(k, msg) returns false when worker k
+   *   can't accept the message now, and receiveAny(k, msg) waits
+   *   for a message from any worker, returning false when all of them
+   *   have closed their connection.
+   *
+   * - maxMessageSize() is the size of the largest message which can
+   *   be sent on both sides.
+   */
+  class UnixSocketTransport {
+  public:
+    /// Largest message size, also used as socket buffers size
+    static const size_t MAX_MESSAGE_SIZE = 4u << 20u;
+
+    explicit UnixSocketTransport(const size_t num_workers) :
+      _worker(NONE),
+      _max_message_size(MAX_MESSAGE_SIZE) {
+      for (size_t k=0; k<num_workers; ++k) {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) != 0) {
+          throw std::runtime_error("socketpair failed: " + errorString());
+        }
+        for (int fd : fds) {
+          int size = static_cast<int>(MAX_MESSAGE_SIZE);
+          setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+          setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+          // the kernel limits buffers to net.core.wmem_max, and reports
+          // twice the size given to setsockopt()
+          socklen_t length = sizeof(size);
+          if (getsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, &length) == 0) {
+            _max_message_size = std::min(_max_message_size,
+                                         static_cast<size_t>(size) / 2u);
+          }
+        }
+        _coordinator_fds.push_back(fds[0]);
+        _worker_fds.push_back(fds[1]);
+      }
+    }
+
+    ~UnixSocketTransport() {
+      for (int fd : _coordinator_fds) if (fd >= 0) close(fd);
+      for (int fd : _worker_fds) if (fd >= 0) close(fd);
+    }
+
+    UnixSocketTransport(const UnixSocketTransport &) = delete;
+    UnixSocketTransport &operator=(const UnixSocketTransport &) = delete;
+
+    size_t numWorkers() const {
+      return _coordinator_fds.size();
+    }
+
+    size_t maxMessageSize() const {
+      return _max_message_size;
+    }
+
+    void setupCoordinator() {
+      for (int &fd : _worker_fds) closeFd(fd);
+    }
+
+    void setupWorker(const size_t k) {
+      _worker = k;
+      for (int &fd : _coordinator_fds) closeFd(fd);
+      for (size_t j=0; j<_worker_fds.size(); ++j) {
+        if (j != k) closeFd(_worker_fds[j]);
+      }
+    }
+
+    /// Worker side: blocking send to the coordinator
+    void send(const std::vector<char> &msg) {
+      if (!sendMessage(_worker_fds[_worker], msg, 0)) {
+        throw std::runtime_error("send failed: " + errorString());
+      }
+    }
+
+    /// Worker side: non-blocking receive from the coordinator
+    bool tryReceive(std::vector<char> &msg) {
+      return receiveMessage(_worker_fds[_worker], msg, MSG_DONTWAIT);
+    }
+
+    /// Coordinator side: non-blocking send to worker k
+    bool trySend(const size_t k, const std::vector<char> &msg) {
+      return sendMessage(_coordinator_fds[k], msg, MSG_DONTWAIT);
+    }
+
+    /// Coordinator side: waits for a message from any worker
+    bool receiveAny(size_t &k, std::vector<char> &msg) {
+      for (;;) {
+        std::vector<pollfd> fds;
+        std::vector<size_t> workers;
+        for (size_t j=0; j<_coordinator_fds.size(); ++j) {
+          if (_coordinator_fds[j] < 0) continue;
+          pollfd p;
+          p.fd = _coordinator_fds[j];
+          p.events = POLLIN;
+          p.revents = 0;
+          fds.push_back(p);
+          workers.push_back(j);
+        }
+        if (fds.empty()) return false;
+        if (poll(fds.data(), fds.size(), -1) < 0) {
+          if (errno == EINTR) continue;
+          throw std::runtime_error("poll failed: " + errorString());
+        }
+        for (size_t i=0; i<fds.size(); ++i) {
+          if (fds[i].revents == 0) continue;
+          k = workers[i];
+          if (receiveMessage(_coordinator_fds[k], msg, MSG_DONTWAIT)) return true;
+          // no message and an event means the worker closed the socket
+          if (fds[i].revents & (POLLHUP | POLLERR)) closeFd(_coordinator_fds[k]);
+        }
+      }
+    }
+
+  private:
+    static const size_t NONE = ~size_t(0u);
+
+    std::vector<int> _coordinator_fds;
+    std::vector<int> _worker_fds;
+    size_t _worker;
+    size_t _max_message_size;
+
+    static std::string errorString() {
+      return std::to_string(errno);
+    }
+
+    static void closeFd(int &fd) {
+      if (fd >= 0) close(fd);
+      fd = -1;
+    }
+
+    static bool sendMessage(const int fd, const std::vector<char> &msg,
+                            const int flags) {
+      for (;;) {
+        ssize_t n = ::send(fd, msg.data(), msg.size(), flags | MSG_NOSIGNAL);
+        if (n >= 0) return true;
+        if (errno != EINTR) return false;
+      }
+    }
+
+    static bool receiveMessage(const int fd, std::vector<char> &msg,
+                               const int flags) {
+      for (;;) {
+        // MSG_TRUNC with MSG_PEEK returns the real size of next message
+        ssize_t n = recv(fd, nullptr, 0, flags | MSG_PEEK | MSG_TRUNC);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        msg.resize(static_cast<size_t>(n));
+        n = recv(fd, msg.data(), msg.size(), flags);
+        if (n < 0 && errno == EINTR) continue;
+        return n == static_cast<ssize_t>(msg.size());
+      }
+    }
+  }; // class UnixSocketTransport
+
+  /// Types of messages exchanged by solve_processes()
+  enum class IslandMessage : uint32_t {
+    MIGRANTS = 1u, ///< migrant records, from a worker or routed to it
+    FINAL = 2u,    ///< best record and IslandStats of a finished worker
+    ERROR = 3u     ///< what() of the exception which stopped a worker
+  };
+
+  /**
+   * Island model over several processes with periodic migration
+   *
+   * It is the multi-process version of solve_islands(): the calling
+   * process forks one worker process per island and acts as the
+   * coordinator. Workers run the usual generational loop with their
+   * own reseeded copies of the functors, so RankFunctor doesn't need
+   * to be thread safe, it even can use global state.
+   *
+   * Every config.migration_interval generations, a worker sends its
+   * config.num_migrants best individuals, as compact binary records
+   * (see serialization.h), to the coordinator, split in as many
+   * messages as needed to fit maxMessageSize(), and integrates all the
+   * migrants already routed to it without waiting for more. The
+   * coordinator routes migrants following config.topology, dropping
+   * them when the destination socket is full, and collects the best
+   * individual and the statistics of every worker when it finishes.
+   *
+   * The Transport is pluggable, see UnixSocketTransport for the
+   * required interface.
+   *
+   * When any worker fails, it throws std::runtime_error with the
+   * message of the exception thrown at the worker. When fork() fails,
+   * workers already started are killed before throwing. Chromosomes
+   * too long to send one of them in a message are rejected with
+   * std::runtime_error before forking.
+   *
+   * ATTENTION: it uses fork(), so it should be called before creating
+   * any thread in the program. Worker processes finish with _exit().
+   */
+  template<typename Transport,
+           typename InitializerFunctor,
+           typename SelectionFunctor,
+           typename CrossOverFunctor,
+           typename MutationFunctor,
+           typename RankFunctor,
+           typename T=float,
+           typename ChromosomeType=typename std::decay<
+             decltype(std::declval<const InitializerFunctor&>()())>::type>
+  IslandResult<ChromosomeType, T>
+  solve_processes(Transport &transport,
+                  const IslandConfig &config,
+                  const size_t num_iterations,
+                  const size_t population_size,
+                  const InitializerFunctor &init_func,
+                  const SelectionFunctor &select_func,
+                  const CrossOverFunctor &cross_over_func,
+                  const MutationFunctor &mutate_func,
+                  const RankFunctor &rank_func) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "solve_processes needs trivially copyable ranks");
+    typedef Population<RankFunctor, T, ChromosomeType> PopulationType;
+    typedef typename PopulationType::Hypothesis Hypothesis;
+    const size_t K = transport.numWorkers();
+    const bool migrates = (K > 1u && config.migration_interval > 0u);
+    // migrants are split in several messages, but one record with the
+    // final stats should fit in a message
+    const size_t num_gens = InitializerFunctor(init_func)().size();
+    const size_t header_size = sizeof(IslandMessage) + sizeof(uint64_t);
+    const size_t record_size = sizeof(uint64_t) + sizeof(T) +
+      num_blocks_for(num_gens) * sizeof(block_type);
+    if (header_size + record_size + sizeof(IslandStats<T>) >
+        transport.maxMessageSize()) {
+      throw std::runtime_error("Chromosomes of " + std::to_string(num_gens) +
+                               " gens don't fit in the messages of the transport");
+    }
+    const size_t migrants_by_message =
+      (transport.maxMessageSize() - header_size) / record_size;
+
+    std::vector<pid_t> pids;
+    for (size_t k=0; k<K; ++k) {
+      pid_t pid = fork();
+      if (pid < 0) {
+        const std::string error = std::to_string(errno);
+        for (pid_t started : pids) kill(started, SIGKILL);
+        for (pid_t started : pids) waitpid(started, nullptr, 0);
+        throw std::runtime_error("fork failed: " + error);
+      }
+      if (pid > 0) {
+        pids.push_back(pid);
+        continue;
+      }
+      // worker process
+      std::string error;
+      try {
+        transport.setupWorker(k);
+        InitializerFunctor init(init_func);
+        SelectionFunctor select(select_func);
+        CrossOverFunctor cross_over(cross_over_func);
+        MutationFunctor mutate(mutate_func);
+        reseed(init, derive_seed(config.seed, 4u*k));
+        reseed(select, derive_seed(config.seed, 4u*k + 1u));
+        reseed(cross_over, derive_seed(config.seed, 4u*k + 2u));
+        reseed(mutate, derive_seed(config.seed, 4u*k + 3u));
+        const WorkerOperators<CrossOverFunctor, MutationFunctor>
+          operators(cross_over, mutate);
+        IslandStats<T> stats = IslandStats<T>();
+
+        PopulationType current(rank_func);
+        PopulationType next(rank_func);
+        current.init(init, population_size);
+        Hypothesis best = current.top();
+        next.reserve(population_size, best.first.size());
+        std::vector<size_t> order;
+        std::vector<Hypothesis> arrivals;
+        std::vector<char> msg;
+        for (size_t i=0; i<num_iterations; ++i) {
+          next_generation(current, next, best, select, operators,
+                          population_size, i);
+          if (!migrates || (i + 1u) % config.migration_interval != 0u) continue;
+          const std::vector<T> &ranks = current.ranks();
+          const size_t n = std::min(config.num_migrants, ranks.size());
+          best_positions(ranks, n, order);
+          for (size_t first=0; first<n; first+=migrants_by_message) {
+            const size_t last = std::min(n, first + migrants_by_message);
+            msg.clear();
+            BinaryWriter writer(msg);
+            writer.write(IslandMessage::MIGRANTS);
+            writer.write(static_cast<uint64_t>(last - first));
+            for (size_t j=first; j<last; ++j) {
+              writer.writeRecord(current.chromosome(order[j]), ranks[order[j]]);
+            }
+            transport.send(msg);
+          }
+          arrivals.clear();
+          while (transport.tryReceive(msg)) {
+            BinaryReader reader(msg.data(), msg.size());
+            reader.read<IslandMessage>();
+            const uint64_t count = reader.read<uint64_t>();
+            for (uint64_t j=0; j<count; ++j) {
+              Hypothesis migrant;
+              reader.readRecord(migrant.first, migrant.second);
+              arrivals.push_back(std::move(migrant));
+            }
+          }
+          stats.migrants_received += immigrate(current, arrivals, best, order);
+        }
+        const std::vector<T> &ranks = current.ranks();
+        stats.best_rank = best.second;
+        stats.mean_rank = std::accumulate(ranks.begin(), ranks.end(), 0.0) /
+          std::max<size_t>(ranks.size(), 1u);
+        stats.generations = num_iterations;
+        msg.clear();
+        BinaryWriter writer(msg);
+        writer.write(IslandMessage::FINAL);
+        writer.writeRecord(best.first, best.second);
+        writer.write(stats);
+        transport.send(msg);
+        _exit(0);
+      }
+      catch (std::exception &e) {
+        error = e.what();
+      }
+      catch (...) {
+        error = "unknown exception";
+      }
+      try {
+        error.resize(std::min(error.size(), transport.maxMessageSize() - header_size));
+        std::vector<char> msg;
+        BinaryWriter writer(msg);
+        writer.write(IslandMessage::ERROR);
+        writer.write(static_cast<uint64_t>(error.size()));
+        writer.writeBytes(error.data(), error.size());
+        transport.send(msg);
+      }
+      catch (...) {
+        // the coordinator still sees the exit status
+      }
+      _exit(1);
+    }
+
+    // coordinator process
+    transport.setupCoordinator();
+    IslandResult<ChromosomeType, T> result;
+    result.islands.resize(K);
+    result.best_rank = std::numeric_limits<T>::lowest();
+    std::vector<bool> finished(K, false);
+    std::vector<std::string> errors(K);
+    // migrants sent and dropped are only known by the coordinator
+    std::vector<size_t> sent(K, 0u), dropped(K, 0u);
+    std::mt19937_64 rng(derive_seed(config.seed, 4u*K));
+    std::vector<size_t> dests;
+    std::vector<char> msg;
+    size_t k;
+    while (transport.receiveAny(k, msg)) {
+      BinaryReader reader(msg.data(), msg.size());
+      IslandMessage type = reader.read<IslandMessage>();
+      if (type == IslandMessage::MIGRANTS) {
+        const uint64_t count = reader.read<uint64_t>();
+        migration_destinations(config.topology, k, K, rng, dests);
+        for (size_t dest : dests) {
+          if (transport.trySend(dest, msg)) sent[k] += count;
+          else dropped[k] += count;
+        }
+      }
+      else if (type == IslandMessage::FINAL) {
+        Hypothesis best;
+        reader.readRecord(best.first, best.second);
+        result.islands[k] = reader.read<IslandStats<T> >();
+        if (result.best_rank < best.second) {
+          result.best = best.first;
+          result.best_rank = best.second;
+        }
+        finished[k] = true;
+      }
+      else if (type == IslandMessage::ERROR) {
+        errors[k].resize(static_cast<size_t>(reader.read<uint64_t>()));
+        reader.readBytes(&errors[k][0], errors[k].size());
+      }
+    }
+    std::string failure;
+    for (size_t j=0; j<K; ++j) {
+      result.islands[j].migrants_sent = sent[j];
+      result.islands[j].migrants_dropped = dropped[j];
+      int status;
+      waitpid(pids[j], &status, 0);
+      if (failure.empty() &&
+          (!finished[j] || !WIFEXITED(status) || WEXITSTATUS(status) != 0)) {
+        failure = "Island worker process " + std::to_string(j) + " failed";
+        if (!errors[j].empty()) failure += ": " + errors[j];
+      }
+    }
+    if (!failure.empty()) throw std::runtime_error(failure);
+    return result;
+  }
+
+  /// solve_processes() over UnixSocketTransport, one worker per island
+  template<typename InitializerFunctor,
+           typename SelectionFunctor,
+           typename CrossOverFunctor,
+           typename MutationFunctor,
+           typename RankFunctor,
+           typename T=float,
+           typename ChromosomeType=typename std::decay<
+             decltype(std::declval<const InitializerFunctor&>()())>::type>
+  IslandResult<ChromosomeType, T>
+  solve_processes(const IslandConfig &config,
+                  const size_t num_iterations,
+                  const size_t population_size,
+                  const InitializerFunctor &init_func,
+                  const SelectionFunctor &select_func,
+                  const CrossOverFunctor &cross_over_func,
+                  const MutationFunctor &mutate_func,
+                  const RankFunctor &rank_func) {
+    UnixSocketTransport transport(std::max<size_t>(config.num_islands, 1u));
+    return solve_processes<UnixSocketTransport, InitializerFunctor,
+                           SelectionFunctor, CrossOverFunctor,
+                           MutationFunctor, RankFunctor, T,
+                           ChromosomeType>(transport, config, num_iterations,
+                                           population_size, init_func,
+                                           select_func, cross_over_func,
+                                           mutate_func, rank_func);
+  }
+
+} // namespace GeneticAlgorithms
+
+#endif // PROCESS_ISLANDS_H
@@ -0,0 +1,120 @@
+/*
+ * This file is part of GeneticAlgorithms toolkit
+ *
+ * Copyright 2017, Francisco Zamora-Martinez
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef SEEDING_H
+#define SEEDING_H
+
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+namespace GeneticAlgorithms {
+
+  /**
+   * Produces a new seed from a base seed and an index
+   *
+   * Different indices produce unrelated seeds, so copies of the same
+   * functor can be given independent random sequences, e.g. one for
+   * each island or worker.
+   */
+  inline uint64_t derive_seed(const uint64_t seed, const uint64_t index) {
+    uint64_t x = seed + 0x9e3779b97f4a7c15ULL * (index + 1u);
+    x = (x ^ (x >> 30u)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27u)) * 0x94d049bb133111ebULL;
+    x ^= x >> 31u;
+    return x;
+  }
+
+  /// Calls functor.seed(seed), available at all functors of this toolkit
+  template<typename Functor>
+  auto reseed(Functor &functor, const uint64_t seed, int)
+    -> decltype(functor.seed(seed), void()) {
+    functor.seed(seed);
+  }
+
+  /// Functors without seed() are left unchanged
+  template<typename Functor>
+  void reseed(Functor &, const uint64_t, long) {
+  }
+
+  /**
+   * Restarts the random sequence of a functor, when it has one
+   *
+   * Genetic operators of this toolkit implement a seed(uint64_t)
+   * method. User functors which don't implement it are not modified.
+   */
+  template<typename Functor>
+  void reseed(Functor &functor, const uint64_t seed) {
+    reseed(functor, seed, 0);
+  }
+
+  /**
+   * Trait which tells if a functor implements random streams
+   *
+   * Genetic operators of this toolkit implement a const method
+   * stream(generation, individual), which moves their CounterRng to
+   * the random stream of the given child (see counter_rng.h).
+   */
+  template<typename Functor>
+  class has_stream {
+    template<typename F>
+    static auto test(int) -> decltype(std::declval<const F&>().stream(uint64_t(),
+                                                                      uint64_t()),
+                                      std::true_type());
+    template<typename F>
+    static std::false_type test(long);
+  public:
+    static const bool value = decltype(test<Functor>(0))::value;
+  }; // class has_stream
+
+  /// Calls functor.stream(generation, individual), when available
+  template<typename Functor>
+  auto restream(const Functor &functor, const uint64_t generation,
+                const uint64_t individual, int)
+    -> decltype(functor.stream(generation, individual), void()) {
+    functor.stream(generation, individual);
+  }
+
+  /// Functors without stream() are left unchanged
+  template<typename Functor>
+  void restream(const Functor &, const uint64_t, const uint64_t, long) {
+  }
+
+  /**
+   * Moves a functor to the random stream of a given child
+   *
+   * Functors which don't implement stream() are not modified.
+   */
+  template<typename Functor>
+  void restream(const Functor &functor, const uint64_t generation,
+                const uint64_t individual) {
+    restream(functor, generation, individual, 0);
+  }
+
+} // namespace GeneticAlgorithms
+
+#endif // SEEDING_H
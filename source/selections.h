@@ -29,15 +29,122 @@
 #define SELECTIONS_H
 
 #include <algorithm>
+#include <cmath>
 #include <functional>
 #include <numeric>
 #include <random>
 #include <vector>
 
 #include "chromosome.h"
+#include "counter_rng.h"
+#include "thread_pool.h"
 
 namespace GeneticAlgorithms {
 
+  /// Number of couples sampled by every chunk of a parallel selection
+  static const size_t SELECTION_CHUNK_SIZE = 4096u;
+
+  /// Number of ranks processed by every chunk of a parallel selection
+  static const size_t SELECTION_RANKS_GRAIN = 32768u;
+
+  /**
+   * Converts population ranks into non-negative roulette weights
+   *
+   * As in RouletteWheelSelection, when any rank is negative all of
+   * them are translated by -min. The weights vector is reused, and
+   * the minimum is reduced in parallel when a ThreadPool is given.
+   */
+  template<typename RankSequence, typename T>
+  void rank_weights(const RankSequence &ranks, std::vector<T> &weights,
+                    ThreadPool *pool) {
+    const size_t n = ranks.size();
+    weights.resize(n);
+    const size_t num_chunks = (n + SELECTION_RANKS_GRAIN - 1u) / SELECTION_RANKS_GRAIN;
+    std::vector<T> mins(num_chunks, T(0.0f));
+    auto chunk_min = [&](size_t, size_t begin, size_t end) {
+      for (size_t c=begin; c<end; ++c) {
+        const size_t last = std::min(n, (c+1u)*SELECTION_RANKS_GRAIN);
+        T m = T(0.0f);
+        for (size_t i=c*SELECTION_RANKS_GRAIN; i<last; ++i) {
+          weights[i] = static_cast<T>(ranks[i]);
+          m = std::min(m, weights[i]);
+        }
+        mins[c] = m;
+      }
+    };
+    if (pool != nullptr) pool->parallel_for(num_chunks, 1u, chunk_min);
+    else chunk_min(0u, 0u, num_chunks);
+    const T min = (num_chunks > 0u) ? *std::min_element(mins.begin(), mins.end()) : T(0.0f);
+    if (min < T(0.0f)) {
+      auto translate = [&](size_t, size_t begin, size_t end) {
+        for (size_t i=begin; i<end; ++i) weights[i] -= min;
+      };
+      if (pool != nullptr) pool->parallel_for(n, SELECTION_RANKS_GRAIN, translate);
+      else translate(0u, 0u, n);
+    }
+  }
+
+  /// Selection functors which sample in parallel at the given ThreadPool
+  template<typename SelectionFunctor, typename RankSequence>
+  auto select_couples(const SelectionFunctor &select_func,
+                      const RankSequence &ranks, const size_t result_size,
+                      ThreadPool *pool, int)
+    -> decltype(select_func(ranks, result_size, pool)) {
+    return select_func(ranks, result_size, pool);
+  }
+
+  /// Selection functors which run only in the calling thread
+  template<typename SelectionFunctor, typename RankSequence>
+  std::vector<IndexCouple>
+  select_couples(const SelectionFunctor &select_func, const RankSequence &ranks,
+                 const size_t result_size, ThreadPool *, long) {
+    return select_func(ranks, result_size);
+  }
+
+  /**
+   * Calls select_func(ranks, result_size), giving it pool when it accepts one
+   *
+   * Selection functors which can run in parallel implement
+   * operator()(ranks, result_size, ThreadPool*), so they use the pool
+   * of the solver instead of owning another one. pool can be nullptr.
+   */
+  template<typename SelectionFunctor, typename RankSequence>
+  std::vector<IndexCouple>
+  select_couples(const SelectionFunctor &select_func, const RankSequence &ranks,
+                 const size_t result_size, ThreadPool *pool) {
+    return select_couples(select_func, ranks, result_size, pool, 0);
+  }
+
+  /**
+   * Fills result with couples produced by draw(rng)
+   *
+   * The result is split in chunks of SELECTION_CHUNK_SIZE couples, and
+   * every chunk uses its own random engine seeded from rng. Chunks
+   * are processed in parallel when a ThreadPool is given, but the
+   * result only depends on rng, not on the number of workers.
+   */
+  template<typename DrawFunctor>
+  void sample_couples(std::vector<IndexCouple> &result, CounterRng &rng,
+                      ThreadPool *pool, DrawFunctor draw) {
+    const size_t n = result.size();
+    const size_t num_chunks = (n + SELECTION_CHUNK_SIZE - 1u) / SELECTION_CHUNK_SIZE;
+    std::vector<uint64_t> seeds(num_chunks);
+    for (auto &seed : seeds) seed = rng();
+    auto sample_chunk = [&](size_t, size_t begin, size_t end) {
+      for (size_t c=begin; c<end; ++c) {
+        CounterRng chunk_rng(seeds[c]);
+        const size_t last = std::min(n, (c+1u)*SELECTION_CHUNK_SIZE);
+        for (size_t i=c*SELECTION_CHUNK_SIZE; i<last; ++i) {
+          size_t x_pos = draw(chunk_rng);
+          size_t y_pos = draw(chunk_rng);
+          result[i] = IndexCouple(x_pos, y_pos);
+        }
+      }
+    };
+    if (pool != nullptr) pool->parallel_for(num_chunks, 1u, sample_chunk);
+    else sample_chunk(0u, 0u, num_chunks);
+  }
+
   /**
    * A class which selects population subjects based on their rank
    *
@@ -53,45 +160,347 @@ namespace GeneticAlgorithms {
   public:
 
     /// Initializes the algorithm by receiving a random seed
-    RouletteWheelSelection(unsigned seed) :
+    RouletteWheelSelection(uint64_t seed) :
       _rng(seed) {
     }
 
-    /// This functor receives a population and returns selected couples
-    std::vector<typename Chromosome::Couple>
-    operator()(const std::vector<std::pair<Chromosome, T> > pop,
-               size_t result_size) const {
-      std::vector<float> ranks(pop.size());
-      // extract all ranks from pop vector
-      std::transform(pop.begin(), pop.end(), ranks.begin(),
-                     [](const std::pair<Chromosome, T> &x){ return x.second; });
+    /**
+     * This functor receives population ranks and returns selected couples
+     *
+     * RankSequence is any random access sequence of ranks, usually a
+     * const reference to Population::ranks(). The result contains
+     * pairs of indices into that sequence.
+     */
+    template<typename RankSequence>
+    std::vector<IndexCouple>
+    operator()(const RankSequence &pop_ranks, size_t result_size) const {
+      if (pop_ranks.size() == 0u) return std::vector<IndexCouple>();
+      std::vector<T> ranks(pop_ranks.begin(), pop_ranks.end());
       // the minimum would be used to check if all ranks are positive
-      float min = *std::min_element(ranks.begin(), ranks.end());
-      if (min < 0.0f) {
+      T min = *std::min_element(ranks.begin(), ranks.end());
+      if (min < T(0.0f)) {
         // if non positive ranks, translate them using -min
 	std::transform(ranks.begin(), ranks.end(), ranks.begin(),
-		       [min](float x){ return x - min; });
+		       [min](T x){ return x - min; });
       }
 
       // the multinomial distribution is computed here
-      std::discrete_distribution<int> distribution(ranks.begin(), ranks.end());
+      std::discrete_distribution<size_t> distribution(ranks.begin(), ranks.end());
 
       // generate a vector of couples by sampling from distribution
-      std::vector<typename Chromosome::Couple> result(result_size);
+      std::vector<IndexCouple> result(result_size);
       for (auto it = result.begin(); it != result.end(); ++it) {
         size_t x_pos = distribution(_rng);
         size_t y_pos = distribution(_rng);
-        *it = std::make_pair(pop[x_pos].first, pop[y_pos].first);
+        *it = IndexCouple(x_pos, y_pos);
       }
 
       return result;
     }
+    /// Restarts the random sequence of this functor with the given seed
+    void seed(uint64_t seed) {
+      _rng.seed(seed);
+    }
+
+    /// Moves to the random stream of (generation, individual), see counter_rng.h
+    void stream(uint64_t generation, uint64_t individual) const {
+      _rng.stream(generation, individual, RandomStream::SELECTION);
+    }
+
   private:
-    mutable std::mt19937_64 _rng;
+    mutable CounterRng _rng;
   };
 
   typedef RouletteWheelSelection<float> FloatRouletteWheelSelection;
   typedef RouletteWheelSelection<double> DoubleRouletteWheelSelection;
+
+  /**
+   * A roulette wheel selection which samples in constant time
+   *
+   * It selects with the same probabilities than RouletteWheelSelection,
+   * but it builds Vose's alias table over the rank weights, so every
+   * draw costs one uniform integer and one uniform real, independently
+   * of the population size. When a ThreadPool is given, weights and
+   * their normalization are computed and couples are sampled in
+   * parallel. The pairing of small and large entries of the table is
+   * serial, O(n) with a small constant.
+   *
+   * ATTENTION: this class is not thread safe, if you need to use it
+   * on different threads, be sure each thread receives a different
+   * instance.
+   */
+  template<typename T>
+  class AliasRouletteWheelSelection {
+  public:
+
+    AliasRouletteWheelSelection(uint64_t seed) :
+      _rng(seed) {
+    }
+
+    /// This functor receives population ranks and returns selected couples
+    template<typename RankSequence>
+    std::vector<IndexCouple>
+    operator()(const RankSequence &ranks, size_t result_size) const {
+      return (*this)(ranks, result_size, nullptr);
+    }
+
+    /// Parallel version, pool is usually the ThreadPool of the solver
+    template<typename RankSequence>
+    std::vector<IndexCouple>
+    operator()(const RankSequence &ranks, size_t result_size,
+               ThreadPool *pool) const {
+      if (ranks.size() == 0u) return std::vector<IndexCouple>();
+      buildTable(ranks, pool);
+      std::vector<IndexCouple> result(result_size);
+      const size_t n = _prob.size();
+      const std::vector<double> &prob = _prob;
+      const std::vector<size_t> &alias = _alias;
+      sample_couples(result, _rng, pool, [&](CounterRng &rng) {
+          std::uniform_int_distribution<size_t> int_dist(0u, n - 1u);
+          std::uniform_real_distribution<double> real_dist(0.0, 1.0);
+          size_t i = int_dist(rng);
+          return (real_dist(rng) < prob[i]) ? i : alias[i];
+        });
+      return result;
+    }
+
+    /// Restarts the random sequence of this functor with the given seed
+    void seed(uint64_t seed) {
+      _rng.seed(seed);
+    }
+
+    /// Moves to the random stream of (generation, individual), see counter_rng.h
+    void stream(uint64_t generation, uint64_t individual) const {
+      _rng.stream(generation, individual, RandomStream::SELECTION);
+    }
+
+  private:
+    mutable CounterRng _rng;
+    /// buffers reused between generations
+    mutable std::vector<T> _weights;
+    mutable std::vector<double> _prob;
+    mutable std::vector<double> _sums;
+    mutable std::vector<size_t> _alias;
+    mutable std::vector<size_t> _small, _large;
+
+    /// Vose's alias method, O(n) time
+    template<typename RankSequence>
+    void buildTable(const RankSequence &ranks, ThreadPool *pool) const {
+      rank_weights(ranks, _weights, pool);
+      const size_t n = _weights.size();
+      const size_t num_chunks = (n + SELECTION_RANKS_GRAIN - 1u) / SELECTION_RANKS_GRAIN;
+      _prob.resize(n);
+      _alias.resize(n);
+      _sums.assign(num_chunks, 0.0);
+      // sums by chunks, so the total doesn't depend on the number of workers
+      auto chunk_sum = [&](size_t, size_t begin, size_t end) {
+        for (size_t c=begin; c<end; ++c) {
+          const size_t last = std::min(n, (c+1u)*SELECTION_RANKS_GRAIN);
+          for (size_t i=c*SELECTION_RANKS_GRAIN; i<last; ++i) _sums[c] += _weights[i];
+        }
+      };
+      if (pool != nullptr) pool->parallel_for(num_chunks, 1u, chunk_sum);
+      else chunk_sum(0u, 0u, num_chunks);
+      const double total = std::accumulate(_sums.begin(), _sums.end(), 0.0);
+      auto normalize = [&](size_t, size_t begin, size_t end) {
+        for (size_t i=begin; i<end; ++i) {
+          // all weights zero means uniform selection
+          _prob[i] = (total > 0.0) ? double(_weights[i]) * n / total : 1.0;
+          _alias[i] = i;
+        }
+      };
+      if (pool != nullptr) pool->parallel_for(n, SELECTION_RANKS_GRAIN, normalize);
+      else normalize(0u, 0u, n);
+      _small.clear();
+      _large.clear();
+      for (size_t i=0; i<n; ++i) {
+        if (_prob[i] < 1.0) _small.push_back(i);
+        else _large.push_back(i);
+      }
+      while (!_small.empty() && !_large.empty()) {
+        size_t s = _small.back(); _small.pop_back();
+        size_t l = _large.back();
+        _alias[s] = l;
+        _prob[l] = (_prob[l] + _prob[s]) - 1.0;
+        if (_prob[l] < 1.0) {
+          _large.pop_back();
+          _small.push_back(l);
+        }
+      }
+      // remaining entries are 1.0 up to rounding errors
+      for (size_t i : _small) _prob[i] = 1.0;
+      for (size_t i : _large) _prob[i] = 1.0;
+    }
+  }; // class AliasRouletteWheelSelection
+
+  typedef AliasRouletteWheelSelection<float> FloatAliasRouletteWheelSelection;
+  typedef AliasRouletteWheelSelection<double> DoubleAliasRouletteWheelSelection;
+
+  /**
+   * Stochastic universal sampling over rank weights
+   *
+   * All parents are chosen with a single random draw: 2*result_size
+   * equally spaced pointers are placed over the cumulative weights,
+   * starting at a random offset. Every subject is selected a number of
+   * times as close as possible to its expected value, so it has lower
+   * variance than a roulette wheel. Selected parents are shuffled
+   * before pairing them into couples.
+   *
+   * The cumulative weights are computed with a parallel prefix sum
+   * and the pointers are resolved in parallel when a ThreadPool is
+   * given.
+   *
+   * ATTENTION: this class is not thread safe, if you need to use it
+   * on different threads, be sure each thread receives a different
+   * instance.
+   */
+  template<typename T>
+  class StochasticUniversalSampling {
+  public:
+
+    StochasticUniversalSampling(uint64_t seed) :
+      _rng(seed) {
+    }
+
+    /// This functor receives population ranks and returns selected couples
+    template<typename RankSequence>
+    std::vector<IndexCouple>
+    operator()(const RankSequence &ranks, size_t result_size) const {
+      return (*this)(ranks, result_size, nullptr);
+    }
+
+    /// Parallel version, pool is usually the ThreadPool of the solver
+    template<typename RankSequence>
+    std::vector<IndexCouple>
+    operator()(const RankSequence &ranks, size_t result_size,
+               ThreadPool *pool) const {
+      rank_weights(ranks, _weights, pool);
+      const size_t n = _weights.size();
+      if (n == 0u || result_size == 0u) return std::vector<IndexCouple>();
+      _cumulative.resize(n);
+      double total = parallel_inclusive_scan(pool, _weights.data(),
+                                             _cumulative.data(), n,
+                                             SELECTION_RANKS_GRAIN);
+      if (!(total > 0.0)) {
+        // all weights zero means uniform selection
+        std::fill(_weights.begin(), _weights.end(), 1.0);
+        total = parallel_inclusive_scan(pool, _weights.data(),
+                                        _cumulative.data(), n,
+                                        SELECTION_RANKS_GRAIN);
+      }
+      const size_t M = 2u * result_size;
+      const double step = total / M;
+      std::uniform_real_distribution<double> dist(0.0, step);
+      const double start = dist(_rng);
+      _picks.resize(M);
+      // subject i owns pointers k with cumulative[i-1] <= start+k*step < cumulative[i]
+      auto first_pointer = [&](size_t i) -> size_t {
+        if (i == 0u) return 0u;
+        if (i == n) return M;
+        double k = std::ceil((_cumulative[i - 1u] - start) / step);
+        return static_cast<size_t>(std::min(double(M), std::max(0.0, k)));
+      };
+      auto resolve = [&](size_t, size_t begin, size_t end) {
+        for (size_t i=begin; i<end; ++i) {
+          for (size_t k=first_pointer(i); k<first_pointer(i + 1u); ++k) {
+            _picks[k] = i;
+          }
+        }
+      };
+      if (pool != nullptr) pool->parallel_for(n, SELECTION_RANKS_GRAIN, resolve);
+      else resolve(0u, 0u, n);
+      std::shuffle(_picks.begin(), _picks.end(), _rng);
+      std::vector<IndexCouple> result(result_size);
+      for (size_t i=0; i<result_size; ++i) {
+        result[i] = IndexCouple(_picks[2u*i], _picks[2u*i + 1u]);
+      }
+      return result;
+    }
+
+    /// Restarts the random sequence of this functor with the given seed
+    void seed(uint64_t seed) {
+      _rng.seed(seed);
+    }
+
+    /// Moves to the random stream of (generation, individual), see counter_rng.h
+    void stream(uint64_t generation, uint64_t individual) const {
+      _rng.stream(generation, individual, RandomStream::SELECTION);
+    }
+
+  private:
+    mutable CounterRng _rng;
+    /// buffers reused between generations
+    mutable std::vector<double> _weights;
+    mutable std::vector<double> _cumulative;
+    mutable std::vector<size_t> _picks;
+  }; // class StochasticUniversalSampling
+
+  typedef StochasticUniversalSampling<float> FloatStochasticUniversalSampling;
+  typedef StochasticUniversalSampling<double> DoubleStochasticUniversalSampling;
+
+  /**
+   * A k-tournament selection
+   *
+   * Every parent is the best of k subjects drawn uniformly at random
+   * from the population. It only compares ranks, so they don't need
+   * to be positive nor normalized, and k controls the selection
+   * pressure. Couples are sampled in parallel when a ThreadPool is
+   * given.
+   *
+   * ATTENTION: this class is not thread safe, if you need to use it
+   * on different threads, be sure each thread receives a different
+   * instance.
+   */
+  class TournamentSelection {
+  public:
+
+    TournamentSelection(uint64_t seed, size_t k=2u) :
+      _rng(seed),
+      _k(std::max<size_t>(k, 1u)) {
+    }
+
+    /// This functor receives population ranks and returns selected couples
+    template<typename RankSequence>
+    std::vector<IndexCouple>
+    operator()(const RankSequence &ranks, size_t result_size) const {
+      return (*this)(ranks, result_size, nullptr);
+    }
+
+    /// Parallel version, pool is usually the ThreadPool of the solver
+    template<typename RankSequence>
+    std::vector<IndexCouple>
+    operator()(const RankSequence &ranks, size_t result_size,
+               ThreadPool *pool) const {
+      const size_t n = ranks.size();
+      if (n == 0u) return std::vector<IndexCouple>();
+      std::vector<IndexCouple> result(result_size);
+      const size_t k = _k;
+      sample_couples(result, _rng, pool, [&](CounterRng &rng) {
+          std::uniform_int_distribution<size_t> int_dist(0u, n - 1u);
+          size_t best = int_dist(rng);
+          for (size_t j=1u; j<k; ++j) {
+            size_t i = int_dist(rng);
+            if (ranks[best] < ranks[i]) best = i;
+          }
+          return best;
+        });
+      return result;
+    }
+
+    /// Restarts the random sequence of this functor with the given seed
+    void seed(uint64_t seed) {
+      _rng.seed(seed);
+    }
+
+    /// Moves to the random stream of (generation, individual), see counter_rng.h
+    void stream(uint64_t generation, uint64_t individual) const {
+      _rng.stream(generation, individual, RandomStream::SELECTION);
+    }
+
+  private:
+    mutable CounterRng _rng;
+    const size_t _k;
+  }; // class TournamentSelection
   
 } // namespace GeneticAlgorithms
 
@@ -0,0 +1,129 @@
+/*
+ * This file is part of GeneticAlgorithms toolkit
+ *
+ * Copyright 2017, Francisco Zamora-Martinez
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef SERIALIZATION_H
+#define SERIALIZATION_H
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "chromosome.h"
+
+namespace GeneticAlgorithms {
+
+  /**
+   * Appends plain values and chromosome records to a byte buffer
+   *
+   * Values are written with their native representation, so buffers
+   * are meant to be read by the same build on the same kind of
+   * machine (e.g. processes of the same run). A chromosome record is
+   * the number of gens as uint64_t, followed by the rank and by the
+   * gens words, with no padding.
+   */
+  class BinaryWriter {
+  public:
+    explicit BinaryWriter(std::vector<char> &buffer) :
+      _buffer(buffer) {
+    }
+
+    template<typename V>
+    void write(const V &value) {
+      static_assert(std::is_trivially_copyable<V>::value,
+                    "BinaryWriter only writes trivially copyable values");
+      writeBytes(&value, sizeof(V));
+    }
+
+    void writeBytes(const void *data, const size_t n) {
+      const char *p = static_cast<const char*>(data);
+      _buffer.insert(_buffer.end(), p, p + n);
+    }
+
+    /// Writes a chromosome record
+    template<typename ChromosomeType, typename T>
+    void writeRecord(const ChromosomeType &x, const T &rank) {
+      write(static_cast<uint64_t>(x.size()));
+      write(rank);
+      writeBytes(x.blocks(), x.num_blocks() * sizeof(block_type));
+    }
+
+  private:
+    std::vector<char> &_buffer;
+  }; // class BinaryWriter
+
+  /**
+   * Reads values written by BinaryWriter
+   *
+   * All methods throw std::runtime_error when the buffer is too short.
+   */
+  class BinaryReader {
+  public:
+    BinaryReader(const char *data, const size_t size) :
+      _pos(data),
+      _end(data + size) {
+    }
+
+    template<typename V>
+    V read() {
+      static_assert(std::is_trivially_copyable<V>::value,
+                    "BinaryReader only reads trivially copyable values");
+      V value;
+      readBytes(&value, sizeof(V));
+      return value;
+    }
+
+    void readBytes(void *data, const size_t n) {
+      if (static_cast<size_t>(_end - _pos) < n) {
+        throw std::runtime_error("Truncated binary data");
+      }
+      std::memcpy(data, _pos, n);
+      _pos += n;
+    }
+
+    /// Reads a chromosome record
+    template<typename ChromosomeType, typename T>
+    void readRecord(ChromosomeType &x, T &rank) {
+      const size_t num_gens = static_cast<size_t>(read<uint64_t>());
+      rank = read<T>();
+      x = ChromosomeType(num_gens);
+      readBytes(x.blocks(), x.num_blocks() * sizeof(block_type));
+    }
+
+    bool empty() const {
+      return _pos == _end;
+    }
+
+  private:
+    const char *_pos;
+    const char *_end;
+  }; // class BinaryReader
+
+} // namespace GeneticAlgorithms
+
+#endif // SERIALIZATION_H
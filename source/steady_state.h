@@ -0,0 +1,475 @@
+/*
+ * This file is part of GeneticAlgorithms toolkit
+ *
+ * Copyright 2017, Francisco Zamora-Martinez
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef STEADY_STATE_H
+#define STEADY_STATE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+#include "breeding.h"
+#include "chromosome.h"
+#include "lsh.h"
+#include "niching.h"
+#include "population.h"
+#include "seeding.h"
+#include "thread_pool.h"
+
+namespace GeneticAlgorithms {
+
+  /// Which individual leaves the population when a child is inserted
+  enum class ReplacementPolicy {
+    WORST,            ///< the individual with the lowest rank
+    OLDEST,           ///< the individual inserted longer ago
+    TOURNAMENT_LOSER, ///< the lowest rank of a few random individuals
+    CROWDING          ///< the closest individual, only when the child is better
+  };
+
+  /// Configuration of solve_steady_state()
+  struct SteadyStateConfig {
+    ReplacementPolicy replacement;
+    /// Number of individuals which compete in TOURNAMENT_LOSER
+    size_t tournament_size;
+    /// Number of workers, including the calling thread
+    size_t num_threads;
+    /// Seed used to derive the seeds of the operators of every worker
+    uint64_t seed;
+    /// Population size from which CROWDING finds neighbors with LSH
+    size_t lsh_threshold;
+    /// Number of couples selected at once by every worker
+    size_t selection_batch;
+
+    SteadyStateConfig() :
+      replacement(ReplacementPolicy::WORST),
+      tournament_size(2u),
+      num_threads(1u),
+      seed(0u),
+      lsh_threshold(2048u),
+      selection_batch(32u) {
+    }
+  }; // struct SteadyStateConfig
+
+  /**
+   * Selects couples for a steady-state worker, out of the mutex
+   *
+   * Only the ranks are copied under the mutex, and the selection,
+   * which may build tables of the size of the population, runs over
+   * the copy.
+   */
+  template<typename PopulationType, typename SelectionFunctor, typename T>
+  void steady_state_select(const PopulationType &population,
+                           const SelectionFunctor &select_func,
+                           const size_t result_size, std::mutex &mutex,
+                           std::vector<T> &ranks,
+                           std::vector<IndexCouple> &couples, std::false_type) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      ranks.assign(population.ranks().begin(), population.ranks().end());
+    }
+    couples = select_func(ranks, result_size);
+  }
+
+  /// Selection functors which receive the population select under the mutex
+  template<typename PopulationType, typename SelectionFunctor, typename T>
+  void steady_state_select(const PopulationType &population,
+                           const SelectionFunctor &select_func,
+                           const size_t result_size, std::mutex &mutex,
+                           std::vector<T> &,
+                           std::vector<IndexCouple> &couples, std::true_type) {
+    std::lock_guard<std::mutex> lock(mutex);
+    couples = population.select(select_func, result_size);
+  }
+
+  /**
+   * Indexed min-heap of the ranks of a population
+   *
+   * top() is the position with the lowest rank, ties won by the first
+   * position, and update() changes the rank of any position in
+   * O(log n), so WORST replacement doesn't scan the population.
+   */
+  template<typename T>
+  class RankHeap {
+  public:
+    template<typename RankSequence>
+    explicit RankHeap(const RankSequence &ranks) :
+      _ranks(ranks.begin(), ranks.end()),
+      _heap(_ranks.size()),
+      _slots(_ranks.size()) {
+      for (size_t i=0; i<_heap.size(); ++i) _heap[i] = _slots[i] = i;
+      for (size_t k=_heap.size()/2u; k>0u; --k) siftDown(k - 1u);
+    }
+
+    size_t size() const {
+      return _heap.size();
+    }
+
+    /// Position of the lowest rank
+    size_t top() const {
+      return _heap[0];
+    }
+
+    /// Position of the lowest rank besides top(), needs size() > 1
+    size_t second() const {
+      assert(_heap.size() > 1u);
+      return (_heap.size() > 2u && lower(2u, 1u)) ? _heap[2] : _heap[1];
+    }
+
+    /// Changes the rank of position i
+    void update(const size_t i, const T rank) {
+      _ranks[i] = rank;
+      siftUp(_slots[i]);
+      siftDown(_slots[i]);
+    }
+
+  private:
+    std::vector<T> _ranks;
+    /// Positions in heap order, and the slot of every position
+    std::vector<size_t> _heap;
+    std::vector<size_t> _slots;
+
+    bool lower(const size_t a, const size_t b) const {
+      const size_t i = _heap[a], j = _heap[b];
+      return _ranks[i] < _ranks[j] || (!(_ranks[j] < _ranks[i]) && i < j);
+    }
+
+    void swapSlots(const size_t a, const size_t b) {
+      std::swap(_heap[a], _heap[b]);
+      _slots[_heap[a]] = a;
+      _slots[_heap[b]] = b;
+    }
+
+    void siftUp(size_t k) {
+      while (k > 0u && lower(k, (k - 1u)/2u)) {
+        swapSlots(k, (k - 1u)/2u);
+        k = (k - 1u)/2u;
+      }
+    }
+
+    void siftDown(size_t k) {
+      for (;;) {
+        size_t m = k;
+        const size_t l = 2u*k + 1u, r = 2u*k + 2u;
+        if (l < _heap.size() && lower(l, m)) m = l;
+        if (r < _heap.size() && lower(r, m)) m = r;
+        if (m == k) return;
+        swapSlots(k, m);
+        k = m;
+      }
+    }
+  }; // class RankHeap
+
+  /**
+   * Copy of the gens of a population kept by a CROWDING worker
+   *
+   * The worker computes with measure() the distances from its child
+   * to all the rows of the copy out of the mutex. Under the mutex,
+   * nearest() copies the rows replaced since its last call, found at
+   * the log of replaced positions, and re-checks only their
+   * distances, so the mutex is never held for a full scan.
+   */
+  class CrowdingView {
+  public:
+    CrowdingView() : _stride(0u), _synced(0u), _nearest(NO_NEIGHBOR) {}
+
+    /// Copies all rows of population, the mutex should be locked
+    template<typename PopulationType>
+    void load(const PopulationType &population, const std::vector<size_t> &log) {
+      _stride = population.arena().stride();
+      _rows.assign(population.arena().data(),
+                   population.arena().data() + population.size()*_stride);
+      _distances.resize(population.size());
+      _synced = log.size();
+    }
+
+    /// Distances from x to every row of the copy, out of the mutex
+    void measure(const block_type *x, const size_t num_blocks) {
+      const size_t n = _distances.size();
+      BitKernels::hamming_rows(x, _rows.data(), _stride, n, num_blocks,
+                               _distances.data());
+      _nearest = (n > 0u) ? std::min_element(_distances.begin(), _distances.end()) -
+        _distances.begin() : NO_NEIGHBOR;
+    }
+
+    /**
+     * Position of the closest row to x, the one given to measure()
+     *
+     * The mutex should be locked. Ties are won by the first position,
+     * as at nearest_neighbor().
+     */
+    template<typename PopulationType>
+    size_t nearest(const PopulationType &population, const std::vector<size_t> &log,
+                   const block_type *x, const size_t num_blocks) {
+      bool rescan = false;
+      for (size_t k=_synced; k<log.size(); ++k) {
+        const size_t i = log[k];
+        const block_type *row = population.arena().data() + i*_stride;
+        std::copy(row, row + _stride, _rows.data() + i*_stride);
+        const uint32_t d = static_cast<uint32_t>(BitKernels::hamming(x, row, num_blocks));
+        const bool farther = (i == _nearest && _distances[i] < d);
+        _distances[i] = d;
+        if (farther) {
+          rescan = true;
+        }
+        else if (d < _distances[_nearest] || (d == _distances[_nearest] && i < _nearest)) {
+          _nearest = i;
+        }
+      }
+      _synced = log.size();
+      if (rescan) {
+        _nearest = std::min_element(_distances.begin(), _distances.end()) -
+          _distances.begin();
+      }
+      return _nearest;
+    }
+
+  private:
+    std::vector<block_type> _rows;
+    size_t _stride;
+    std::vector<uint32_t> _distances;
+    /// Number of entries of the log already copied
+    size_t _synced;
+    size_t _nearest;
+  }; // class CrowdingView
+
+  /**
+   * Asynchronous steady-state genetic algorithm
+   *
+   * Instead of breeding complete generations, every worker repeats
+   * independently: select two parents, breed one child, rank it and
+   * insert it into the population, replacing the individual chosen
+   * by config.replacement. There is no barrier between workers, so
+   * they stay busy even when ranking times vary a lot between
+   * individuals. Only copies of parents and insertion are done under
+   * a mutex, crossover, mutation and ranking run concurrently. The
+   * victim is chosen under the mutex in O(log N) for WORST (see
+   * RankHeap) and O(1) for OLDEST and TOURNAMENT_LOSER. The best
+   * individual never takes part: the next worst, the next oldest or a
+   * tournament among the others is chosen instead.
+   *
+   * Every worker selects config.selection_batch couples at once, over
+   * a copy of the ranks taken under the mutex, so the cost of building
+   * selection tables is paid once per batch and out of the mutex.
+   * Parents are copied when their child is bred, so they may have
+   * been replaced since the selection. Selection functors receiving
+   * the population (see uses_population at population.h) select
+   * under the mutex.
+   *
+   * num_evaluations is the total number of children, shared by all
+   * workers. The best individual is never replaced by a worse one
+   * (elitism), and it is returned at the end.
+   *
+   * With CROWDING, every child competes with the closest individual
+   * of the population by Hamming distance, and replaces it only when
+   * it is better, so niches far from the best one survive. Distances
+   * are computed out of the mutex against a copy of the population of
+   * every worker, and only rows replaced meanwhile are checked under
+   * the mutex (see CrowdingView). From config.lsh_threshold
+   * individuals, the closest one is searched among the candidates of
+   * a BitSamplingLSH (see lsh.h), which is updated at every
+   * replacement.
+   *
+   * Every worker uses its own copies of the given functors, reseeded
+   * from config.seed (see seeding.h). With more than one worker the
+   * result depends on threads scheduling.
+   *
+   * ATTENTION: functor copies run concurrently, so they should not
+   * share mutable state.
+   *
+   * @code
+   * SteadyStateConfig config;
+   * config.replacement = ReplacementPolicy::TOURNAMENT_LOSER;
+   * config.num_threads = 8;
+   * config.seed = rng();
+   * Chromosome best = solve_steady_state(config, 100000u, 100u,
+   *                                      RandomInitializer(N, rng(), 0.5f),
+   *                                      TournamentSelection(rng(), 2),
+   *                                      RandomSplitCrossOver(N, rng()),
+   *                                      RandomMutate(rng(), 0.01f),
+   *                                      MyRank());
+   * @endcode
+   */
+  template<typename InitializerFunctor,
+           typename SelectionFunctor,
+           typename CrossOverFunctor,
+           typename MutationFunctor,
+           typename RankFunctor,
+           typename T=float,
+           typename ChromosomeType=typename std::decay<
+             decltype(std::declval<const InitializerFunctor&>()())>::type>
+  ChromosomeType solve_steady_state(const SteadyStateConfig &config,
+                                    const size_t num_evaluations,
+                                    const size_t population_size,
+                                    const InitializerFunctor &init_func,
+                                    const SelectionFunctor &select_func,
+                                    const CrossOverFunctor &cross_over_func,
+                                    const MutationFunctor &mutate_func,
+                                    const RankFunctor &rank_func) {
+    ThreadPool pool(config.num_threads);
+    Population<RankFunctor, T, ChromosomeType> population(rank_func, &pool);
+    population.init(init_func, population_size);
+    // the population is used from the workers of the pool
+    population.setPool(nullptr);
+
+    const size_t N = population.size();
+    const size_t num_gens = population.chromosome(0u).size();
+    const std::vector<T> &ranks = population.ranks();
+    size_t best = std::max_element(ranks.begin(), ranks.end()) - ranks.begin();
+    size_t oldest = 0u;
+    std::mutex mutex;
+    std::atomic<size_t> next(0u);
+
+    const size_t selection_batch = std::max<size_t>(config.selection_batch, 1u);
+
+    // neighbors index of CROWDING, positions are ids
+    const bool crowding = (config.replacement == ReplacementPolicy::CROWDING);
+    std::unique_ptr<BitSamplingLSH> lsh;
+    if (crowding && N >= config.lsh_threshold) {
+      lsh.reset(new BitSamplingLSH(num_gens, 8u,
+                                   BitSamplingLSH::key_bits_for(num_gens, 0.1*num_gens),
+                                   derive_seed(config.seed, 5u*pool.size())));
+      for (size_t i=0; i<N; ++i) lsh->insert(i, population.chromosome(i).blocks());
+    }
+    std::vector<uint32_t> distances;
+    std::vector<size_t> ids;
+    // positions replaced in order, for the CrowdingView of every worker
+    const bool crowding_views = (crowding && !lsh);
+    std::vector<size_t> crowding_log;
+    const bool worst = (config.replacement == ReplacementPolicy::WORST);
+    std::unique_ptr<RankHeap<T> > heap;
+    if (worst) heap.reset(new RankHeap<T>(ranks));
+
+    // position of the individual to be replaced, mutex should be locked
+    auto victim = [&](std::mt19937_64 &rng, const ChromosomeType &child,
+                      CrowdingView &view) -> size_t {
+      size_t i = 0u;
+      switch (config.replacement) {
+      case ReplacementPolicy::WORST:
+        i = heap->top();
+        if (i == best && N > 1u) i = heap->second();
+        break;
+      case ReplacementPolicy::OLDEST:
+        // every insertion makes the oldest one the youngest, so the
+        // oldest position just goes round
+        if (oldest == best && N > 1u) oldest = (oldest + 1u) % N;
+        i = oldest;
+        oldest = (oldest + 1u) % N;
+        break;
+      case ReplacementPolicy::TOURNAMENT_LOSER:
+        if (N > 1u) {
+          // the best one doesn't compete, draws skip its position
+          auto draw = [&]() {
+            const size_t k = rng() % (N - 1u);
+            return (k < best) ? k : k + 1u;
+          };
+          i = draw();
+          for (size_t j=1u; j<config.tournament_size; ++j) {
+            const size_t k = draw();
+            if (ranks[k] < ranks[i]) i = k;
+          }
+        }
+        break;
+      case ReplacementPolicy::CROWDING:
+        // the best one is protected because only better children replace
+        if (crowding_views) {
+          i = view.nearest(population, crowding_log, child.blocks(), child.num_blocks());
+        }
+        else {
+          i = nearest_neighbor(population, child, lsh.get(), distances, ids);
+        }
+        break;
+      }
+      return i;
+    };
+
+    auto work = [&](size_t worker, size_t, size_t) {
+      // every worker has its own operators, with independent seeds
+      SelectionFunctor select(select_func);
+      CrossOverFunctor cross_over(cross_over_func);
+      MutationFunctor mutate(mutate_func);
+      RankFunctor rank(rank_func);
+      reseed(select, derive_seed(config.seed, 4u*worker + 1u));
+      reseed(cross_over, derive_seed(config.seed, 4u*worker + 2u));
+      reseed(mutate, derive_seed(config.seed, 4u*worker + 3u));
+      std::mt19937_64 rng(derive_seed(config.seed, 4u*pool.size() + worker));
+      ChromosomeType first, second, child(num_gens);
+      std::vector<T> selection_ranks;
+      std::vector<IndexCouple> couples;
+      size_t num_used = 0u;
+      CrowdingView view;
+      if (crowding_views) {
+        std::lock_guard<std::mutex> lock(mutex);
+        view.load(population, crowding_log);
+      }
+      while (next.fetch_add(1u) < num_evaluations) {
+        if (num_used == couples.size()) {
+          steady_state_select(population, select, selection_batch, mutex,
+                              selection_ranks, couples,
+                              std::integral_constant<bool,
+                              uses_population<SelectionFunctor>::value>());
+          num_used = 0u;
+        }
+        const IndexCouple couple = couples[num_used++];
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          first = population.chromosome(couple.first);
+          second = population.chromosome(couple.second);
+        }
+        breed_into(cross_over, mutate, first, second, child);
+        const T r = rank(child);
+        if (crowding_views) view.measure(child.blocks(), child.num_blocks());
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          const size_t i = victim(rng, child, view);
+          if (i == best && !(ranks[best] < r)) continue;
+          if (crowding && !(ranks[i] < r)) continue;
+          if (lsh) {
+            lsh->erase(i, population.chromosome(i).blocks());
+            lsh->insert(i, child.blocks());
+          }
+          population.replace(i, child, r);
+          if (heap) heap->update(i, r);
+          if (crowding_views) crowding_log.push_back(i);
+          if (ranks[best] < r) best = i;
+        }
+      }
+    };
+    // one long running task per worker, all of them share next counter
+    pool.parallel_for(pool.size(), 1u, work);
+
+    return population.chromosome(best);
+  }
+
+} // namespace GeneticAlgorithms
+
+#endif // STEADY_STATE_H
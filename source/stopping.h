@@ -0,0 +1,281 @@
+/*
+ * This file is part of GeneticAlgorithms toolkit
+ *
+ * Copyright 2017, Francisco Zamora-Martinez
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef STOPPING_H
+#define STOPPING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <type_traits>
+
+namespace GeneticAlgorithms {
+
+  /// State of a run, checked by stopping criteria after every generation
+  struct SolverProgress {
+    /// Generations done, including the ones restored from a checkpoint
+    uint64_t generation;
+    /// Chromosomes ranked by the RankFunctor in this run, FitnessCache
+    /// hits excluded (see Population::numEvaluations())
+    uint64_t evaluations;
+    /// Wall time since this run started, in seconds
+    double seconds;
+    double best_rank;
+    /// Generations since the best rank was improved for the last time
+    uint64_t stagnant_generations;
+    /// Mean pairwise Hamming distance per gen (see diversity.h), only
+    /// computed when the criterion declares uses_diversity=true
+    double diversity;
+  }; // struct SolverProgress
+
+  /// How a run of solve_until() finished
+  struct StopReport {
+    /// Description of the criterion which fired, as "Stagnation(50)"
+    std::string reason;
+    uint64_t generations;
+    uint64_t evaluations;
+    double seconds;
+  }; // struct StopReport
+
+  /**
+   * Base of all stopping criteria, needed to compose them
+   *
+   * A criterion implements a const operator() which receives a
+   * SolverProgress and returns true when the run must stop, and
+   * reason() which describes why it stopped. It declares a static
+   * constant uses_diversity, and only when it is true the solver
+   * computes the diversity of every generation.
+   *
+   * Criteria are composed with || (any of them) and && (all of
+   * them):
+   *
+   * @code
+   * StopReport report;
+   * solve_until((Stagnation(50u) && MaxGenerations(200u)) ||
+   *             WallClock(60.0) || TargetFitness(100.0),
+   *             population_size, ..., &report);
+   * std::cout << report.reason << std::endl;
+   * @endcode
+   */
+  struct StoppingCriterion {
+  }; // struct StoppingCriterion
+
+  /// Describes a criterion as its name followed by its argument
+  template<typename A>
+  std::string criterion_reason(const char *name, const A &arg) {
+    std::ostringstream out;
+    out << name << "(" << arg << ")";
+    return out.str();
+  }
+
+  /// Stops after the given number of generations
+  class MaxGenerations : public StoppingCriterion {
+  public:
+    static const bool uses_diversity = false;
+
+    explicit MaxGenerations(const uint64_t generations) : _generations(generations) {}
+
+    bool operator()(const SolverProgress &p) const {
+      return p.generation >= _generations;
+    }
+
+    std::string reason(const SolverProgress &) const {
+      return criterion_reason("MaxGenerations", _generations);
+    }
+
+  private:
+    uint64_t _generations;
+  }; // class MaxGenerations
+
+  /// Stops when the RankFunctor has been called the given number of times
+  class MaxEvaluations : public StoppingCriterion {
+  public:
+    static const bool uses_diversity = false;
+
+    explicit MaxEvaluations(const uint64_t evaluations) : _evaluations(evaluations) {}
+
+    bool operator()(const SolverProgress &p) const {
+      return p.evaluations >= _evaluations;
+    }
+
+    std::string reason(const SolverProgress &) const {
+      return criterion_reason("MaxEvaluations", _evaluations);
+    }
+
+  private:
+    uint64_t _evaluations;
+  }; // class MaxEvaluations
+
+  /**
+   * Stops when the given wall time, in seconds, has passed
+   *
+   * It is checked between generations, so the run takes the budget
+   * plus at most the time of one generation.
+   */
+  class WallClock : public StoppingCriterion {
+  public:
+    static const bool uses_diversity = false;
+
+    explicit WallClock(const double seconds) : _seconds(seconds) {}
+
+    bool operator()(const SolverProgress &p) const {
+      return p.seconds >= _seconds;
+    }
+
+    std::string reason(const SolverProgress &) const {
+      return criterion_reason("WallClock", _seconds);
+    }
+
+  private:
+    double _seconds;
+  }; // class WallClock
+
+  /// Stops when the best rank reaches the given one (maximization)
+  class TargetFitness : public StoppingCriterion {
+  public:
+    static const bool uses_diversity = false;
+
+    explicit TargetFitness(const double target) : _target(target) {}
+
+    bool operator()(const SolverProgress &p) const {
+      return p.best_rank >= _target;
+    }
+
+    std::string reason(const SolverProgress &) const {
+      return criterion_reason("TargetFitness", _target);
+    }
+
+  private:
+    double _target;
+  }; // class TargetFitness
+
+  /// Stops when the best rank hasn't improved for the given generations
+  class Stagnation : public StoppingCriterion {
+  public:
+    static const bool uses_diversity = false;
+
+    explicit Stagnation(const uint64_t generations) : _generations(generations) {}
+
+    bool operator()(const SolverProgress &p) const {
+      return p.stagnant_generations >= _generations;
+    }
+
+    std::string reason(const SolverProgress &) const {
+      return criterion_reason("Stagnation", _generations);
+    }
+
+  private:
+    uint64_t _generations;
+  }; // class Stagnation
+
+  /**
+   * Stops when the diversity falls to the given value or below
+   *
+   * Diversity is the mean pairwise Hamming distance per gen, 0 when
+   * all chromosomes are equal and around 0.5 for random ones.
+   */
+  class DiversityCollapse : public StoppingCriterion {
+  public:
+    static const bool uses_diversity = true;
+
+    explicit DiversityCollapse(const double min_diversity) :
+      _min_diversity(min_diversity) {}
+
+    bool operator()(const SolverProgress &p) const {
+      return p.diversity <= _min_diversity;
+    }
+
+    std::string reason(const SolverProgress &) const {
+      return criterion_reason("DiversityCollapse", _min_diversity);
+    }
+
+  private:
+    double _min_diversity;
+  }; // class DiversityCollapse
+
+  /// Stops when any of both criteria fires, reporting the first one
+  template<typename A, typename B>
+  class AnyOf : public StoppingCriterion {
+  public:
+    static const bool uses_diversity = A::uses_diversity || B::uses_diversity;
+
+    AnyOf(const A &a, const B &b) : _a(a), _b(b) {}
+
+    bool operator()(const SolverProgress &p) const {
+      return _a(p) || _b(p);
+    }
+
+    std::string reason(const SolverProgress &p) const {
+      return _a(p) ? _a.reason(p) : _b.reason(p);
+    }
+
+  private:
+    A _a;
+    B _b;
+  }; // class AnyOf
+
+  /// Stops when both criteria fire
+  template<typename A, typename B>
+  class AllOf : public StoppingCriterion {
+  public:
+    static const bool uses_diversity = A::uses_diversity || B::uses_diversity;
+
+    AllOf(const A &a, const B &b) : _a(a), _b(b) {}
+
+    bool operator()(const SolverProgress &p) const {
+      return _a(p) && _b(p);
+    }
+
+    std::string reason(const SolverProgress &p) const {
+      return "(" + _a.reason(p) + " and " + _b.reason(p) + ")";
+    }
+
+  private:
+    A _a;
+    B _b;
+  }; // class AllOf
+
+  template<typename A, typename B>
+  typename std::enable_if<std::is_base_of<StoppingCriterion, A>::value &&
+                          std::is_base_of<StoppingCriterion, B>::value,
+                          AnyOf<A, B> >::type
+  operator||(const A &a, const B &b) {
+    return AnyOf<A, B>(a, b);
+  }
+
+  template<typename A, typename B>
+  typename std::enable_if<std::is_base_of<StoppingCriterion, A>::value &&
+                          std::is_base_of<StoppingCriterion, B>::value,
+                          AllOf<A, B> >::type
+  operator&&(const A &a, const B &b) {
+    return AllOf<A, B>(a, b);
+  }
+
+} // namespace GeneticAlgorithms
+
+#endif // STOPPING_H
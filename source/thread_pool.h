@@ -0,0 +1,276 @@
+/*
+ * This file is part of GeneticAlgorithms toolkit
+ *
+ * Copyright 2017, Francisco Zamora-Martinez
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace GeneticAlgorithms {
+
+  /**
+   * Scoped guard which joins a set of threads
+   *
+   * Threads are started through start(), and all of them are joined
+   * by join() or, at the latest, by the destructor, after calling the
+   * given stop function to make them finish. So when starting a thread
+   * throws, or an exception leaves the scope, the threads already
+   * started are joined during the unwinding instead of calling
+   * std::terminate.
+   *
+   * The stop function and everything used by the threads should be
+   * declared before the guard, so they outlive the threads.
+   */
+  class ThreadJoiner {
+  public:
+    explicit ThreadJoiner(const std::function<void()> &stop=std::function<void()>()) :
+      _stop(stop) {
+    }
+
+    ~ThreadJoiner() {
+      join();
+    }
+
+    ThreadJoiner(const ThreadJoiner &) = delete;
+    ThreadJoiner &operator=(const ThreadJoiner &) = delete;
+
+    /// Starts a std::thread with the given function and arguments
+    template<typename... Args>
+    void start(Args&&... args) {
+      _threads.emplace_back(std::forward<Args>(args)...);
+    }
+
+    /// Calls the stop function and joins all threads started so far
+    void join() {
+      if (_threads.empty()) return;
+      if (_stop) _stop();
+      for (std::thread &th : _threads) th.join();
+      _threads.clear();
+    }
+
+    void reserve(const size_t n) {
+      _threads.reserve(n);
+    }
+
+  private:
+    std::function<void()> _stop;
+    std::vector<std::thread> _threads;
+  }; // class ThreadJoiner
+
+  /**
+   * A fixed set of worker threads for data parallel loops
+   *
+   * The pool is created once and reused for every parallel loop, so
+   * no thread is created or destroyed in the hot path of a genetic
+   * algorithm. The calling thread participates as worker 0, so a pool
+   * of size 1 doesn't create any thread and runs everything inline.
+   *
+   * Loop iterations are distributed dynamically: every worker grabs
+   * the next chunk of `grain` iterations from a shared atomic counter
+   * when it finishes the previous one. This keeps all workers busy
+   * even when the cost of each iteration varies a lot.
+   *
+   * ATTENTION: parallel_for() is not reentrant, it should be called
+   * from one thread at a time.
+   *
+   * @code
+   * ThreadPool pool(8);
+   * pool.parallel_for(v.size(), 1u,
+   *                   [&](size_t worker, size_t begin, size_t end) {
+   *                     for (size_t i=begin; i<end; ++i) v[i] = f(i);
+   *                   });
+   * @endcode
+   */
+  class ThreadPool {
+  public:
+    /// Receives the total number of workers, including the caller
+    explicit ThreadPool(size_t num_threads=1u) :
+      _num_workers(std::max<size_t>(num_threads, 1u)),
+      _job_id(0u),
+      _pending(0u),
+      _stop(false),
+      _threads([this]() {
+          {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+          }
+          _job_cv.notify_all();
+        }) {
+      _threads.reserve(_num_workers - 1u);
+      for (size_t w=1u; w<_num_workers; ++w) {
+        _threads.start(&ThreadPool::workerLoop, this, w);
+      }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /// Number of workers, including the calling thread
+    size_t size() const {
+      return _num_workers;
+    }
+
+    /**
+     * Executes func(worker, begin, end) over [0,n) in chunks
+     *
+     * The worker argument is in range [0,size()) and it is unique
+     * among concurrently running calls, so it can be used to index
+     * per-worker state. When grain is 0 a chunk size is computed from
+     * n and the number of workers. Exceptions thrown by func are
+     * propagated to the caller once all workers have finished.
+     */
+    template<typename F>
+    void parallel_for(size_t n, size_t grain, F func) {
+      if (n == 0u) return;
+      if (grain == 0u) grain = std::max<size_t>(1u, n / (_num_workers * 16u));
+      if (_num_workers == 1u || n <= grain) {
+        func(0u, 0u, n);
+        return;
+      }
+      std::atomic<size_t> next(0u);
+      std::function<void(size_t)> job = [&](size_t worker) {
+        size_t begin;
+        while ((begin = next.fetch_add(grain)) < n) {
+          func(worker, begin, std::min(begin + grain, n));
+        }
+      };
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _job = &job;
+        _error = nullptr;
+        _pending = _num_workers - 1u;
+        ++_job_id;
+      }
+      _job_cv.notify_all();
+      runJob(job, 0u);
+      std::unique_lock<std::mutex> lock(_mutex);
+      _done_cv.wait(lock, [this]{ return _pending == 0u; });
+      _job = nullptr;
+      if (_error) std::rethrow_exception(_error);
+    }
+
+  private:
+    const size_t _num_workers;
+    std::mutex _mutex;
+    std::condition_variable _job_cv;
+    std::condition_variable _done_cv;
+    std::function<void(size_t)> *_job;
+    size_t _job_id;
+    size_t _pending;
+    bool _stop;
+    std::exception_ptr _error;
+    /// Declared last, so workers are joined before the rest is destroyed
+    ThreadJoiner _threads;
+
+    void runJob(const std::function<void(size_t)> &job, size_t worker) {
+      try {
+        job(worker);
+      }
+      catch (...) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_error) _error = std::current_exception();
+      }
+    }
+
+    void workerLoop(size_t worker) {
+      size_t last_job_id = 0u;
+      for (;;) {
+        std::function<void(size_t)> *job;
+        {
+          std::unique_lock<std::mutex> lock(_mutex);
+          _job_cv.wait(lock, [&]{ return _stop || _job_id != last_job_id; });
+          if (_stop) return;
+          last_job_id = _job_id;
+          job = _job;
+        }
+        runJob(*job, worker);
+        {
+          std::lock_guard<std::mutex> lock(_mutex);
+          --_pending;
+        }
+        _done_cv.notify_one();
+      }
+    }
+  }; // class ThreadPool
+
+  /**
+   * Inclusive prefix sum of in[0,n) into out[0,n)
+   *
+   * The input is split in blocks of grain elements. Block sums are
+   * computed in parallel, scanned, and used as offsets of a second
+   * parallel pass. Results only depend on grain, not on the number of
+   * workers, so they are reproducible. When pool is nullptr the same
+   * computation is done by the calling thread. It returns the total
+   * sum.
+   */
+  template<typename T>
+  T parallel_inclusive_scan(ThreadPool *pool, const T *in, T *out,
+                            const size_t n, const size_t grain=32768u) {
+    if (n == 0u) return T();
+    const size_t num_chunks = (n + grain - 1u) / grain;
+    std::vector<T> offsets(num_chunks, T());
+    auto chunk_sums = [&](size_t, size_t begin, size_t end) {
+      for (size_t c=begin; c<end; ++c) {
+        T sum = T();
+        for (size_t i=c*grain; i<std::min(n, (c+1u)*grain); ++i) sum += in[i];
+        offsets[c] = sum;
+      }
+    };
+    auto chunk_scans = [&](size_t, size_t begin, size_t end) {
+      for (size_t c=begin; c<end; ++c) {
+        T sum = offsets[c];
+        for (size_t i=c*grain; i<std::min(n, (c+1u)*grain); ++i) {
+          sum += in[i];
+          out[i] = sum;
+        }
+      }
+    };
+    if (pool != nullptr) pool->parallel_for(num_chunks, 1u, chunk_sums);
+    else chunk_sums(0u, 0u, num_chunks);
+    // exclusive scan of chunk sums
+    T acc = T();
+    for (size_t c=0; c<num_chunks; ++c) {
+      T x = offsets[c];
+      offsets[c] = acc;
+      acc += x;
+    }
+    if (pool != nullptr) pool->parallel_for(num_chunks, 1u, chunk_scans);
+    else chunk_scans(0u, 0u, num_chunks);
+    return out[n - 1u];
+  }
+
+} // namespace GeneticAlgorithms
+
+#endif // THREAD_POOL_H
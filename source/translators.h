@@ -29,8 +29,13 @@
 #define TRANSLATORS_H
 
 #include <boost/dynamic_bitset.hpp>
+#include <cassert>
+#include <cstdint>
 #include <iostream>
+#include <tuple>
+#include <type_traits>
 
+#include "bit_kernels.h"
 #include "chromosome.h"
 
 namespace GeneticAlgorithms {
@@ -40,7 +45,12 @@ namespace GeneticAlgorithms {
    *
    * C++ types are represented on a fixed number of bits of the
    * gens. Each time a type is decoded, a position pointer is move
-   * forward, allowing to decode the next required bits.
+   * forward, allowing to decode the next required bits. Bits are
+   * extracted a word at a time, gen at the position pointer is the
+   * least significant bit of the decoded integer.
+   *
+   * The decoder is a view over the gens of the chromosome, nothing is
+   * copied, so the chromosome should live longer than the decoder.
    * 
    * ATTENTION: no thread safe object, it should be created for each
    * thread in your program.
@@ -62,32 +72,25 @@ namespace GeneticAlgorithms {
    */
   class Decoder {
   public:
-    Decoder(const Chromosome &chromosome) :
-      _gens(chromosome.gens()), _pos(0u) {
+    template<typename ChromosomeType>
+    Decoder(const ChromosomeType &chromosome) :
+      _blocks(chromosome.blocks()), _pos(0u) {
     }
 
     bool decodeBool() {
-      return _gens[_pos++];
+      return BitKernels::extract_bits(_blocks, _pos++, 1u) != 0u;
     }
 
+    /// Decodes an unsigned integer of n bits, with n in [0,64]
     uint64_t decodeUInt64(const size_t n) {
-      uint64_t x = 0u;
-      size_t i = _pos, j = _pos + n - 1;
-      for (size_t k=j+1u; k>i; --k) {
-        x = (x<<1uL) | static_cast<uint64_t>(_gens[k-1]);
-      }
+      uint64_t x = BitKernels::extract_bits(_blocks, _pos, n);
       _pos += n;
       return x;
     }
-    
+
+    /// Decodes an unsigned integer of n bits, with n in [0,32]
     uint32_t decodeUInt32(const size_t n) {
-      uint32_t x = 0u;
-      size_t i = _pos, j = _pos + n - 1;
-      for (size_t k=j+1u; k>i; --k) {
-        x = (x<<1uL) | static_cast<uint32_t>(_gens[k-1]);
-      }
-      _pos += n;
-      return x;
+      return static_cast<uint32_t>(decodeUInt64(n));
     }
 
     double decodeDouble(const size_t n,
@@ -97,7 +100,7 @@ namespace GeneticAlgorithms {
       // assert(min < max);
       double length = max - min;
       double x_double = static_cast<double>
-        (double(x_uint)/double((1uL<<n) - 1uL)*length + min);
+        (double(x_uint)/double(BitKernels::low_mask(n))*length + min);
       return x_double;
     }
 
@@ -108,69 +111,299 @@ namespace GeneticAlgorithms {
       // assert(min < max);
       float length = max - min;
       float x_float = static_cast<float>
-        (double(x_uint)/double((1uL<<n) - 1uL)*length + min);
+        (double(x_uint)/double(BitKernels::low_mask(n))*length + min);
       return x_float;
     }
 
+    /// Position of the next gen to be decoded
+    size_t position() const {
+      return _pos;
+    }
+
   private:
-    bitset _gens;
-    uint32_t _pos;
+    const block_type *_blocks;
+    size_t _pos;
   }; // class Decoder
 
-  // template <typename N>
-  // class EncoderBuilder {
-  // public:
-  //   class Encoder {
-  //     friend class EncoderBuilder;
-  //   private:
-  //     Encoder(EncoderBuilder *builder);
-  //   };
-    
-  //   void code_uint32(uint32_t val, const size_t i=0u, const size_t j=N-1) {
-  //     for (size_t k=j+1; k>i; --k) {
-  //       _gens[k-1] = val & 1u;
-  //       val >>= 1;
-  //     }
-  //   }
-
-  //   void code_float(float val, float min, float max,
-  //                   const size_t i=0, const size_t j=N-1) {
-  //     float length = max - min;
-  //     uint32_t x_uint = static_cast<uint32_t>(roundf((val - min) / length));
-  //     code_uint32(x_uint, i, j);
-  //   }
-
-  // private:
-  //   enum types_t {
-  //     UINT32,
-  //     FLOAT,
-  //   };
-  //   struct data_desc_t {
-  //     types_t type;
-  //     size_t num_bits;
-  //     float min, max;
-  //   };
-  //   vector<data_desc_t> description;
-
-    
-  //   uint32_t decode_uint32(const size_t i=0,
-  //                          const size_t j=N-1) const {
-  //     uint32_t x = 0u;
-  //     for (size_t k=j+1; k>i; --k) {
-  //       x = (x<<1) | static_cast<uint32_t>(_gens[k-1]);
-  //     }
-  //     return x;
-  //   }
-
-  //   float decode_float(float min,
-  //                      float max,
-  //                      const size_t i=0,
-  //                      const size_t j=N-1) const {
-  //     uint32_t x_uint = decode_uint32(i, j);
-  //     // assert(min < max);
-  //     float length = max - min;
-  //     return static_cast<float>(static_cast<double>(x_uint)*length + min);
-  //   }
+  /**
+   * Nearest integer of n bits to a real number in [min,max]
+   *
+   * It is the inverse of Decoder::decodeDouble(), values out of the
+   * range are clamped.
+   */
+  inline uint64_t quantize(const double value, const size_t n,
+                           const double min, const double max) {
+    const uint64_t top = BitKernels::low_mask(n);
+    const double x = (value - min) / (max - min) * double(top);
+    if (!(x > 0.0)) return 0u;
+    if (x >= double(top)) return top;
+    return static_cast<uint64_t>(x + 0.5);
+  }
+
+  /**
+   * This encoder converts C++ types into Chromosome gens
+   *
+   * It mirrors Decoder: the same sequence of calls with the same
+   * sizes and ranges writes the gens which Decoder reads back. Real
+   * numbers are rounded to the nearest representable value.
+   *
+   * The encoder is a view over the gens of the chromosome, which
+   * should live longer than the encoder.
+   *
+   * ATTENTION: no thread safe object, it should be created for each
+   * thread in your program.
+   *
+   * @code
+   * Chromosome x(12);
+   * Encoder encoder(x);
+   * encoder.encodeUInt32(17u, 5);
+   * encoder.encodeFloat(0.25f, 5, 0.0f, 1.0f);
+   * encoder.encodeBool(true);
+   * encoder.encodeBool(false);
+   * @endcode
+   */
+  class Encoder {
+  public:
+    template<typename ChromosomeType>
+    Encoder(ChromosomeType &chromosome) :
+      _blocks(chromosome.blocks()), _pos(0u) {
+    }
+
+    void encodeBool(const bool value) {
+      encodeUInt64(value ? 1u : 0u, 1u);
+    }
+
+    /// Encodes the n least significant bits of value, n in [0,64]
+    void encodeUInt64(const uint64_t value, const size_t n) {
+      BitKernels::deposit_bits(_blocks, _pos, n, value);
+      _pos += n;
+    }
+
+    void encodeUInt32(const uint32_t value, const size_t n) {
+      encodeUInt64(value, n);
+    }
+
+    void encodeDouble(const double value, const size_t n,
+                      const double min=0.0f,
+                      const double max=1.0f) {
+      encodeUInt64(quantize(value, n, min, max), n);
+    }
+
+    void encodeFloat(const float value, const size_t n,
+                     const float min=0.0f,
+                     const float max=1.0f) {
+      encodeUInt64(quantize(value, n, min, max), n);
+    }
+
+    /// Position of the next gen to be encoded
+    size_t position() const {
+      return _pos;
+    }
+
+  private:
+    block_type *_blocks;
+    size_t _pos;
+  }; // class Encoder
+
+  /**
+   * Fields of a Schema, see below
+   *
+   * Every field type declares its number of gens, the C++ type of its
+   * value, a static decode() which receives the field gens as an
+   * integer (first gen as least significant bit) and a static
+   * encode() which does the opposite.
+   */
+
+  /// Unsigned integer of BITS gens, as uint32_t or uint64_t
+  template<size_t BITS>
+  struct UInt {
+    static_assert(BITS > 0u && BITS <= 64u, "UInt needs 1 to 64 bits");
+    static const size_t num_gens = BITS;
+    typedef typename std::conditional<(BITS <= 32u),
+                                      uint32_t, uint64_t>::type value_type;
+
+    static value_type decode(const uint64_t x) {
+      return static_cast<value_type>(x);
+    }
+
+    static uint64_t encode(const value_type value) {
+      return static_cast<uint64_t>(value);
+    }
+  }; // struct UInt
+
+  /**
+   * Real number in [MIN,MAX] with BITS gens, as Decoder::decodeFloat()
+   *
+   * Bounds are integers because C++11 doesn't allow floating point
+   * template arguments. The scale factor is a compile time constant.
+   */
+  template<size_t BITS, int MIN, int MAX, typename Real=float>
+  struct Float {
+    static_assert(BITS > 0u && BITS <= 64u, "Float needs 1 to 64 bits");
+    static_assert(MIN < MAX, "Float needs MIN < MAX");
+    static const size_t num_gens = BITS;
+    typedef Real value_type;
+
+    static constexpr double scale() {
+      return (double(MAX) - double(MIN)) /
+        double((BITS == 64u) ? ~uint64_t(0u) : ((uint64_t(1u) << BITS) - 1u));
+    }
+
+    static value_type decode(const uint64_t x) {
+      return static_cast<value_type>(double(x)*scale() + double(MIN));
+    }
+
+    static uint64_t encode(const value_type value) {
+      return quantize(value, BITS, MIN, MAX);
+    }
+  }; // struct Float
+
+  /// As Float, but decoded as double
+  template<size_t BITS, int MIN, int MAX>
+  using Double = Float<BITS, MIN, MAX, double>;
+
+  /// A boolean flag of one gen
+  struct Bool {
+    static const size_t num_gens = 1u;
+    typedef bool value_type;
+
+    static value_type decode(const uint64_t x) {
+      return x != 0u;
+    }
+
+    static uint64_t encode(const value_type value) {
+      return value ? 1u : 0u;
+    }
+  }; // struct Bool
+
+  namespace SchemaDetail {
+    /// Position of the field I at the list of Fields
+    template<size_t I, typename... Fields>
+    struct FieldOffset;
+
+    template<typename Field, typename... Rest>
+    struct FieldOffset<0u, Field, Rest...> {
+      static const size_t value = 0u;
+    };
+
+    template<size_t I, typename Field, typename... Rest>
+    struct FieldOffset<I, Field, Rest...> {
+      static const size_t value = Field::num_gens +
+        FieldOffset<I - 1u, Rest...>::value;
+    };
+
+    /// Total number of gens of a list of Fields
+    template<typename... Fields>
+    struct TotalGens;
+
+    template<>
+    struct TotalGens<> {
+      static const size_t value = 0u;
+    };
+
+    template<typename Field, typename... Rest>
+    struct TotalGens<Field, Rest...> {
+      static const size_t value = Field::num_gens + TotalGens<Rest...>::value;
+    };
+
+    template<size_t... I>
+    struct Indices {
+    };
+
+    template<size_t N, size_t... I>
+    struct MakeIndices : MakeIndices<N - 1u, N - 1u, I...> {
+    };
+
+    template<size_t... I>
+    struct MakeIndices<0u, I...> {
+      typedef Indices<I...> type;
+    };
+  } // namespace SchemaDetail
+
+  /**
+   * Compile time description of the fields encoded at a chromosome
+   *
+   * Fields are placed one after the other from gen 0. Offsets, sizes
+   * and scale factors are compile time constants, so decoding a
+   * chromosome is a sequence of word shifts and masks.
+   *
+   * @code
+   * typedef Schema<UInt<5>, Float<10,-5,5>, Bool> MySchema;
+   * // MySchema::num_gens == 16
+   * std::tuple<uint32_t, float, bool> v = MySchema::decode(x);
+   * float y = std::get<1>(MySchema::decode(x));
+   * // or into an aggregate with the same fields, in order
+   * struct Params { uint32_t n; float y; bool flag; };
+   * Params p = MySchema::decodeInto<Params>(x);
+   * // and back, into a chromosome of at least num_gens gens
+   * MySchema::encode(std::make_tuple(3u, 1.5f, true), x);
+   * @endcode
+   */
+  template<typename... Fields>
+  class Schema {
+  public:
+    typedef std::tuple<typename Fields::value_type...> value_type;
+
+    /// Number of gens of all the fields
+    static const size_t num_gens = SchemaDetail::TotalGens<Fields...>::value;
+
+    /// Number of fields
+    static const size_t num_fields = sizeof...(Fields);
+
+    /// First gen of field I
+    template<size_t I>
+    static constexpr size_t offset() {
+      return SchemaDetail::FieldOffset<I, Fields...>::value;
+    }
+
+    template<typename ChromosomeType>
+    static value_type decode(const ChromosomeType &chromosome) {
+      assert(chromosome.size() >= num_gens);
+      return decode<value_type>(chromosome.blocks(),
+                                typename SchemaDetail::MakeIndices<num_fields>::type());
+    }
+
+    /// Decodes into an aggregate (or constructor) taking all the fields
+    template<typename Struct, typename ChromosomeType>
+    static Struct decodeInto(const ChromosomeType &chromosome) {
+      assert(chromosome.size() >= num_gens);
+      return decode<Struct>(chromosome.blocks(),
+                            typename SchemaDetail::MakeIndices<num_fields>::type());
+    }
+
+    /// Writes the fields of value at the gens of chromosome
+    template<typename ChromosomeType>
+    static void encode(const value_type &value, ChromosomeType &chromosome) {
+      assert(chromosome.size() >= num_gens);
+      encode(value, chromosome.blocks(),
+             typename SchemaDetail::MakeIndices<num_fields>::type());
+    }
+
+  private:
+    template<size_t... I>
+    static void encode(const value_type &value, block_type *blocks,
+                       SchemaDetail::Indices<I...>) {
+      // the array is only a context to expand one call per field
+      const int order[] = { 0, (BitKernels::deposit_bits(blocks, offset<I>(),
+                                                         Fields::num_gens,
+                                                         Fields::encode(std::get<I>(value))),
+                                0)... };
+      (void)order;
+    }
+
+    template<typename Result, size_t... I>
+    static Result decode(const block_type *blocks, SchemaDetail::Indices<I...>) {
+      return Result{ Fields::decode(BitKernels::extract_bits(blocks,
+                                                             offset<I>(),
+                                                             Fields::num_gens))... };
+    }
+  }; // class Schema
+
+  template<typename... Fields>
+  const size_t Schema<Fields...>::num_gens;
+
+  template<typename... Fields>
+  const size_t Schema<Fields...>::num_fields;
 
 } // namespace GeneticAlgorithms
 
@@ -0,0 +1,756 @@
+#define BOOST_TEST_MODULE GeneticAlgorithms
+#include <boost/test/included/unit_test.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "arena.h"
+#include "batch_rank.h"
+#include "bit_kernels.h"
+#include "bit_slice.h"
+#include "breeding.h"
+#include "checkpoint.h"
+#include "chromosome.h"
+#include "counter_rng.h"
+#include "crossovers.h"
+#include "fitness_cache.h"
+#include "genetic_solver.h"
+#include "initializers.h"
+#include "island_solver.h"
+#include "mutations.h"
+#include "niching.h"
+#include "observer.h"
+#include "pipeline_solver.h"
+#include "process_islands.h"
+#include "selections.h"
+#include "steady_state.h"
+#include "stopping.h"
+#include "thread_pool.h"
+#include "translators.h"
+
+using namespace GeneticAlgorithms;
+
+/// Number of gens set, the optimum is the all ones chromosome
+struct OneMaxRank {
+  template<typename ChromosomeType>
+  float operator()(const ChromosomeType &x) const {
+    size_t n = 0u;
+    for (size_t w=0; w<x.num_blocks(); ++w) n += BitKernels::popcount(x.blocks()[w]);
+    return static_cast<float>(n);
+  }
+  template<size_t W>
+  void operator()(const BasicBitSlice<W> &slice, float *ranks) const {
+    BasicSlicedCounter<W> ones;
+    for (size_t j=0; j<slice.numGens(); ++j) ones.add(slice.word(j));
+    ones.counts(ranks, slice.rows());
+  }
+};
+
+/// Throws after a given number of calls, every copy counts on its own
+struct ThrowingRank {
+  mutable size_t calls = 0u;
+  template<typename ChromosomeType>
+  float operator()(const ChromosomeType &x) const {
+    if (++calls > 300u) throw std::runtime_error("rank failed");
+    return static_cast<float>(x[0]);
+  }
+};
+
+template<typename ChromosomeType>
+static bool same_gens(const ChromosomeType &a, const ChromosomeType &b) {
+  return a.size() == b.size() && BitKernels::equal(a.blocks(), b.blocks(), a.num_blocks());
+}
+
+/// Children bred by the fused word protocol and by the in-place protocol
+template<typename CrossOverFunctor>
+static void check_fused_breeding(const CrossOverFunctor &cross_over) {
+  for (size_t N : { 1u, 63u, 64u, 65u, 300u, 1000u }) {
+    for (float p : { 0.0f, 1e-6f, 0.001f, 0.05f, 0.5f, 1.0f }) {
+      RandomInitializer init(N, 1u, 0.5f);
+      const Chromosome a = init(), b = init();
+      CrossOverFunctor fused_cross_over(cross_over), cross_over_copy(cross_over);
+      CrossOverFunctor timed_cross_over(cross_over), timed_cross_over_copy(cross_over);
+      RandomMutate fused_mutate(7u, p), mutate(7u, p);
+      RandomMutate timed_mutate(7u, p), timed_mutate_copy(7u, p);
+      Chromosome fused(N), unfused(N), timed(N), timed_unfused(N);
+      BreedTimes times;
+      for (size_t i=0; i<20u; ++i) {
+        breed_into(fused_cross_over, fused_mutate, a, b, fused, 0);
+        breed_into(cross_over_copy, mutate, a, b, unfused, 0L);
+        timed_breed_into(timed_cross_over, timed_mutate, a, b, timed, times, 0);
+        timed_breed_into(timed_cross_over_copy, timed_mutate_copy, a, b,
+                         timed_unfused, times, 0L);
+        BOOST_REQUIRE(same_gens(fused, unfused));
+        BOOST_REQUIRE(same_gens(fused, timed));
+        BOOST_REQUIRE(same_gens(fused, timed_unfused));
+      }
+      BOOST_REQUIRE(times.cross_over.count() > 0);
+      BOOST_REQUIRE(times.mutate.count() > 0);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(transpose64_moves_bits_across_the_diagonal) {
+  CounterRng rng(3u);
+  block_type m[64], t[64];
+  for (size_t i=0; i<64u; ++i) m[i] = t[i] = rng();
+  BitKernels::transpose64(t);
+  for (size_t i=0; i<64u; ++i) {
+    for (size_t j=0; j<64u; ++j) {
+      BOOST_REQUIRE_EQUAL((m[i] >> j) & 1u, (t[j] >> i) & 1u);
+    }
+  }
+  BitKernels::transpose64(t);
+  for (size_t i=0; i<64u; ++i) BOOST_REQUIRE_EQUAL(m[i], t[i]);
+}
+
+/// Slices of W*64 chromosomes count the gens of any number of rows
+template<size_t W>
+static void check_bit_slice() {
+  for (size_t N : { 1u, 64u, 130u }) {
+    for (size_t P : { 1u, 63u, 64u, 65u, 200u, 300u }) {
+      ChromosomeArena<Chromosome> arena;
+      RandomInitializer init(N, 5u, 0.5f);
+      for (size_t i=0; i<P; ++i) init(arena.emplace(N));
+      const GeneMatrix genes = { arena.data(), arena.stride(), P, N };
+      BasicBitSlice<W> slice;
+      std::vector<block_type> rows(P * arena.stride(), block_type(0u));
+      for (size_t first=0; first<P; first+=BasicBitSlice<W>::LANES) {
+        slice.load(genes, first);
+        BOOST_REQUIRE_EQUAL(slice.rows(), std::min(BasicBitSlice<W>::LANES, P - first));
+        for (size_t i=0; i<slice.rows(); ++i) {
+          for (size_t j=0; j<N; ++j) {
+            const block_type lane = lane_block(slice.word(j), i / bits_per_block);
+            BOOST_REQUIRE_EQUAL((lane >> (i % bits_per_block)) & 1u,
+                                block_type(genes(first + i, j)));
+          }
+        }
+        slice.store(rows.data() + first*arena.stride(), arena.stride());
+      }
+      for (size_t i=0; i<P; ++i) {
+        BOOST_REQUIRE(BitKernels::equal(rows.data() + i*arena.stride(), arena.data() + i*arena.stride(),
+                                        arena[i].num_blocks()));
+      }
+      std::vector<float> ranks(P);
+      make_sliced_rank<W>(OneMaxRank())(genes, ranks.data());
+      for (size_t i=0; i<P; ++i) BOOST_REQUIRE_EQUAL(ranks[i], OneMaxRank()(arena[i]));
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(bit_slices_of_any_width_round_trip_and_count) {
+  check_bit_slice<1u>();
+  check_bit_slice<4u>();
+  check_bit_slice<8u>();
+}
+
+BOOST_AUTO_TEST_CASE(fused_breeding_equals_unfused_breeding) {
+  check_fused_breeding(RandomSplitCrossOver(1000u, 2u));
+  check_fused_breeding(RandomMixCrossOver(2u));
+  check_fused_breeding(KPointCrossOver(1000u, 3u, 2u));
+  check_fused_breeding(TwoPointCrossOver(1000u, 2u));
+  check_fused_breeding(make_cross_over_on_prob(3u, 0.5f, RandomMixCrossOver(2u)));
+}
+
+BOOST_AUTO_TEST_CASE(random_mutate_flips_gens_with_its_probability) {
+  const size_t N = 1u << 20u;
+  for (float p : { 1e-6f, 5e-6f, 1e-5f, 1e-4f, 0.001f, 0.01f, 0.1f, 0.3f, 0.5f }) {
+    for (bool fused : { false, true }) {
+      RandomMutate mutate(11u, p);
+      RandomMixCrossOver cross_over(12u);
+      const Chromosome zeros(N);
+      Chromosome x(N);
+      // enough repetitions to expect at least 200 flips
+      const size_t repetitions = std::max<size_t>(2u, std::ceil(200.0 / (p * N)));
+      double flips = 0.0;
+      for (size_t i=0; i<repetitions; ++i) {
+        if (fused) breed_into(cross_over, mutate, zeros, zeros, x);
+        else mutate(zeros, x);
+        flips += OneMaxRank()(x);
+      }
+      // binomial mean and standard deviation of the number of flips
+      const double mean = double(p) * N * repetitions;
+      const double stddev = std::sqrt(mean * (1.0 - p));
+      BOOST_CHECK_MESSAGE(std::fabs(flips - mean) < 5.0 * stddev + 1.0,
+                          "p=" << p << " fused=" << fused << " flips="
+                          << flips << " expected=" << mean);
+    }
+  }
+}
+
+/// Fraction of the picks of every position at the given couples
+std::vector<double> pick_fractions(const std::vector<IndexCouple> &couples,
+                                   const size_t n) {
+  std::vector<double> fractions(n, 0.0);
+  for (const IndexCouple &c : couples) {
+    fractions[c.first] += 1.0;
+    fractions[c.second] += 1.0;
+  }
+  for (double &f : fractions) f /= 2.0 * couples.size();
+  return fractions;
+}
+
+BOOST_AUTO_TEST_CASE(alias_and_sus_selections_follow_rank_weights) {
+  const std::vector<float> ranks = { 1.0f, 2.0f, 3.0f, 4.0f, 0.0f };
+  const size_t M = 20000u;
+  ThreadPool pool(4u);
+  FloatAliasRouletteWheelSelection alias(1u);
+  const std::vector<double> alias_fractions =
+    pick_fractions(alias(ranks, M), ranks.size());
+  FloatStochasticUniversalSampling sus(2u);
+  const std::vector<IndexCouple> sus_couples = sus(ranks, M);
+  const std::vector<double> sus_fractions = pick_fractions(sus_couples, ranks.size());
+  for (size_t i=0; i<ranks.size(); ++i) {
+    const double expected = ranks[i] / 10.0;
+    BOOST_CHECK_CLOSE_FRACTION(alias_fractions[i] + 1.0, expected + 1.0, 0.01);
+    // SUS picks every subject its expected number of times, +-1
+    BOOST_CHECK_LE(std::fabs(sus_fractions[i] - expected), 1.0 / (2.0 * M));
+  }
+  BOOST_CHECK_EQUAL(alias_fractions.back(), 0.0);
+  BOOST_CHECK_EQUAL(sus_fractions.back(), 0.0);
+  // the same seed draws the same couples with any pool
+  FloatAliasRouletteWheelSelection alias_pool(1u);
+  FloatStochasticUniversalSampling sus_pool(2u);
+  BOOST_CHECK(alias_pool(ranks, M, &pool) == FloatAliasRouletteWheelSelection(1u)(ranks, M));
+  BOOST_CHECK(sus_pool(ranks, M, &pool) == sus_couples);
+}
+
+BOOST_AUTO_TEST_CASE(encoder_and_schema_round_trip_the_decoder) {
+  Chromosome x(200u);
+  Encoder encoder(x);
+  encoder.encodeUInt32(17u, 5u);
+  encoder.encodeFloat(0.25f, 10u, -5.0f, 5.0f);
+  encoder.encodeBool(true);
+  // crosses the boundary of the first block
+  encoder.encodeUInt64(0x123456789abcdefULL, 60u);
+  encoder.encodeDouble(0.3, 30u, 0.0, 1.0);
+  BOOST_CHECK_EQUAL(encoder.position(), 106u);
+  Decoder decoder(x);
+  BOOST_CHECK_EQUAL(decoder.decodeUInt32(5u), 17u);
+  BOOST_CHECK_LE(std::fabs(decoder.decodeFloat(10u, -5.0f, 5.0f) - 0.25f),
+                 0.5f * 10.0f / 1023.0f);
+  BOOST_CHECK(decoder.decodeBool());
+  BOOST_CHECK_EQUAL(decoder.decodeUInt64(60u), 0x123456789abcdefULL);
+  BOOST_CHECK_CLOSE_FRACTION(decoder.decodeDouble(30u, 0.0, 1.0), 0.3, 1e-8);
+  BOOST_CHECK_EQUAL(decoder.position(), encoder.position());
+
+  typedef Schema<UInt<5>, Float<10,-5,5>, Bool, UInt<60>, Double<30,0,1> > MySchema;
+  BOOST_CHECK_EQUAL(MySchema::num_gens, 106u);
+  BOOST_CHECK_EQUAL(MySchema::offset<3>(), 16u);
+  // the schema reads the gens written by Encoder
+  const MySchema::value_type v = MySchema::decode(x);
+  BOOST_CHECK_EQUAL(std::get<0>(v), 17u);
+  BOOST_CHECK_EQUAL(std::get<2>(v), true);
+  BOOST_CHECK_EQUAL(std::get<3>(v), 0x123456789abcdefULL);
+  Chromosome y(106u);
+  MySchema::encode(v, y);
+  BOOST_CHECK(MySchema::decode(y) == v);
+  BOOST_CHECK(same_gens(Chromosome(x.blocks(), 106u), y));
+  struct Params { uint32_t n; float f; bool flag; uint64_t id; double d; };
+  const Params p = MySchema::decodeInto<Params>(y);
+  BOOST_CHECK_EQUAL(p.id, 0x123456789abcdefULL);
+  BOOST_CHECK_EQUAL(p.f, std::get<1>(v));
+}
+
+BOOST_AUTO_TEST_CASE(seeded_initializer_returns_seeds_first) {
+  const std::vector<Chromosome> seeds = { RandomInitializer(64u, 1u, 0.5f)(),
+                                          RandomInitializer(64u, 2u, 0.5f)() };
+  SeededInitializer init(seeds, 64u, 3u);
+  BOOST_CHECK(same_gens(init(), seeds[0]));
+  BOOST_CHECK(same_gens(init(), seeds[1]));
+  BOOST_CHECK_EQUAL(init().size(), 64u);
+  init.seed(3u);
+  BOOST_CHECK(same_gens(init(), seeds[0]));
+  BOOST_CHECK_THROW(SeededInitializer(seeds, 65u, 3u), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(fitness_cache_evicts_by_clock) {
+  FitnessCache<float> cache(4u);
+  RandomInitializer init(100u, 5u, 0.5f);
+  std::vector<Chromosome> x;
+  for (size_t i=0; i<5u; ++i) x.push_back(init());
+  for (size_t i=0; i<4u; ++i) cache.insert(x[i], float(i));
+  float rank;
+  BOOST_REQUIRE(cache.find(x[0], rank));
+  BOOST_CHECK_EQUAL(rank, 0.0f);
+  // x[0] was referenced, so the hand skips it and evicts x[1]
+  cache.insert(x[4], 4.0f);
+  BOOST_CHECK_EQUAL(cache.size(), 4u);
+  BOOST_CHECK(cache.find(x[0], rank));
+  BOOST_CHECK(!cache.find(x[1], rank));
+  for (size_t i : { 2u, 3u, 4u }) {
+    BOOST_REQUIRE(cache.find(x[i], rank));
+    BOOST_CHECK_EQUAL(rank, float(i));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(fitness_cache_keeps_ranks_after_many_evictions) {
+  FitnessCache<float> cache(64u);
+  RandomInitializer init(70u, 6u, 0.5f);
+  std::vector<Chromosome> x;
+  for (size_t i=0; i<1000u; ++i) {
+    x.push_back(init());
+    cache.insert(x.back(), float(i));
+    BOOST_REQUIRE(cache.size() <= cache.capacity());
+  }
+  size_t found = 0u;
+  for (size_t i=0; i<x.size(); ++i) {
+    float rank;
+    if (cache.find(x[i], rank)) {
+      BOOST_REQUIRE_EQUAL(rank, float(i));
+      ++found;
+    }
+  }
+  BOOST_CHECK_EQUAL(found, cache.capacity());
+}
+
+BOOST_AUTO_TEST_CASE(solve_is_deterministic_for_any_number_of_threads) {
+  const size_t N = 200u;
+  Chromosome first;
+  for (size_t num_threads : { 1u, 2u, 4u }) {
+    FitnessCache<float> cache(1000u);
+    Chromosome best = solve(30u, 300u, RandomInitializer(N, 1u, 0.5f),
+                            TournamentSelection(2u, 2u), RandomMixCrossOver(3u),
+                            RandomMutate(4u, 0.01f), OneMaxRank(), 0,
+                            num_threads, &cache);
+    if (num_threads == 1u) first = best;
+    else BOOST_CHECK(same_gens(first, best));
+  }
+  for (size_t num_threads : { 1u, 4u }) {
+    Chromosome best = solve(30u, 300u, RandomInitializer(N, 1u, 0.5f),
+                            FloatAliasRouletteWheelSelection(2u),
+                            RandomSplitCrossOver(N, 3u),
+                            RandomMutate(4u, 0.01f), OneMaxRank(), 0,
+                            num_threads);
+    if (num_threads == 1u) first = best;
+    else BOOST_CHECK(same_gens(first, best));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(seeds_keep_64_bits_and_wrappers_have_their_own_stream) {
+  BOOST_CHECK_NE(derive_seed(1u, 0u) >> 32u, 0u);
+  // seeds which only differ at the high 32 bits give other sequences
+  const uint64_t high = uint64_t(1u) << 32u;
+  RandomMutate low_mutate(1u, 0.5f), high_mutate(1u + high, 0.5f);
+  Chromosome x(200u), a(200u), b(200u);
+  low_mutate.stream(0u, 0u);
+  high_mutate.stream(0u, 0u);
+  low_mutate(x, a);
+  high_mutate(x, b);
+  BOOST_CHECK(!same_gens(a, b));
+  Chromosome first;
+  for (size_t num_threads : { 1u, 4u }) {
+    Chromosome best = solve(30u, 100u, RandomInitializer(200u, 1u, 0.5f),
+                            TournamentSelection(2u, 2u),
+                            make_cross_over_on_prob(high + 3u, 0.7f, RandomMixCrossOver(5u)),
+                            RandomMutate(4u, 0.01f), OneMaxRank(), 0,
+                            num_threads);
+    if (num_threads == 1u) first = best;
+    else BOOST_CHECK(same_gens(first, best));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(stopping_criteria_fire_and_compose) {
+  SolverProgress p = SolverProgress();
+  p.generation = 10u;
+  p.evaluations = 500u;
+  p.seconds = 1.5;
+  p.best_rank = 7.0;
+  p.stagnant_generations = 3u;
+  p.diversity = 0.2;
+  BOOST_CHECK(MaxGenerations(10u)(p) && !MaxGenerations(11u)(p));
+  BOOST_CHECK(MaxEvaluations(500u)(p) && !MaxEvaluations(501u)(p));
+  BOOST_CHECK(WallClock(1.0)(p) && !WallClock(2.0)(p));
+  BOOST_CHECK(TargetFitness(7.0)(p) && !TargetFitness(8.0)(p));
+  BOOST_CHECK(Stagnation(3u)(p) && !Stagnation(4u)(p));
+  BOOST_CHECK(DiversityCollapse(0.2)(p) && !DiversityCollapse(0.1)(p));
+  const auto any = MaxGenerations(20u) || Stagnation(3u);
+  BOOST_CHECK(any(p));
+  BOOST_CHECK_EQUAL(any.reason(p), "Stagnation(3)");
+  BOOST_CHECK(!(MaxGenerations(20u) || Stagnation(4u))(p));
+  const auto all = MaxGenerations(10u) && Stagnation(3u);
+  BOOST_CHECK(all(p));
+  BOOST_CHECK_EQUAL(all.reason(p), "(MaxGenerations(10) and Stagnation(3))");
+  BOOST_CHECK(!(MaxGenerations(10u) && Stagnation(4u))(p));
+  const auto nested = (Stagnation(4u) && MaxGenerations(5u)) || WallClock(1.0);
+  BOOST_CHECK(nested(p));
+  BOOST_CHECK_EQUAL(nested.reason(p), "WallClock(1)");
+  BOOST_CHECK(!decltype(any)::uses_diversity);
+  BOOST_CHECK((decltype(any || DiversityCollapse(0.1))::uses_diversity));
+}
+
+/// OneMaxRank which counts its calls, shared by all copies
+struct CountingRank {
+  size_t *calls;
+  float operator()(const Chromosome &x) const {
+    ++*calls;
+    return OneMaxRank()(x);
+  }
+};
+
+BOOST_AUTO_TEST_CASE(max_evaluations_count_rank_calls_with_a_cache) {
+  size_t calls = 0u;
+  const CountingRank rank = { &calls };
+  // short chromosomes repeat a lot, most ranks are found at the cache
+  FitnessCache<float> cache(1000u);
+  StopReport report;
+  solve_until(MaxEvaluations(2000u), 50u, RandomInitializer(12u, 1u, 0.5f),
+              TournamentSelection(2u, 2u), RandomMixCrossOver(3u),
+              RandomMutate(4u, 0.05f), rank, 0, 1u, &cache,
+              nullptr, static_cast<NullObserver*>(nullptr), &report);
+  BOOST_CHECK_EQUAL(report.evaluations, calls);
+  BOOST_CHECK_GE(calls, 2000u);
+  BOOST_CHECK_LT(calls, 2000u + 50u);
+  BOOST_CHECK_GT(report.generations, 2000u/50u);
+  BOOST_CHECK_EQUAL(report.reason, "MaxEvaluations(2000)");
+}
+
+BOOST_AUTO_TEST_CASE(observed_solve_equals_unobserved_solve) {
+  for (size_t num_threads : { 1u, 3u }) {
+    const Chromosome unobserved =
+      solve(20u, 200u, RandomInitializer(300u, 1u, 0.5f), TournamentSelection(2u),
+            RandomSplitCrossOver(300u, 3u), RandomMutate(4u, 0.01f), OneMaxRank(),
+            0, num_threads);
+    GenerationLog log(100u);
+    const Chromosome observed =
+      solve(20u, 200u, RandomInitializer(300u, 1u, 0.5f), TournamentSelection(2u),
+            RandomSplitCrossOver(300u, 3u), RandomMutate(4u, 0.01f), OneMaxRank(),
+            0, num_threads, static_cast<FitnessCache<float>*>(nullptr), nullptr, &log);
+    BOOST_CHECK(same_gens(unobserved, observed));
+    BOOST_REQUIRE_EQUAL(log.size(), 20u);
+    BOOST_CHECK_EQUAL(log[19].generation, 20u);
+    BOOST_CHECK_EQUAL(log[19].best_rank, OneMaxRank()(observed));
+    BOOST_CHECK_GT(log[19].cross_over_seconds, 0.0);
+    BOOST_CHECK_GT(log[19].mutate_seconds, 0.0);
+    BOOST_CHECK_GE(log[19].breed_seconds, log[19].cross_over_seconds / num_threads);
+  }
+}
+
+/// A mutation without random streams, which checkpoints reject
+struct NoStreamMutate {
+  Chromosome operator()(const Chromosome &x) const {
+    return x;
+  }
+};
+
+BOOST_AUTO_TEST_CASE(checkpoint_resume_continues_the_interrupted_run) {
+  const std::string path = "test_checkpoint.ckpt";
+  std::remove(path.c_str());
+  auto run = [&](size_t num_iterations, size_t population_size,
+                 const CheckpointConfig *checkpoint) {
+    return solve(num_iterations, population_size, RandomInitializer(150u, 1u, 0.5f),
+                 TournamentSelection(2u), RandomMixCrossOver(3u),
+                 RandomMutate(4u, 0.01f), OneMaxRank(), 0, 2u,
+                 static_cast<FitnessCache<float>*>(nullptr), checkpoint);
+  };
+  const Chromosome uninterrupted = run(20u, 100u, nullptr);
+  CheckpointConfig checkpoint(path, 0u);
+  run(10u, 100u, &checkpoint);
+  {
+    MappedCheckpoint saved(path);
+    BOOST_CHECK_EQUAL(saved.generation(), 10u);
+    BOOST_CHECK_EQUAL(saved.size(), 100u);
+    BOOST_CHECK_EQUAL(saved.numGens(), 150u);
+    const Chromosome best(saved.bestRow(), saved.numGens());
+    BOOST_CHECK_EQUAL(OneMaxRank()(best), saved.bestRank<float>());
+    BOOST_CHECK_THROW(saved.ranks<double>(), std::runtime_error);
+  }
+  BOOST_CHECK_THROW(run(20u, 50u, &checkpoint), std::runtime_error);
+  BOOST_CHECK_THROW(solve(20u, 100u, RandomInitializer(100u, 1u, 0.5f),
+                          TournamentSelection(2u), RandomMixCrossOver(3u),
+                          RandomMutate(4u, 0.01f), OneMaxRank(), 0, 1u,
+                          static_cast<FitnessCache<float>*>(nullptr), &checkpoint),
+                    std::runtime_error);
+  BOOST_CHECK(same_gens(run(20u, 100u, &checkpoint), uninterrupted));
+  BOOST_CHECK_THROW(solve(20u, 100u, RandomInitializer(150u, 1u, 0.5f),
+                          TournamentSelection(2u), RandomMixCrossOver(3u),
+                          NoStreamMutate(), OneMaxRank(), 0, 1u,
+                          static_cast<FitnessCache<float>*>(nullptr), &checkpoint),
+                    std::runtime_error);
+  std::remove(path.c_str());
+}
+
+BOOST_AUTO_TEST_CASE(thread_pool_runs_every_chunk_and_rethrows) {
+  for (size_t num_threads : { 1u, 4u }) {
+    ThreadPool pool(num_threads);
+    BOOST_CHECK_EQUAL(pool.size(), num_threads);
+    std::vector<size_t> visits(1000u, 0u);
+    std::vector<size_t> workers(1000u, 0u);
+    pool.parallel_for(visits.size(), 7u, [&](size_t worker, size_t begin, size_t end) {
+        for (size_t i=begin; i<end; ++i) {
+          ++visits[i];
+          workers[i] = worker;
+        }
+      });
+    BOOST_CHECK(std::all_of(visits.begin(), visits.end(), [](size_t v) { return v == 1u; }));
+    BOOST_CHECK(*std::max_element(workers.begin(), workers.end()) < num_threads);
+    BOOST_CHECK_THROW(pool.parallel_for(100u, 1u, [](size_t, size_t begin, size_t end) {
+          if (begin <= 50u && 50u < end) throw std::runtime_error("chunk failed");
+        }), std::runtime_error);
+    // the pool is still usable after an exception
+    size_t sum = 0u;
+    pool.parallel_for(10u, 10u, [&](size_t, size_t begin, size_t end) { sum += end - begin; });
+    BOOST_CHECK_EQUAL(sum, 10u);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(thread_joiner_stops_and_joins_while_unwinding) {
+  std::atomic<bool> stop(false);
+  std::atomic<size_t> finished(0u);
+  auto wait_stop = [&]() {
+    while (!stop) std::this_thread::yield();
+    ++finished;
+  };
+  try {
+    ThreadJoiner threads([&]() { stop = true; });
+    for (size_t t=0; t<3u; ++t) threads.start(wait_stop);
+    throw std::runtime_error("a thread failed to start");
+  }
+  catch (const std::runtime_error &) {
+  }
+  BOOST_CHECK_EQUAL(finished.load(), 3u);
+}
+
+BOOST_AUTO_TEST_CASE(pipeline_solver_equals_solve_and_reports_errors) {
+  const Chromosome expected = solve(20u, 300u, RandomInitializer(200u, 1u, 0.5f),
+                                    TournamentSelection(2u, 2u), RandomMixCrossOver(3u),
+                                    RandomMutate(4u, 0.01f), OneMaxRank());
+  for (size_t threads : { 1u, 3u }) {
+    for (size_t batch_size : { 1u, 7u, 64u, 1000u }) {
+      PipelineConfig config;
+      config.breed_threads = threads;
+      config.rank_threads = threads + 1u;
+      config.batch_size = batch_size;
+      config.queue_capacity = 2u;
+      auto result = solve_pipeline(config, 20u, 300u, RandomInitializer(200u, 1u, 0.5f),
+                                   TournamentSelection(2u, 2u), RandomMixCrossOver(3u),
+                                   RandomMutate(4u, 0.01f), OneMaxRank());
+      BOOST_CHECK(same_gens(expected, result.best));
+      BOOST_CHECK_EQUAL(result.best_rank, OneMaxRank()(expected));
+      auto sliced = solve_pipeline(config, 20u, 300u, RandomInitializer(200u, 1u, 0.5f),
+                                   TournamentSelection(2u, 2u), RandomMixCrossOver(3u),
+                                   RandomMutate(4u, 0.01f), make_sliced_rank<4u>(OneMaxRank()));
+      BOOST_CHECK(same_gens(expected, sliced.best));
+    }
+  }
+  PipelineConfig config;
+  config.breed_threads = 2u;
+  config.rank_threads = 2u;
+  config.batch_size = 5u;
+  config.queue_capacity = 2u;
+  // thrown while ranking the initial population, and later
+  for (size_t population_size : { 1000u, 100u }) {
+    BOOST_CHECK_THROW(solve_pipeline(config, 20u, population_size,
+                                     RandomInitializer(200u, 1u, 0.5f),
+                                     TournamentSelection(2u, 2u), RandomMixCrossOver(3u),
+                                     RandomMutate(4u, 0.01f), ThrowingRank()),
+                      std::runtime_error);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(island_solver_improves_and_reports_errors) {
+  IslandConfig config;
+  config.seed = 3u;
+  config.num_migrants = 2u;
+  auto result = solve_islands(config, 50u, 50u, RandomInitializer(200u, 1u, 0.5f),
+                              TournamentSelection(2u), RandomMixCrossOver(3u),
+                              RandomMutate(4u, 0.005f), OneMaxRank());
+  BOOST_CHECK_EQUAL(result.islands.size(), config.num_islands);
+  BOOST_CHECK_GT(result.best_rank, 150.0f);
+  BOOST_CHECK_EQUAL(OneMaxRank()(result.best), result.best_rank);
+  size_t received = 0u;
+  for (const auto &island : result.islands) received += island.migrants_received;
+  BOOST_CHECK_GT(received, 0u);
+  // without migration, islands are independent and deterministic
+  config.migration_interval = 0u;
+  auto a = solve_islands(config, 20u, 50u, RandomInitializer(200u, 1u, 0.5f),
+                         TournamentSelection(2u), RandomMixCrossOver(3u),
+                         RandomMutate(4u, 0.005f), OneMaxRank());
+  auto b = solve_islands(config, 20u, 50u, RandomInitializer(200u, 1u, 0.5f),
+                         TournamentSelection(2u), RandomMixCrossOver(3u),
+                         RandomMutate(4u, 0.005f), OneMaxRank());
+  BOOST_CHECK(same_gens(a.best, b.best));
+  BOOST_CHECK_EQUAL(a.islands[0].migrants_sent, 0u);
+  BOOST_CHECK_THROW(solve_islands(config, 20u, 50u, RandomInitializer(200u, 1u, 0.5f),
+                                  TournamentSelection(2u), RandomMixCrossOver(3u),
+                                  RandomMutate(4u, 0.005f), ThrowingRank()),
+                    std::runtime_error);
+}
+
+/// UnixSocketTransport with small messages, so migrants are split
+struct SmallMessageTransport : UnixSocketTransport {
+  explicit SmallMessageTransport(const size_t num_workers) :
+    UnixSocketTransport(num_workers) {
+  }
+  size_t maxMessageSize() const {
+    return 1024u;
+  }
+  void send(const std::vector<char> &msg) {
+    if (msg.size() > maxMessageSize()) throw std::runtime_error("message too long");
+    UnixSocketTransport::send(msg);
+  }
+};
+
+BOOST_AUTO_TEST_CASE(process_islands_improve_and_report_errors) {
+  IslandConfig config;
+  config.num_islands = 3u;
+  config.seed = 3u;
+  auto result = solve_processes(config, 50u, 50u, RandomInitializer(200u, 1u, 0.5f),
+                                TournamentSelection(2u), RandomMixCrossOver(3u),
+                                RandomMutate(4u, 0.005f), OneMaxRank());
+  BOOST_CHECK_EQUAL(result.islands.size(), 3u);
+  BOOST_CHECK_GT(result.best_rank, 150.0f);
+  BOOST_CHECK_EQUAL(OneMaxRank()(result.best), result.best_rank);
+  for (const auto &island : result.islands) {
+    BOOST_CHECK_EQUAL(island.generations, 50u);
+  }
+  try {
+    solve_processes(config, 20u, 50u, RandomInitializer(200u, 1u, 0.5f),
+                    TournamentSelection(2u), RandomMixCrossOver(3u),
+                    RandomMutate(4u, 0.005f), ThrowingRank());
+    BOOST_ERROR("solve_processes should throw");
+  }
+  catch (std::runtime_error &e) {
+    BOOST_CHECK(std::string(e.what()).find("rank failed") != std::string::npos);
+  }
+  // 20 migrants of 1000 gens need 3 messages of 1024 bytes
+  config.num_islands = 2u;
+  config.num_migrants = 20u;
+  config.migration_interval = 5u;
+  SmallMessageTransport small(config.num_islands);
+  auto split = solve_processes(small, config, 20u, 50u, RandomInitializer(1000u, 1u, 0.5f),
+                               TournamentSelection(2u), RandomMixCrossOver(3u),
+                               RandomMutate(4u, 0.005f), OneMaxRank());
+  for (const auto &island : split.islands) {
+    BOOST_CHECK_EQUAL(island.migrants_sent + island.migrants_dropped, 4u*20u);
+  }
+  BOOST_CHECK_EQUAL(OneMaxRank()(split.best), split.best_rank);
+  SmallMessageTransport too_small(config.num_islands);
+  BOOST_CHECK_THROW(solve_processes(too_small, config, 20u, 50u,
+                                    RandomInitializer(10000u, 1u, 0.5f),
+                                    TournamentSelection(2u), RandomMixCrossOver(3u),
+                                    RandomMutate(4u, 0.005f), OneMaxRank()),
+                    std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(lsh_niche_counts_approach_exact_ones_with_any_pool) {
+  // clusters of chromosomes around 10 random centers
+  const size_t N = 256u, P = 300u;
+  const double radius = 40.0;
+  RandomInitializer init(N, 1u, 0.5f);
+  RandomMutate perturb(2u, 0.03f);
+  std::vector<Chromosome> centers;
+  for (size_t c=0; c<10u; ++c) centers.push_back(init());
+  ThreadPool pool(4u);
+  Population<OneMaxRank, float, Chromosome> population(OneMaxRank(), nullptr);
+  Chromosome x(N);
+  for (size_t i=0; i<P; ++i) {
+    perturb.stream(0u, i);
+    perturb(centers[i % centers.size()], x);
+    population.push(x);
+  }
+  BitSamplingLSH lsh(N, 8u, BitSamplingLSH::key_bits_for(N, radius), 3u);
+  std::vector<NicheScratch> scratch;
+  std::vector<double> exact, approx, exact_pool, approx_pool;
+  niche_counts(population, radius, 1.0, exact, scratch);
+  niche_counts(population, radius, 1.0, lsh, approx, scratch);
+  population.setPool(&pool);
+  niche_counts(population, radius, 1.0, exact_pool, scratch);
+  niche_counts(population, radius, 1.0, lsh, approx_pool, scratch);
+  BOOST_CHECK(exact == exact_pool);
+  BOOST_CHECK(approx == approx_pool);
+  // LSH only misses pairs, and it finds most neighbors inside radius
+  size_t neighbors = 0u, found = 0u;
+  std::vector<size_t> ids;
+  for (size_t i=0; i<P; ++i) {
+    BOOST_CHECK_LE(approx[i], exact[i] + 1e-9);
+    BOOST_CHECK_GE(approx[i], 1.0);
+    lsh.candidates(population.chromosome(i).blocks(), ids);
+    for (size_t j=0; j<P; ++j) {
+      const size_t d = BitKernels::hamming(population.chromosome(i).blocks(),
+                                           population.chromosome(j).blocks(),
+                                           population.chromosome(i).num_blocks());
+      if (j == i || !(d < radius)) continue;
+      ++neighbors;
+      if (std::find(ids.begin(), ids.end(), j) != ids.end()) ++found;
+    }
+  }
+  BOOST_REQUIRE_GT(neighbors, 0u);
+  BOOST_CHECK_GT(double(found) / neighbors, 0.95);
+  double exact_sum = 0.0, approx_sum = 0.0;
+  for (size_t i=0; i<P; ++i) {
+    exact_sum += exact[i];
+    approx_sum += approx[i];
+  }
+  BOOST_CHECK_GT(approx_sum / exact_sum, 0.95);
+}
+
+BOOST_AUTO_TEST_CASE(steady_state_solver_improves_with_every_policy) {
+  for (ReplacementPolicy policy : { ReplacementPolicy::WORST,
+        ReplacementPolicy::OLDEST, ReplacementPolicy::TOURNAMENT_LOSER,
+        ReplacementPolicy::CROWDING }) {
+    SteadyStateConfig config;
+    config.replacement = policy;
+    config.seed = 5u;
+    Chromosome a = solve_steady_state(config, 5000u, 100u,
+                                      RandomInitializer(200u, 1u, 0.5f),
+                                      TournamentSelection(2u), RandomMixCrossOver(3u),
+                                      RandomMutate(4u, 0.005f), OneMaxRank());
+    // a single worker is deterministic
+    Chromosome b = solve_steady_state(config, 5000u, 100u,
+                                      RandomInitializer(200u, 1u, 0.5f),
+                                      TournamentSelection(2u), RandomMixCrossOver(3u),
+                                      RandomMutate(4u, 0.005f), OneMaxRank());
+    BOOST_CHECK(same_gens(a, b));
+    BOOST_CHECK_GT(OneMaxRank()(a), 130.0f);
+    config.num_threads = 4u;
+    config.lsh_threshold = 10u;
+    Chromosome c = solve_steady_state(config, 5000u, 100u,
+                                      RandomInitializer(200u, 1u, 0.5f),
+                                      make_fitness_sharing(20.0, 1.0, TournamentSelection(2u),
+                                                           50u, 8u, 7u),
+                                      RandomMixCrossOver(3u),
+                                      RandomMutate(4u, 0.005f), OneMaxRank());
+    BOOST_CHECK_GT(OneMaxRank()(c), 120.0f);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(rank_heap_finds_the_two_worst_positions) {
+  std::mt19937_64 rng(7u);
+  std::vector<int> ranks(37u);
+  for (int &r : ranks) r = static_cast<int>(rng() % 10u);
+  RankHeap<int> heap(ranks);
+  for (size_t step=0u; step<1000u; ++step) {
+    // the lowest rank, ties won by the first position
+    const size_t worst = std::min_element(ranks.begin(), ranks.end()) - ranks.begin();
+    BOOST_CHECK_EQUAL(heap.top(), worst);
+    size_t next_worst = (worst == 0u) ? 1u : 0u;
+    for (size_t i=0u; i<ranks.size(); ++i) {
+      if (i != worst && ranks[i] < ranks[next_worst]) next_worst = i;
+    }
+    BOOST_CHECK_EQUAL(heap.second(), next_worst);
+    const size_t i = rng() % ranks.size();
+    ranks[i] = static_cast<int>(rng() % 10u);
+    heap.update(i, ranks[i]);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(steady_state_crowding_out_of_the_mutex_improves) {
+  SteadyStateConfig config;
+  config.replacement = ReplacementPolicy::CROWDING;
+  config.seed = 5u;
+  config.num_threads = 4u;
+  config.lsh_threshold = 1000u;
+  Chromosome c = solve_steady_state(config, 5000u, 100u,
+                                    RandomInitializer(200u, 1u, 0.5f),
+                                    TournamentSelection(2u), RandomMixCrossOver(3u),
+                                    RandomMutate(4u, 0.005f), OneMaxRank());
+  BOOST_CHECK_GT(OneMaxRank()(c), 120.0f);
+}